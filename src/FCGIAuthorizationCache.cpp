@@ -0,0 +1,121 @@
+#include "FCGIAuthorizationCache.h"
+#include "ThreadLogger.h"
+#include <algorithm>
+
+using namespace std;
+
+FCGIAuthorizationCache::FCGIAuthorizationCache(const size_t maxEntries, const chrono::seconds ttl)
+	: _maxEntries(maxEntries), _maxShardEntries(max<size_t>(maxEntries / shardsNumber, 1)), _ttl(ttl)
+{
+}
+
+shared_ptr<FCGIAuthorizationCache> FCGIAuthorizationCache::processCache(const size_t maxEntries, const chrono::seconds ttl)
+{
+	lock_guard locker(_processCacheMutex);
+
+	if (!_processCache)
+	{
+		_processCache = make_shared<FCGIAuthorizationCache>(maxEntries, ttl);
+
+		LOG_INFO(
+			"FCGIAuthorizationCache created"
+			", maxEntries: {}"
+			", ttl: {}",
+			maxEntries, ttl.count()
+		);
+	}
+	else if (_processCache->_maxEntries != maxEntries || _processCache->_ttl != ttl)
+		LOG_WARN(
+			"FCGIAuthorizationCache already created with a different configuration, it is used as is"
+			", maxEntries: {}"
+			", ttl: {}"
+			", requested maxEntries: {}"
+			", requested ttl: {}",
+			_processCache->_maxEntries, _processCache->_ttl.count(), maxEntries, ttl.count()
+		);
+
+	return _processCache;
+}
+
+size_t FCGIAuthorizationCache::shardIndex(const string_view credentials)
+{
+	// i bit alti dell'hash per lo shard, i bassi restano per i bucket della mappa dello shard
+	return (CredentialsHash{}(credentials) >> ((sizeof(size_t) - 1) * 8)) % shardsNumber;
+}
+
+shared_ptr<FCGIRequestData::AuthorizationDetails> FCGIAuthorizationCache::find(const string_view credentials) const
+{
+	const Shard &credentialsShard = _shards[shardIndex(credentials)];
+
+	shared_lock locker(credentialsShard.mutex);
+
+	const auto it = credentialsShard.entries.find(credentials);
+	if (it == credentialsShard.entries.end() || it->second.expiration <= chrono::steady_clock::now())
+		return nullptr;
+
+	return it->second.authorizationDetails;
+}
+
+void FCGIAuthorizationCache::insert(
+	const string_view credentials, const string_view userName, shared_ptr<FCGIRequestData::AuthorizationDetails> authorizationDetails,
+	const uint64_t generation
+)
+{
+	Shard &credentialsShard = _shards[shardIndex(credentials)];
+	const auto now = chrono::steady_clock::now();
+
+	lock_guard locker(credentialsShard.mutex);
+
+	// invalidate incrementa _generation prima di svuotare gli shard: sotto il lock dello shard o l'inserimento vede
+	// il nuovo valore, o la entry inserita viene poi eliminata dall'invalidate
+	if (_generation.load(memory_order_acquire) != generation)
+	{
+		LOG_DEBUG(
+			"FCGIAuthorizationCache insert skipped, invalidated during checkAuthorization"
+			", userName: {}",
+			userName
+		);
+
+		return;
+	}
+
+	if (credentialsShard.entries.size() >= _maxShardEntries && !credentialsShard.entries.contains(credentials))
+	{
+		// shard pieno: prima le entry scadute, altrimenti quella più vicina alla scadenza
+		erase_if(credentialsShard.entries, [now](const auto &entry) { return entry.second.expiration <= now; });
+		if (credentialsShard.entries.size() >= _maxShardEntries)
+			credentialsShard.entries.erase(ranges::min_element(credentialsShard.entries, {}, [](const auto &entry) { return entry.second.expiration; }));
+	}
+
+	credentialsShard.entries.insert_or_assign(string(credentials), Entry{string(userName), std::move(authorizationDetails), now + _ttl});
+}
+
+void FCGIAuthorizationCache::invalidate(const string_view userName)
+{
+	_generation.fetch_add(1, memory_order_acq_rel);
+
+	size_t invalidated = 0;
+	for (Shard &credentialsShard : _shards)
+	{
+		lock_guard locker(credentialsShard.mutex);
+		invalidated += erase_if(credentialsShard.entries, [userName](const auto &entry) { return entry.second.userName == userName; });
+	}
+
+	LOG_INFO(
+		"FCGIAuthorizationCache invalidate"
+		", userName: {}"
+		", invalidated: {}",
+		userName, invalidated
+	);
+}
+
+void FCGIAuthorizationCache::clear()
+{
+	_generation.fetch_add(1, memory_order_acq_rel);
+
+	for (Shard &credentialsShard : _shards)
+	{
+		lock_guard locker(credentialsShard.mutex);
+		credentialsShard.entries.clear();
+	}
+}
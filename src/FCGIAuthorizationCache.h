@@ -0,0 +1,104 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIRequestData.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Cache (di processo) dei risultati di FastCGIAPI::checkAuthorization, per credenziali
+// (valore Base64 dell'header Authorization: Basic): una richiesta con credenziali già verificate
+// non decodifica l'header e non chiama checkAuthorization fino alla scadenza (ttl).
+// Vengono memorizzati solo gli esiti positivi. La chiave viene confrontata per intero,
+// l'hash sceglie solo lo shard e il bucket.
+// Shard con shared_mutex: le ricerche, la quasi totalità, prendono il lock condiviso del solo shard.
+// Gli AuthorizationDetails in cache sono condivisi tra richieste e thread: vanno trattati in sola lettura
+class FCGIAuthorizationCache final
+{
+public:
+	FCGIAuthorizationCache(size_t maxEntries, std::chrono::seconds ttl);
+	~FCGIAuthorizationCache() = default;
+
+	FCGIAuthorizationCache(const FCGIAuthorizationCache &) = delete;
+	FCGIAuthorizationCache &operator=(const FCGIAuthorizationCache &) = delete;
+
+	// ritorna la cache del processo, creandola alla prima chiamata: le chiamate successive
+	// con una configurazione diversa ricevono la stessa cache (con un warning)
+	static std::shared_ptr<FCGIAuthorizationCache> processCache(size_t maxEntries, std::chrono::seconds ttl);
+
+	// nullptr se le credenziali non sono in cache o sono scadute
+	[[nodiscard]] std::shared_ptr<FCGIRequestData::AuthorizationDetails> find(std::string_view credentials) const;
+	// generation: generation() letto prima di checkAuthorization. Se nel frattempo c'è stata una invalidate/clear
+	// l'autorizzazione può essere già revocata e non viene inserita
+	void insert(std::string_view credentials, std::string_view userName,
+		std::shared_ptr<FCGIRequestData::AuthorizationDetails> authorizationDetails, uint64_t generation);
+
+	// da chiamare quando cambiano credenziali o permessi di userName (es. cambio password, utente disabilitato)
+	void invalidate(std::string_view userName);
+	void clear();
+
+	// incrementato da ogni invalidate/clear
+	[[nodiscard]] uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+
+private:
+	struct CredentialsHash
+	{
+		using is_transparent = void;
+		size_t operator()(const std::string_view credentials) const { return std::hash<std::string_view>{}(credentials); }
+	};
+
+	struct Entry
+	{
+		std::string userName;
+		std::shared_ptr<FCGIRequestData::AuthorizationDetails> authorizationDetails;
+		std::chrono::steady_clock::time_point expiration;
+	};
+
+	// allineato alla cache line: i lock di shard diversi non condividono la linea
+	struct alignas(64) Shard
+	{
+		mutable std::shared_mutex mutex;
+		std::unordered_map<std::string, Entry, CredentialsHash, std::equal_to<>> entries;
+	};
+
+	static constexpr size_t shardsNumber = 16;
+
+	// come richiesto a processCache, per segnalare configurazioni diverse
+	size_t _maxEntries;
+	size_t _maxShardEntries;
+	std::chrono::seconds _ttl;
+	std::atomic<uint64_t> _generation{};
+	std::array<Shard, shardsNumber> _shards;
+
+	static inline std::mutex _processCacheMutex;
+	static inline std::shared_ptr<FCGIAuthorizationCache> _processCache;
+
+	static size_t shardIndex(std::string_view credentials);
+};
@@ -0,0 +1,192 @@
+#include "FCGIBase64.h"
+#include <array>
+#include <format>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+constexpr string_view encodeTable = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// valore a 6 bit di ogni carattere, -1 se il carattere non appartiene all'alfabeto
+constexpr array<int8_t, 256> decodeTable = []
+{
+	array<int8_t, 256> table{};
+	table.fill(-1);
+	for (size_t index = 0; index < encodeTable.size(); index++)
+		table[static_cast<uint8_t>(encodeTable[index])] = static_cast<int8_t>(index);
+	return table;
+}();
+
+#ifdef __SSE2__
+// byte di chunk compresi in [low, high]: con il bias di -128 - low il confronto signed equivale a quello unsigned
+__m128i bytesInRange(const __m128i chunk, const char low, const char high)
+{
+	return _mm_cmplt_epi8(
+		_mm_add_epi8(chunk, _mm_set1_epi8(static_cast<char>(-128 - low))), _mm_set1_epi8(static_cast<char>(-128 + (high - low + 1)))
+	);
+}
+
+// decodifica 16 caratteri in 12 byte, false (out non scritto) se il blocco contiene un carattere non valido
+bool decodeBlock(const char *in, char *out)
+{
+	const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(in));
+	const __m128i upper = bytesInRange(chunk, 'A', 'Z');
+	const __m128i lower = bytesInRange(chunk, 'a', 'z');
+	const __m128i digit = bytesInRange(chunk, '0', '9');
+	const __m128i plus = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('+'));
+	const __m128i slash = _mm_cmpeq_epi8(chunk, _mm_set1_epi8('/'));
+	if (_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, plus)), slash)) != 0xFFFF)
+		return false;
+
+	// valore a 6 bit = carattere + offset della sua classe: 'A' -> 0, 'a' -> 26, '0' -> 52, '+' -> 62, '/' -> 63
+	__m128i offset = _mm_and_si128(upper, _mm_set1_epi8(-65));
+	offset = _mm_or_si128(offset, _mm_and_si128(lower, _mm_set1_epi8(-71)));
+	offset = _mm_or_si128(offset, _mm_and_si128(digit, _mm_set1_epi8(4)));
+	offset = _mm_or_si128(offset, _mm_and_si128(plus, _mm_set1_epi8(19)));
+	offset = _mm_or_si128(offset, _mm_and_si128(slash, _mm_set1_epi8(16)));
+	const __m128i values = _mm_add_epi8(chunk, offset);
+
+	// 2 valori da 6 bit -> 12 bit per lane a 16 bit, 2 lane a 16 bit -> 24 bit per lane a 32 bit
+	// (il primo carattere nei bit più significativi)
+	const __m128i pairs = _mm_or_si128(_mm_slli_epi16(_mm_and_si128(values, _mm_set1_epi16(0x00FF)), 6), _mm_srli_epi16(values, 8));
+	const __m128i quads = _mm_or_si128(_mm_slli_epi32(_mm_and_si128(pairs, _mm_set1_epi32(0x0000FFFF)), 12), _mm_srli_epi32(pairs, 16));
+
+	alignas(16) uint32_t triples[4];
+	_mm_store_si128(reinterpret_cast<__m128i *>(triples), quads);
+	for (const uint32_t triple : triples)
+	{
+		*out++ = static_cast<char>(triple >> 16);
+		*out++ = static_cast<char>(triple >> 8);
+		*out++ = static_cast<char>(triple);
+	}
+
+	return true;
+}
+#endif
+} // namespace
+
+string FCGIBase64::DecodeError::message() const
+{
+	return std::format(
+		"Base64 decode failed"
+		", reason: {}"
+		", position: {}",
+		reason == Reason::InvalidCharacter ? "invalid character" : "invalid length", position
+	);
+}
+
+size_t FCGIBase64::encode(const string_view in, char *out)
+{
+	const auto *data = reinterpret_cast<const uint8_t *>(in.data());
+	const size_t size = in.size();
+	char *outStart = out;
+
+	size_t index = 0;
+	for (; index + 3 <= size; index += 3)
+	{
+		const uint32_t triple = data[index] << 16 | data[index + 1] << 8 | data[index + 2];
+		*out++ = encodeTable[triple >> 18];
+		*out++ = encodeTable[triple >> 12 & 0x3F];
+		*out++ = encodeTable[triple >> 6 & 0x3F];
+		*out++ = encodeTable[triple & 0x3F];
+	}
+	if (const size_t remaining = size - index; remaining > 0)
+	{
+		const uint32_t triple = data[index] << 16 | (remaining == 2 ? data[index + 1] << 8 : 0);
+		*out++ = encodeTable[triple >> 18];
+		*out++ = encodeTable[triple >> 12 & 0x3F];
+		*out++ = remaining == 2 ? encodeTable[triple >> 6 & 0x3F] : '=';
+		*out++ = '=';
+	}
+
+	return out - outStart;
+}
+
+string FCGIBase64::encode(const string_view in)
+{
+	string out;
+	out.resize_and_overwrite(encodedLength(in.size()), [in](char *buffer, size_t) { return encode(in, buffer); });
+
+	return out;
+}
+
+expected<size_t, FCGIBase64::DecodeError> FCGIBase64::decode(const string_view in, char *out)
+{
+	// padding: al massimo due '=' finali, solo su input di lunghezza multipla di 4
+	size_t length = in.size();
+	if (length > 0 && in[length - 1] == '=')
+	{
+		length--;
+		if (length > 0 && in[length - 1] == '=')
+			length--;
+		if (in.size() % 4 != 0)
+			return unexpected(DecodeError{DecodeError::Reason::InvalidLength, length});
+	}
+	if (length % 4 == 1)
+		return unexpected(DecodeError{DecodeError::Reason::InvalidLength, length});
+
+	const auto *data = reinterpret_cast<const uint8_t *>(in.data());
+	char *outStart = out;
+
+	size_t index = 0;
+#ifdef __SSE2__
+	// un blocco con un carattere non valido viene lasciato al ciclo scalare, che ne individua la posizione
+	for (; index + 16 <= length; index += 16, out += 12)
+	{
+		if (!decodeBlock(in.data() + index, out))
+			break;
+	}
+#endif
+
+	const auto invalidCharacter = [&](const size_t from)
+	{
+		size_t position = from;
+		while (decodeTable[data[position]] >= 0)
+			position++;
+		return unexpected(DecodeError{DecodeError::Reason::InvalidCharacter, position});
+	};
+
+	for (; index + 4 <= length; index += 4)
+	{
+		const int32_t first = decodeTable[data[index]];
+		const int32_t second = decodeTable[data[index + 1]];
+		const int32_t third = decodeTable[data[index + 2]];
+		const int32_t fourth = decodeTable[data[index + 3]];
+		if ((first | second | third | fourth) < 0)
+			return invalidCharacter(index);
+
+		const uint32_t triple = first << 18 | second << 12 | third << 6 | fourth;
+		*out++ = static_cast<char>(triple >> 16);
+		*out++ = static_cast<char>(triple >> 8);
+		*out++ = static_cast<char>(triple);
+	}
+
+	// 2 o 3 caratteri finali (padding assente o già rimosso): 1 o 2 byte
+	if (const size_t remaining = length - index; remaining > 0)
+	{
+		const int32_t first = decodeTable[data[index]];
+		const int32_t second = decodeTable[data[index + 1]];
+		const int32_t third = remaining == 3 ? decodeTable[data[index + 2]] : 0;
+		if ((first | second | third) < 0)
+			return invalidCharacter(index);
+
+		*out++ = static_cast<char>(first << 2 | second >> 4);
+		if (remaining == 3)
+			*out++ = static_cast<char>(second << 4 | third >> 2);
+	}
+
+	return out - outStart;
+}
+
+expected<string, FCGIBase64::DecodeError> FCGIBase64::decode(const string_view in)
+{
+	string out;
+	if (auto decoded = decode(in, out); !decoded)
+		return unexpected(decoded.error());
+
+	return out;
+}
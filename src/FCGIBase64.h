@@ -0,0 +1,75 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <string>
+#include <string_view>
+
+// Base64 (RFC 4648, alfabeto standard) senza allocazioni oltre all'output:
+//	- encode/decode su un buffer del chiamante già dimensionato (encodedLength/decodedMaxLength)
+//	  oppure in una stringa del chiamante riutilizzabile (es. std::pmr::string dell'arena della richiesta)
+//	- decode accetta l'input con o senza padding '=' e con SSE2 traduce e valida 16 caratteri alla volta
+//	- un carattere non valido non viene ignorato: decode ritorna DecodeError con la sua posizione
+class FCGIBase64 final
+{
+public:
+	struct DecodeError
+	{
+		enum class Reason : uint8_t
+		{
+			InvalidCharacter,
+			// lunghezza (senza padding) % 4 == 1 oppure padding non finale
+			InvalidLength
+		};
+
+		Reason reason;
+		size_t position;
+
+		[[nodiscard]] std::string message() const;
+	};
+
+	static constexpr size_t encodedLength(const size_t size) { return (size + 2) / 3 * 4; }
+	static constexpr size_t decodedMaxLength(const size_t size) { return (size + 3) / 4 * 3; }
+
+	// out: almeno encodedLength(in.size()) byte, ritorna i byte scritti
+	static size_t encode(std::string_view in, char *out);
+	static std::string encode(std::string_view in);
+
+	// out: almeno decodedMaxLength(in.size()) byte, ritorna i byte scritti
+	static std::expected<size_t, DecodeError> decode(std::string_view in, char *out);
+	static std::expected<std::string, DecodeError> decode(std::string_view in);
+
+	// decodifica in out (es. buffer riutilizzato tra le richieste), la string_view ritornata punta in out
+	template <typename S> static std::expected<std::string_view, DecodeError> decode(const std::string_view in, S &out)
+	{
+		out.resize(decodedMaxLength(in.size()));
+		const auto decodedLength = decode(in, out.data());
+		if (!decodedLength)
+			return std::unexpected(decodedLength.error());
+		out.resize(*decodedLength);
+
+		return std::string_view(out.data(), out.size());
+	}
+};
@@ -0,0 +1,812 @@
+#include "FCGIConnection.h"
+#include "ThreadLogger.h"
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <array>
+#include <format>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+// deve contenere almeno un record di dimensione massima (header + content + padding)
+constexpr size_t readBufferSize = 2 * (FCGIProtocol::headerLength + FCGIProtocol::maxContentLength + 0xFF);
+constexpr size_t outputBufferSize = 16 * 1024;
+constexpr size_t errorBufferSize = 1024;
+// record FCGI_STDOUT inviati con una sola writev da putStr
+constexpr size_t putStrRecordsPerWrite = 32;
+
+// sendfile non ha MSG_NOSIGNAL: SIGPIPE (client disconnesso) viene bloccato nel thread durante l'invio
+// e, se generato dall'invio, scartato prima di ripristinare la maschera. Un SIGPIPE già pendente
+// (di altri, es. inviato al processo) non viene consumato
+class SigpipeBlock final
+{
+public:
+	SigpipeBlock()
+	{
+		sigemptyset(&_sigpipe);
+		sigaddset(&_sigpipe, SIGPIPE);
+		pthread_sigmask(SIG_BLOCK, &_sigpipe, &_previousMask);
+
+		sigset_t pending;
+		_sigpipePending = sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE);
+	}
+	~SigpipeBlock()
+	{
+		sigset_t pending;
+		if (!_sigpipePending && sigpending(&pending) == 0 && sigismember(&pending, SIGPIPE))
+		{
+			constexpr timespec noWait{};
+			sigtimedwait(&_sigpipe, nullptr, &noWait);
+		}
+		pthread_sigmask(SIG_SETMASK, &_previousMask, nullptr);
+	}
+
+	SigpipeBlock(const SigpipeBlock &) = delete;
+	SigpipeBlock &operator=(const SigpipeBlock &) = delete;
+
+private:
+	sigset_t _sigpipe{};
+	sigset_t _previousMask{};
+	bool _sigpipePending{};
+};
+} // namespace
+
+FCGIConnection::FCGIConnection(const int socket, const uint32_t maxConnections, const uint32_t maxRequests)
+	: _socket(socket), _maxConnections(maxConnections), _maxRequests(maxRequests)
+{
+	_readBuffer.resize(readBufferSize);
+}
+
+FCGIConnection::~FCGIConnection()
+{
+	_activeRequests -= static_cast<uint32_t>(_requests.size());
+	close(_socket);
+}
+
+bool FCGIConnection::hasBufferedInput() const { return !_readyRequests.empty() || bufferedRecordAvailable(); }
+
+FCGX_Request *FCGIConnection::readRequest()
+{
+	_finishedRequests.clear();
+
+	if (_dispatchedRequest != nullptr)
+	{
+		LOG_ERROR(
+			"readRequest called while a request is still in progress"
+			", socket: {}"
+			", requestId: {}",
+			_socket, _dispatchedRequest->requestId
+		);
+
+		return nullptr;
+	}
+
+	bool received = false;
+	while (!_closed)
+	{
+		if (!_readyRequests.empty())
+		{
+			const uint16_t requestId = _readyRequests.front();
+			_readyRequests.pop_front();
+
+			// la richiesta potrebbe essere stata abortita nel frattempo
+			const auto it = _requests.find(requestId);
+			if (it == _requests.end())
+				continue;
+
+			it->second->dispatched = true;
+			_dispatchedRequest = it->second.get();
+
+			return &_dispatchedRequest->fcgxRequest;
+		}
+
+		if (!bufferedRecordAvailable())
+		{
+			// una sola recv per chiamata, il resto arriverà al prossimo poll
+			if (received)
+				return nullptr;
+			if (!receive())
+			{
+				closeConnection();
+				return nullptr;
+			}
+			received = true;
+
+			continue;
+		}
+
+		FCGIProtocol::RecordHeader header{};
+		string_view content;
+		if (!readRecord(header, content))
+		{
+			closeConnection();
+			return nullptr;
+		}
+		processRecord(header, content);
+	}
+
+	return nullptr;
+}
+
+void FCGIConnection::finishRequest(FCGX_Request &fcgxRequest)
+{
+	const auto &stream = *static_cast<Stream *>(fcgxRequest.out->data);
+	FCGIConnection &connection = *stream.connection;
+	Request &request = *stream.request;
+
+	for (Stream *outputStream : {&request.err, &request.out})
+	{
+		if (outputStream->fcgxStream.wasFCloseCalled)
+			continue;
+		emptyOutputBuffer(&outputStream->fcgxStream, 1);
+		outputStream->fcgxStream.isClosed = 1;
+		outputStream->fcgxStream.wasFCloseCalled = 1;
+	}
+
+	// consuma l'eventuale FCGI_STDIN non letto dall'handler, altrimenti i record
+	// rimarrebbero sulla connessione e verrebbero interpretati come record della richiesta successiva
+	while (!request.stdinComplete && !connection._closed)
+	{
+		FCGIProtocol::RecordHeader header{};
+		string_view content;
+		if (!connection.readRecord(header, content))
+		{
+			connection.closeConnection();
+			break;
+		}
+		connection.processRecord(header, content);
+		request.pendingInput.clear();
+	}
+
+	if (!connection._closed)
+		connection.endRequest(request.requestId, FCGIProtocol::requestComplete);
+
+	const bool keepConnection = request.keepConnection;
+
+	if (const auto it = connection._requests.find(request.requestId); it != connection._requests.end())
+	{
+		connection._finishedRequests.push_back(std::move(it->second));
+		connection._requests.erase(it);
+		--_activeRequests;
+	}
+	connection._dispatchedRequest = nullptr;
+
+	if (!keepConnection)
+		connection.closeConnection();
+}
+
+bool FCGIConnection::isNativeRequest(const FCGX_Request &request)
+{
+	return request.out != nullptr && request.out->emptyBuffProc == &FCGIConnection::emptyOutputBuffer;
+}
+
+int FCGIConnection::putStr(FCGX_Request &request, const string_view content)
+{
+	// content piccolo: la copia nel buffer dello stream costa meno di una send dedicata
+	if (!isNativeRequest(request) || content.size() < outputBufferSize)
+		return FCGX_PutStr(content.data(), static_cast<int>(content.size()), request.out);
+
+	FCGX_Stream *fcgxStream = request.out;
+	if (fcgxStream->isClosed)
+		return -1;
+
+	auto &stream = *static_cast<Stream *>(fcgxStream->data);
+	FCGIConnection &connection = *stream.connection;
+	const uint16_t requestId = stream.request->requestId;
+
+	// quanto già nel buffer dello stream viene inviato nella prima writev, con il suo header (riservato in testa al buffer)
+	auto *data = reinterpret_cast<unsigned char *>(stream.buffer.data());
+	size_t bufferedLength = fcgxStream->wrNext - (data + FCGIProtocol::headerLength);
+	if (bufferedLength > 0)
+		FCGIProtocol::encodeHeader(data, stream.recordType, requestId, static_cast<uint16_t>(bufferedLength));
+
+	array<unsigned char, putStrRecordsPerWrite * FCGIProtocol::headerLength> headers;
+	array<iovec, 1 + 2 * putStrRecordsPerWrite> iov;
+
+	bool success = true;
+	size_t offset = 0;
+	while (success && offset < content.size())
+	{
+		int iovCount = 0;
+		if (bufferedLength > 0)
+		{
+			iov[iovCount++] = {data, FCGIProtocol::headerLength + bufferedLength};
+			bufferedLength = 0;
+		}
+		for (size_t recordIndex = 0; recordIndex < putStrRecordsPerWrite && offset < content.size(); recordIndex++)
+		{
+			const size_t recordLength = min(content.size() - offset, FCGIProtocol::maxContentLength);
+			unsigned char *header = headers.data() + recordIndex * FCGIProtocol::headerLength;
+			FCGIProtocol::encodeHeader(header, stream.recordType, requestId, static_cast<uint16_t>(recordLength));
+			iov[iovCount++] = {header, FCGIProtocol::headerLength};
+			iov[iovCount++] = {const_cast<char *>(content.data() + offset), recordLength};
+			offset += recordLength;
+		}
+		success = connection.writeAll(iov.data(), iovCount);
+	}
+	stream.written = true;
+	fcgxStream->wrNext = data + FCGIProtocol::headerLength;
+
+	if (!success)
+	{
+		fcgxStream->isClosed = 1;
+		fcgxStream->FCGI_errno = errno != 0 ? errno : EPIPE;
+
+		return -1;
+	}
+
+	return static_cast<int>(content.size());
+}
+
+bool FCGIConnection::sendFile(FCGX_Request &request, const int fd, uint64_t offset, uint64_t length)
+{
+	FCGX_Stream *fcgxStream = request.out;
+	if (!isNativeRequest(request) || fcgxStream->isClosed)
+		return false;
+
+	auto &stream = *static_cast<Stream *>(fcgxStream->data);
+	FCGIConnection &connection = *stream.connection;
+	const uint16_t requestId = stream.request->requestId;
+
+	// prima quanto già scritto nello stream (es. gli header della risposta)
+	emptyOutputBuffer(fcgxStream, 0);
+	if (fcgxStream->isClosed)
+		return false;
+
+	SigpipeBlock sigpipeBlock;
+
+	bool success = true;
+	unsigned char header[FCGIProtocol::headerLength];
+	while (success && length > 0)
+	{
+		const size_t recordLength = min<uint64_t>(length, FCGIProtocol::maxContentLength);
+		FCGIProtocol::encodeHeader(header, stream.recordType, requestId, static_cast<uint16_t>(recordLength));
+		success = connection.writeAll(header, sizeof(header), true) && connection.sendFileAll(fd, offset, recordLength);
+		offset += recordLength;
+		length -= recordLength;
+	}
+	stream.written = true;
+
+	if (!success)
+	{
+		fcgxStream->isClosed = 1;
+		fcgxStream->FCGI_errno = errno != 0 ? errno : EPIPE;
+	}
+
+	return success;
+}
+
+bool FCGIConnection::bufferedRecordAvailable() const
+{
+	const size_t available = _readEnd - _readStart;
+	if (available < FCGIProtocol::headerLength)
+		return false;
+
+	const FCGIProtocol::RecordHeader header = FCGIProtocol::decodeHeader(_readBuffer.data() + _readStart);
+
+	return available >= FCGIProtocol::headerLength + header.contentLength + header.paddingLength;
+}
+
+bool FCGIConnection::receive()
+{
+	if (_closed)
+		return false;
+
+	// compatta il buffer: i record già processati non servono più
+	if (_readStart > 0)
+	{
+		memmove(_readBuffer.data(), _readBuffer.data() + _readStart, _readEnd - _readStart);
+		_readEnd -= _readStart;
+		_readStart = 0;
+	}
+
+	while (true)
+	{
+		const ssize_t received = recv(_socket, _readBuffer.data() + _readEnd, _readBuffer.size() - _readEnd, 0);
+		if (received > 0)
+		{
+			_readEnd += received;
+			return true;
+		}
+		if (received == 0)
+		{
+			LOG_TRACE(
+				"FCGIConnection closed by peer"
+				", socket: {}",
+				_socket
+			);
+			return false;
+		}
+		if (errno == EINTR)
+			continue;
+
+		LOG_ERROR(
+			"recv failed"
+			", socket: {}"
+			", errno: {}",
+			_socket, strerror(errno)
+		);
+		return false;
+	}
+}
+
+bool FCGIConnection::readRecord(FCGIProtocol::RecordHeader &header, string_view &content)
+{
+	while (!bufferedRecordAvailable())
+	{
+		if (!receive())
+			return false;
+	}
+
+	header = FCGIProtocol::decodeHeader(_readBuffer.data() + _readStart);
+	if (header.version != FCGIProtocol::version1)
+	{
+		LOG_ERROR(
+			"Unsupported FastCGI protocol version"
+			", socket: {}"
+			", version: {}",
+			_socket, header.version
+		);
+		return false;
+	}
+
+	content = string_view(reinterpret_cast<const char *>(_readBuffer.data() + _readStart + FCGIProtocol::headerLength), header.contentLength);
+	_readStart += FCGIProtocol::headerLength + header.contentLength + header.paddingLength;
+
+	return true;
+}
+
+void FCGIConnection::processRecord(const FCGIProtocol::RecordHeader &header, const string_view content)
+{
+	if (header.requestId == 0)
+	{
+		processManagementRecord(header, content);
+		return;
+	}
+
+	if (header.type == FCGIProtocol::beginRequest)
+	{
+		beginRequest(header.requestId, content);
+		return;
+	}
+
+	const auto it = _requests.find(header.requestId);
+	if (it == _requests.end())
+	{
+		LOG_TRACE(
+			"Record for an unknown request, ignored"
+			", socket: {}"
+			", requestId: {}"
+			", type: {}",
+			_socket, header.requestId, header.type
+		);
+		return;
+	}
+	Request &request = *it->second;
+
+	switch (header.type)
+	{
+	case FCGIProtocol::abortRequest:
+		if (request.dispatched)
+		{
+			// l'handler è in esecuzione: lo stdin viene chiuso, la risposta verrà scartata da nginx
+			request.aborted = true;
+			request.stdinComplete = true;
+			request.pendingInput.clear();
+		}
+		else
+		{
+			const bool keepConnection = request.keepConnection;
+			endRequest(request.requestId, FCGIProtocol::requestComplete);
+			_requests.erase(it);
+			--_activeRequests;
+			if (!keepConnection)
+				closeConnection();
+		}
+		break;
+	case FCGIProtocol::params:
+		if (request.paramsComplete)
+			break;
+		if (content.empty())
+		{
+			request.paramsComplete = true;
+			prepareRequest(request);
+			_readyRequests.push_back(request.requestId);
+		}
+		else
+			request.params.append(content);
+		break;
+	case FCGIProtocol::stdIn:
+		if (request.stdinComplete)
+			break;
+		if (content.empty())
+			request.stdinComplete = true;
+		else
+			request.pendingInput.emplace_back(content);
+		break;
+	default:
+		// FCGI_DATA è previsto solo per il ruolo FILTER, che non è supportato
+		break;
+	}
+}
+
+void FCGIConnection::processManagementRecord(const FCGIProtocol::RecordHeader &header, const string_view content)
+{
+	if (header.type == FCGIProtocol::getValues)
+	{
+		string result;
+		string_view names = content;
+		string_view name;
+		string_view value;
+		while (FCGIProtocol::decodeNameValue(names, name, value))
+		{
+			if (name == FCGIProtocol::maxConns)
+				FCGIProtocol::appendNameValue(result, name, to_string(_maxConnections));
+			else if (name == FCGIProtocol::maxReqs)
+				FCGIProtocol::appendNameValue(result, name, to_string(_maxRequests));
+			else if (name == FCGIProtocol::mpxsConns)
+				FCGIProtocol::appendNameValue(result, name, "1");
+		}
+
+		LOG_TRACE(
+			"FCGI_GET_VALUES"
+			", socket: {}"
+			", maxConnections: {}"
+			", maxRequests: {}",
+			_socket, _maxConnections, _maxRequests
+		);
+
+		writeRecord(FCGIProtocol::getValuesResult, 0, result);
+	}
+	else
+	{
+		char body[8]{};
+		body[0] = static_cast<char>(header.type);
+		writeRecord(FCGIProtocol::unknownType, 0, string_view(body, sizeof(body)));
+	}
+}
+
+void FCGIConnection::beginRequest(const uint16_t requestId, const string_view content)
+{
+	if (content.size() < 8)
+	{
+		LOG_ERROR(
+			"Wrong FCGI_BEGIN_REQUEST body"
+			", socket: {}"
+			", requestId: {}",
+			_socket, requestId
+		);
+		closeConnection();
+		return;
+	}
+	if (_requests.contains(requestId))
+	{
+		LOG_ERROR(
+			"FCGI_BEGIN_REQUEST for a request already in progress"
+			", socket: {}"
+			", requestId: {}",
+			_socket, requestId
+		);
+		return;
+	}
+
+	const auto *body = reinterpret_cast<const unsigned char *>(content.data());
+	const uint16_t role = (body[0] << 8) | body[1];
+	const bool keepConnection = (body[2] & FCGIProtocol::flagKeepConn) != 0;
+
+	if (role != FCGIProtocol::roleResponder || _activeRequests >= _maxRequests)
+	{
+		LOG_WARN(
+			"FCGI_BEGIN_REQUEST rejected"
+			", socket: {}"
+			", requestId: {}"
+			", role: {}"
+			", activeRequests: {}"
+			", maxRequests: {}",
+			_socket, requestId, role, _activeRequests.load(), _maxRequests
+		);
+		endRequest(requestId, role != FCGIProtocol::roleResponder ? FCGIProtocol::unknownRole : FCGIProtocol::overloaded);
+		if (!keepConnection)
+			closeConnection();
+		return;
+	}
+
+	auto request = make_unique<Request>();
+	request->requestId = requestId;
+	request->keepConnection = keepConnection;
+	initStream(request->in, *request, FCGIProtocol::stdIn, true);
+	initStream(request->out, *request, FCGIProtocol::stdOut, false);
+	initStream(request->err, *request, FCGIProtocol::stdErr, false);
+
+	_requests.emplace(requestId, std::move(request));
+	++_activeRequests;
+}
+
+void FCGIConnection::prepareRequest(Request &request)
+{
+	// envp nel formato atteso da FCGIRequestData (NAME=VALUE), come quello costruito da libfcgi
+	vector<size_t> offsets;
+	request.environment.reserve(request.params.size());
+
+	string_view params = request.params;
+	string_view name;
+	string_view value;
+	while (FCGIProtocol::decodeNameValue(params, name, value))
+	{
+		offsets.push_back(request.environment.size());
+		request.environment.append(name);
+		request.environment.push_back('=');
+		request.environment.append(value);
+		request.environment.push_back('\0');
+	}
+	if (!params.empty())
+		LOG_ERROR(
+			"Wrong FCGI_PARAMS stream, remaining bytes ignored"
+			", socket: {}"
+			", requestId: {}"
+			", remaining: {}",
+			_socket, request.requestId, params.size()
+		);
+
+	request.envp.reserve(offsets.size() + 1);
+	for (const size_t offset : offsets)
+		request.envp.push_back(request.environment.data() + offset);
+	request.envp.push_back(nullptr);
+
+	request.params.clear();
+	request.params.shrink_to_fit();
+
+	request.fcgxRequest.requestId = request.requestId;
+	request.fcgxRequest.role = FCGIProtocol::roleResponder;
+	request.fcgxRequest.in = &request.in.fcgxStream;
+	request.fcgxRequest.out = &request.out.fcgxStream;
+	request.fcgxRequest.err = &request.err.fcgxStream;
+	request.fcgxRequest.envp = request.envp.data();
+	request.fcgxRequest.ipcFd = _socket;
+	request.fcgxRequest.isBeginProcessed = 1;
+	request.fcgxRequest.keepConnection = request.keepConnection;
+}
+
+void FCGIConnection::endRequest(const uint16_t requestId, const FCGIProtocol::ProtocolStatus protocolStatus, const uint32_t appStatus)
+{
+	char body[8]{};
+	body[0] = static_cast<char>(appStatus >> 24);
+	body[1] = static_cast<char>(appStatus >> 16);
+	body[2] = static_cast<char>(appStatus >> 8);
+	body[3] = static_cast<char>(appStatus);
+	body[4] = static_cast<char>(protocolStatus);
+
+	writeRecord(FCGIProtocol::endRequest, requestId, string_view(body, sizeof(body)));
+}
+
+void FCGIConnection::closeConnection()
+{
+	if (_closed)
+		return;
+
+	_closed = true;
+	// il close del socket viene fatto dal distruttore
+	shutdown(_socket, SHUT_RDWR);
+}
+
+bool FCGIConnection::writeRecord(const uint8_t type, const uint16_t requestId, const string_view content)
+{
+	string record(FCGIProtocol::headerLength, '\0');
+	FCGIProtocol::encodeHeader(reinterpret_cast<unsigned char *>(record.data()), type, requestId, static_cast<uint16_t>(content.size()));
+	record.append(content);
+
+	return writeAll(record.data(), record.size());
+}
+
+bool FCGIConnection::writeAll(const void *buffer, size_t size, const bool more)
+{
+	if (_closed)
+	{
+		errno = EPIPE;
+		return false;
+	}
+
+	auto data = static_cast<const char *>(buffer);
+	while (size > 0)
+	{
+		const ssize_t written = send(_socket, data, size, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			const int sendErrno = errno;
+			LOG_ERROR(
+				"send failed"
+				", socket: {}"
+				", errno: {}",
+				_socket, strerror(sendErrno)
+			);
+			closeConnection();
+			errno = sendErrno;
+
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+
+	return true;
+}
+
+bool FCGIConnection::writeAll(iovec *iov, int iovCount)
+{
+	if (_closed)
+	{
+		errno = EPIPE;
+		return false;
+	}
+
+	while (iovCount > 0)
+	{
+		msghdr message{};
+		message.msg_iov = iov;
+		message.msg_iovlen = iovCount;
+		ssize_t written = sendmsg(_socket, &message, MSG_NOSIGNAL);
+		if (written < 0)
+		{
+			if (errno == EINTR)
+				continue;
+
+			const int sendErrno = errno;
+			LOG_ERROR(
+				"sendmsg failed"
+				", socket: {}"
+				", errno: {}",
+				_socket, strerror(sendErrno)
+			);
+			closeConnection();
+			errno = sendErrno;
+
+			return false;
+		}
+
+		// scrittura parziale: si riparte dal primo iovec non inviato completamente
+		while (iovCount > 0 && static_cast<size_t>(written) >= iov->iov_len)
+		{
+			written -= static_cast<ssize_t>(iov->iov_len);
+			iov++;
+			iovCount--;
+		}
+		if (iovCount > 0)
+		{
+			iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+			iov->iov_len -= written;
+		}
+	}
+
+	return true;
+}
+
+bool FCGIConnection::sendFileAll(const int fd, const uint64_t offset, size_t length)
+{
+	if (_closed)
+	{
+		errno = EPIPE;
+		return false;
+	}
+
+	auto fileOffset = static_cast<off_t>(offset);
+	while (length > 0)
+	{
+		const ssize_t sent = ::sendfile(_socket, fd, &fileOffset, length);
+		if (sent <= 0)
+		{
+			if (sent < 0 && errno == EINTR)
+				continue;
+
+			// sent == 0: il file è più corto del previsto, il record già annunciato non può essere completato
+			const int sendErrno = sent < 0 ? errno : EIO;
+			LOG_ERROR(
+				"sendfile failed"
+				", socket: {}"
+				", fileOffset: {}"
+				", errno: {}",
+				_socket, fileOffset, strerror(sendErrno)
+			);
+			closeConnection();
+			errno = sendErrno;
+
+			return false;
+		}
+		length -= sent;
+	}
+
+	return true;
+}
+
+void FCGIConnection::initStream(Stream &stream, Request &request, const FCGIProtocol::RecordType recordType, const bool isReader)
+{
+	stream.connection = this;
+	stream.request = &request;
+	stream.recordType = recordType;
+
+	FCGX_Stream &fcgxStream = stream.fcgxStream;
+	fcgxStream.isReader = isReader;
+	fcgxStream.fillBuffProc = &FCGIConnection::fillInputBuffer;
+	fcgxStream.emptyBuffProc = &FCGIConnection::emptyOutputBuffer;
+	fcgxStream.data = &stream;
+
+	if (!isReader)
+	{
+		stream.buffer.resize(FCGIProtocol::headerLength + (recordType == FCGIProtocol::stdErr ? errorBufferSize : outputBufferSize));
+		auto *data = reinterpret_cast<unsigned char *>(stream.buffer.data());
+		fcgxStream.wrNext = data + FCGIProtocol::headerLength;
+		fcgxStream.stop = data + stream.buffer.size();
+	}
+}
+
+void FCGIConnection::fillInputBuffer(FCGX_Stream *fcgxStream)
+{
+	auto &stream = *static_cast<Stream *>(fcgxStream->data);
+	FCGIConnection &connection = *stream.connection;
+	Request &request = *stream.request;
+
+	// i record di altre richieste (multiplexing) vengono bufferizzati da processRecord
+	while (request.pendingInput.empty() && !request.stdinComplete && !connection._closed)
+	{
+		FCGIProtocol::RecordHeader header{};
+		string_view content;
+		if (!connection.readRecord(header, content))
+		{
+			connection.closeConnection();
+			break;
+		}
+		connection.processRecord(header, content);
+	}
+
+	if (request.pendingInput.empty())
+	{
+		// EOF
+		fcgxStream->isClosed = 1;
+		fcgxStream->rdNext = fcgxStream->stop;
+		return;
+	}
+
+	stream.buffer = std::move(request.pendingInput.front());
+	request.pendingInput.pop_front();
+
+	auto *data = reinterpret_cast<unsigned char *>(stream.buffer.data());
+	fcgxStream->rdNext = data;
+	fcgxStream->stopUnget = data;
+	fcgxStream->stop = data + stream.buffer.size();
+}
+
+void FCGIConnection::emptyOutputBuffer(FCGX_Stream *fcgxStream, const int doClose)
+{
+	auto &stream = *static_cast<Stream *>(fcgxStream->data);
+	FCGIConnection &connection = *stream.connection;
+	const uint16_t requestId = stream.request->requestId;
+
+	auto *data = reinterpret_cast<unsigned char *>(stream.buffer.data());
+	const size_t contentLength = fcgxStream->wrNext - (data + FCGIProtocol::headerLength);
+
+	bool success = true;
+	if (contentLength > 0)
+	{
+		FCGIProtocol::encodeHeader(data, stream.recordType, requestId, static_cast<uint16_t>(contentLength));
+		success = connection.writeAll(data, FCGIProtocol::headerLength + contentLength);
+		stream.written = true;
+	}
+	// record vuoto = fine dello stream (obbligatorio per FCGI_STDOUT, per FCGI_STDERR solo se è stato scritto qualcosa)
+	if (success && doClose && (stream.recordType == FCGIProtocol::stdOut || stream.written))
+		success = connection.writeRecord(stream.recordType, requestId, {});
+
+	fcgxStream->wrNext = data + FCGIProtocol::headerLength;
+
+	if (!success)
+	{
+		fcgxStream->isClosed = 1;
+		fcgxStream->FCGI_errno = errno != 0 ? errno : EPIPE;
+	}
+}
@@ -0,0 +1,162 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIProtocol.h"
+#include <atomic>
+#include <deque>
+#include <fcgiapp.h>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <vector>
+
+// Connessione FastCGI gestita senza libfcgi (transport "native").
+// - rispetta FCGI_KEEP_CONN: la connessione resta aperta dopo FCGI_END_REQUEST se nginx lo richiede
+//	(upstream keepalive + fastcgi_keep_conn on)
+// - i record di richieste diverse possono arrivare interlacciati (FCGI_MPXS_CONNS=1): vengono
+//	bufferizzati per requestId e le richieste vengono eseguite una alla volta
+// - risponde a FCGI_GET_VALUES con FCGI_MAX_CONNS/FCGI_MAX_REQS/FCGI_MPXS_CONNS
+// Le richieste vengono esposte come FCGX_Request i cui stream (in/out/err) sono FCGX_Stream
+// con le proprie fillBuffProc/emptyBuffProc, per cui FCGX_GetStr/FCGX_PutStr/FCGX_FPrintF
+// e gli handler esistenti funzionano senza modifiche.
+// L'unica differenza è la chiusura della richiesta: al posto di FCGX_Finish_r bisogna chiamare
+// FCGIConnection::finishRequest (FastCGIAPI::finishRequest lo fa in automatico).
+class FCGIConnection final
+{
+public:
+	FCGIConnection(int socket, uint32_t maxConnections, uint32_t maxRequests);
+	~FCGIConnection();
+
+	FCGIConnection(const FCGIConnection &) = delete;
+	FCGIConnection &operator=(const FCGIConnection &) = delete;
+
+	[[nodiscard]] int socket() const { return _socket; }
+	[[nodiscard]] bool closed() const { return _closed; }
+	// true se la richiesta restituita da readRequest non è ancora stata chiusa con finishRequest
+	// (es. handler asincrono sospeso): in questo caso la connessione non va letta
+	[[nodiscard]] bool busy() const { return _dispatchedRequest != nullptr; }
+
+	// true se nel buffer di lettura ci sono già record completi (es. richieste in pipeline)
+	// che vanno processati senza attendere il poll sul socket
+	[[nodiscard]] bool hasBufferedInput() const;
+
+	// processa i record disponibili sul socket (al massimo una recv, il socket deve essere
+	// pronto in lettura oppure hasBufferedInput deve essere true).
+	// Ritorna la prossima richiesta di cui sono stati ricevuti tutti i FCGI_PARAMS,
+	// nullptr se non ci sono ancora richieste pronte o se la connessione è stata chiusa (vedi closed())
+	FCGX_Request *readRequest();
+
+	// equivalente di FCGX_Finish_r per una richiesta restituita da readRequest
+	static void finishRequest(FCGX_Request &request);
+
+	// true se la richiesta è stata creata da un FCGIConnection
+	static bool isNativeRequest(const FCGX_Request &request);
+
+	// scrive content su request.out, come FCGX_PutStr. Per una richiesta Native e un content grande
+	// content non viene copiato nel buffer dello stream: i record FCGI_STDOUT vengono inviati con writev
+	// direttamente da content, insieme a quanto già presente nel buffer (es. gli header della risposta).
+	// Ritorna il numero di byte scritti, -1 in caso di errore
+	static int putStr(FCGX_Request &request, std::string_view content);
+
+	// invia length byte di fd (da offset) su FCGI_STDOUT con sendfile, senza passare dallo user space:
+	// solo per le richieste Native (isNativeRequest). Quanto già nel buffer dello stream viene inviato prima.
+	// false in caso di errore (la connessione viene chiusa)
+	static bool sendFile(FCGX_Request &request, int fd, uint64_t offset, uint64_t length);
+
+private:
+	struct Request;
+
+	struct Stream
+	{
+		FCGX_Stream fcgxStream{};
+		FCGIConnection *connection{};
+		Request *request{};
+		FCGIProtocol::RecordType recordType{};
+		bool written{};
+		// writer: header del record (8 byte) seguito dal contenuto, così il record viene inviato con una sola send
+		// reader: chunk corrente di FCGI_STDIN
+		std::string buffer;
+	};
+
+	struct Request
+	{
+		uint16_t requestId{};
+		bool keepConnection{};
+		bool paramsComplete{};
+		bool stdinComplete{};
+		bool aborted{};
+		bool dispatched{};
+
+		std::string params;
+		std::string environment;
+		std::vector<char *> envp;
+		std::deque<std::string> pendingInput;
+
+		Stream in;
+		Stream out;
+		Stream err;
+
+		FCGX_Request fcgxRequest{};
+	};
+
+	int _socket;
+	uint32_t _maxConnections;
+	uint32_t _maxRequests;
+	bool _closed{};
+
+	std::vector<unsigned char> _readBuffer;
+	size_t _readStart{};
+	size_t _readEnd{};
+
+	std::unordered_map<uint16_t, std::unique_ptr<Request>> _requests;
+	std::deque<uint16_t> _readyRequests;
+	Request *_dispatchedRequest{};
+	// le richieste terminate vengono distrutte alla successiva readRequest, così la
+	// FCGX_Request resta valida fino al ritorno dell'handler
+	std::vector<std::unique_ptr<Request>> _finishedRequests;
+
+	// richieste in corso nel processo (tutte le connessioni), limitate da _maxRequests
+	static inline std::atomic<uint32_t> _activeRequests{};
+
+	[[nodiscard]] bool bufferedRecordAvailable() const;
+	bool receive();
+	bool readRecord(FCGIProtocol::RecordHeader &header, std::string_view &content);
+	void processRecord(const FCGIProtocol::RecordHeader &header, std::string_view content);
+	void processManagementRecord(const FCGIProtocol::RecordHeader &header, std::string_view content);
+	void beginRequest(uint16_t requestId, std::string_view content);
+	void prepareRequest(Request &request);
+	void endRequest(uint16_t requestId, FCGIProtocol::ProtocolStatus protocolStatus, uint32_t appStatus = 0);
+	void closeConnection();
+
+	bool writeRecord(uint8_t type, uint16_t requestId, std::string_view content);
+	// more: altri dati seguono subito (MSG_MORE), es. l'header di un record prima del suo contenuto
+	bool writeAll(const void *buffer, size_t size, bool more = false);
+	bool writeAll(iovec *iov, int iovCount);
+	bool sendFileAll(int fd, uint64_t offset, size_t length);
+
+	void initStream(Stream &stream, Request &request, FCGIProtocol::RecordType recordType, bool isReader);
+	static void fillInputBuffer(FCGX_Stream *fcgxStream);
+	static void emptyOutputBuffer(FCGX_Stream *fcgxStream, int doClose);
+};
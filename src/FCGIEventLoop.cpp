@@ -0,0 +1,326 @@
+#include "FCGIEventLoop.h"
+#include "ThreadLogger.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <unistd.h>
+
+using namespace std;
+
+FCGIEventLoop::FCGIEventLoop()
+{
+	_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epollFd == -1)
+	{
+		const string errorMessage = std::format(
+			"epoll_create1 failed"
+			", errno: {}",
+			strerror(errno)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+}
+
+FCGIEventLoop::~FCGIEventLoop()
+{
+	if (_curlMulti != nullptr)
+		curl_multi_cleanup(_curlMulti);
+	close(_epollFd);
+}
+
+int FCGIEventLoop::nextTimeout() const
+{
+	optional<chrono::steady_clock::time_point> next;
+	if (!_timers.empty())
+		next = _timers.begin()->first;
+	if (_curlTimerActive && (!next || _curlTimeout < *next))
+		next = _curlTimeout;
+	if (!_readyWaiters.empty())
+		return 0;
+	if (!next)
+		return -1;
+
+	const auto milliseconds = chrono::ceil<chrono::milliseconds>(*next - chrono::steady_clock::now()).count();
+
+	return milliseconds <= 0 ? 0 : static_cast<int>(min<int64_t>(milliseconds, numeric_limits<int>::max()));
+}
+
+void FCGIEventLoop::runOnce(const int timeoutMilliseconds)
+{
+	int timeout = timeoutMilliseconds;
+	if (const int next = nextTimeout(); next != -1 && (timeout == -1 || next < timeout))
+		timeout = next;
+
+	epoll_event events[64];
+	const int eventsNumber = epoll_wait(_epollFd, events, size(events), timeout);
+	if (eventsNumber == -1 && errno != EINTR)
+		LOG_ERROR(
+			"epoll_wait failed"
+			", errno: {}",
+			strerror(errno)
+		);
+
+	for (int eventIndex = 0; eventIndex < eventsNumber; eventIndex++)
+	{
+		const int fd = events[eventIndex].data.fd;
+		if (const auto it = _fdWaiters.find(fd); it != _fdWaiters.end())
+		{
+			Waiter *waiter = it->second;
+			removeFdWaiter(*waiter);
+			if (waiter->hasTimer)
+			{
+				_timers.erase(waiter->timer);
+				waiter->hasTimer = false;
+			}
+			_readyWaiters.push_back(waiter);
+		}
+		else if (_curlSockets.contains(fd))
+		{
+			const uint32_t socketEvents = events[eventIndex].events;
+			curlSocketAction(
+				fd, ((socketEvents & EPOLLIN) ? CURL_CSELECT_IN : 0) | ((socketEvents & EPOLLOUT) ? CURL_CSELECT_OUT : 0) |
+						((socketEvents & (EPOLLERR | EPOLLHUP)) ? CURL_CSELECT_ERR : 0)
+			);
+		}
+	}
+
+	const auto now = chrono::steady_clock::now();
+	while (!_timers.empty() && _timers.begin()->first <= now)
+	{
+		Waiter *waiter = _timers.begin()->second;
+		_timers.erase(_timers.begin());
+		waiter->hasTimer = false;
+		if (waiter->fd != -1)
+		{
+			// timeout di un FdAwaiter
+			removeFdWaiter(*waiter);
+			waiter->timedOut = true;
+		}
+		_readyWaiters.push_back(waiter);
+	}
+
+	if (_curlTimerActive && _curlTimeout <= now)
+	{
+		_curlTimerActive = false;
+		curlSocketAction(CURL_SOCKET_TIMEOUT, 0);
+	}
+
+	// le coroutine riprese possono registrare nuovi waiter
+	vector<Waiter *> readyWaiters;
+	readyWaiters.swap(_readyWaiters);
+	for (const Waiter *waiter : readyWaiters)
+		resume(*waiter);
+}
+
+void FCGIEventLoop::cancel(const void *context)
+{
+	erase_if(
+		_fdWaiters,
+		[this, context](const auto &fdWaiter)
+		{
+			if (fdWaiter.second->context != context)
+				return false;
+			epoll_ctl(_epollFd, EPOLL_CTL_DEL, fdWaiter.first, nullptr);
+			return true;
+		}
+	);
+	erase_if(_timers, [context](const auto &timer) { return timer.second->context == context; });
+	erase_if(_readyWaiters, [context](const Waiter *waiter) { return waiter->context == context; });
+	erase_if(
+		_curlWaiters,
+		[this, context](const auto &curlWaiter)
+		{
+			if (curlWaiter.second->context != context)
+				return false;
+			curl_multi_remove_handle(_curlMulti, curlWaiter.first);
+			return true;
+		}
+	);
+}
+
+void FCGIEventLoop::addTimer(Waiter &waiter, const chrono::milliseconds timeout)
+{
+	waiter.timer = _timers.emplace(chrono::steady_clock::now() + timeout, &waiter);
+	waiter.hasTimer = true;
+}
+
+void FCGIEventLoop::removeFdWaiter(const Waiter &waiter)
+{
+	_fdWaiters.erase(waiter.fd);
+	epoll_ctl(_epollFd, EPOLL_CTL_DEL, waiter.fd, nullptr);
+}
+
+void FCGIEventLoop::resume(const Waiter &waiter)
+{
+	_currentContext = waiter.context;
+	if (_resumer)
+		_resumer(waiter.context, waiter.handle);
+	else
+		waiter.handle.resume();
+}
+
+bool FCGIEventLoop::FdAwaiter::await_suspend(const coroutine_handle<> handle)
+{
+	if (_loop._fdWaiters.contains(_fd))
+	{
+		const string errorMessage = std::format(
+			"A coroutine is already waiting on the fd"
+			", fd: {}",
+			_fd
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	epoll_event event{};
+	event.events = _events | EPOLLONESHOT;
+	event.data.fd = _fd;
+	if (epoll_ctl(_loop._epollFd, EPOLL_CTL_ADD, _fd, &event) == -1)
+	{
+		// es. EPERM per un file regolare, che è sempre pronto: la coroutine prosegue senza sospendersi
+		LOG_TRACE(
+			"epoll_ctl failed, the fd is considered ready"
+			", fd: {}"
+			", errno: {}",
+			_fd, strerror(errno)
+		);
+
+		return false;
+	}
+
+	_waiter.handle = handle;
+	_waiter.context = _loop._currentContext;
+	_waiter.fd = _fd;
+	_loop._fdWaiters[_fd] = &_waiter;
+	if (_timeout.count() >= 0)
+		_loop.addTimer(_waiter, _timeout);
+
+	return true;
+}
+
+void FCGIEventLoop::SleepAwaiter::await_suspend(const coroutine_handle<> handle)
+{
+	_waiter.handle = handle;
+	_waiter.context = _loop._currentContext;
+	_loop.addTimer(_waiter, _duration);
+}
+
+bool FCGIEventLoop::CurlAwaiter::await_suspend(const coroutine_handle<> handle)
+{
+	if (_loop._curlMulti == nullptr)
+	{
+		_loop._curlMulti = curl_multi_init();
+		if (_loop._curlMulti == nullptr)
+		{
+			const string errorMessage = "curl_multi_init failed";
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+		curl_multi_setopt(_loop._curlMulti, CURLMOPT_SOCKETFUNCTION, &FCGIEventLoop::curlSocketCallback);
+		curl_multi_setopt(_loop._curlMulti, CURLMOPT_SOCKETDATA, &_loop);
+		curl_multi_setopt(_loop._curlMulti, CURLMOPT_TIMERFUNCTION, &FCGIEventLoop::curlTimerCallback);
+		curl_multi_setopt(_loop._curlMulti, CURLMOPT_TIMERDATA, &_loop);
+	}
+
+	_waiter.handle = handle;
+	_waiter.context = _loop._currentContext;
+
+	curl_easy_setopt(_curl, CURLOPT_PRIVATE, &_waiter);
+	if (const CURLMcode curlMCode = curl_multi_add_handle(_loop._curlMulti, _curl); curlMCode != CURLM_OK)
+	{
+		const string errorMessage = std::format(
+			"curl_multi_add_handle failed"
+			", error: {}",
+			curl_multi_strerror(curlMCode)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+	_loop._curlWaiters[_curl] = &_waiter;
+
+	return true;
+}
+
+void FCGIEventLoop::curlSocketAction(const int socket, const int eventsBitmask)
+{
+	int runningHandles;
+	curl_multi_socket_action(_curlMulti, socket, eventsBitmask, &runningHandles);
+	processCurlMessages();
+}
+
+void FCGIEventLoop::processCurlMessages()
+{
+	int messagesInQueue;
+	while (CURLMsg *message = curl_multi_info_read(_curlMulti, &messagesInQueue))
+	{
+		if (message->msg != CURLMSG_DONE)
+			continue;
+
+		Waiter *waiter = nullptr;
+		curl_easy_getinfo(message->easy_handle, CURLINFO_PRIVATE, &waiter);
+		const CURLcode curlCode = message->data.result;
+		curl_multi_remove_handle(_curlMulti, message->easy_handle);
+		_curlWaiters.erase(message->easy_handle);
+		if (waiter != nullptr)
+		{
+			waiter->curlCode = curlCode;
+			_readyWaiters.push_back(waiter);
+		}
+	}
+}
+
+int FCGIEventLoop::curlSocketCallback(CURL *, const curl_socket_t socket, const int what, void *userp, void *)
+{
+	auto &loop = *static_cast<FCGIEventLoop *>(userp);
+
+	if (what == CURL_POLL_REMOVE)
+	{
+		epoll_ctl(loop._epollFd, EPOLL_CTL_DEL, socket, nullptr);
+		loop._curlSockets.erase(socket);
+
+		return 0;
+	}
+
+	epoll_event event{};
+	event.events = ((what & CURL_POLL_IN) ? static_cast<uint32_t>(EPOLLIN) : 0U) | ((what & CURL_POLL_OUT) ? static_cast<uint32_t>(EPOLLOUT) : 0U);
+	event.data.fd = socket;
+	const bool alreadyRegistered = loop._curlSockets.contains(socket);
+	if (epoll_ctl(loop._epollFd, alreadyRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, socket, &event) == -1)
+	{
+		LOG_ERROR(
+			"epoll_ctl failed for a curl socket"
+			", socket: {}"
+			", errno: {}",
+			socket, strerror(errno)
+		);
+
+		return -1;
+	}
+	loop._curlSockets[socket] = event.events;
+
+	return 0;
+}
+
+int FCGIEventLoop::curlTimerCallback(CURLM *, const long timeoutMilliseconds, void *userp)
+{
+	auto &loop = *static_cast<FCGIEventLoop *>(userp);
+
+	if (timeoutMilliseconds < 0)
+		loop._curlTimerActive = false;
+	else
+	{
+		loop._curlTimerActive = true;
+		loop._curlTimeout = chrono::steady_clock::now() + chrono::milliseconds(timeoutMilliseconds);
+	}
+
+	return 0;
+}
@@ -0,0 +1,161 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <coroutine>
+#include <curl/curl.h>
+#include <functional>
+#include <map>
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <vector>
+
+// Event loop (epoll) di un thread FastCGIAPI, usato dagli handler asincroni (FCGITask) per:
+//	- co_await readable(fd)/writable(fd): attesa su un socket (con timeout opzionale)
+//	- co_await sleepFor(duration): timer
+//	- co_await perform(curl): esecuzione di una CURL easy handle tramite curl multi
+// Le coroutine vengono riprese sempre dal thread proprietario del loop, dentro runOnce.
+// Il file descriptor del loop (fd()) può essere messo in poll insieme al socket in listen.
+class FCGIEventLoop final
+{
+	struct Waiter
+	{
+		std::coroutine_handle<> handle;
+		void *context{};
+		int fd{-1};
+		bool hasTimer{};
+		bool timedOut{};
+		std::multimap<std::chrono::steady_clock::time_point, Waiter *>::iterator timer;
+		CURLcode curlCode{CURLE_OK};
+	};
+
+public:
+	// riprende una coroutine sospesa: context è quello attivo (setCurrentContext) quando la coroutine si è sospesa
+	using Resumer = std::function<void(void *context, std::coroutine_handle<> handle)>;
+
+	FCGIEventLoop();
+	~FCGIEventLoop();
+
+	FCGIEventLoop(const FCGIEventLoop &) = delete;
+	FCGIEventLoop &operator=(const FCGIEventLoop &) = delete;
+
+	[[nodiscard]] int fd() const { return _epollFd; }
+
+	// millisecondi alla scadenza del prossimo timer, -1 se non ci sono timer
+	[[nodiscard]] int nextTimeout() const;
+
+	// attende al massimo timeoutMilliseconds (-1 senza limite) e riprende le coroutine pronte
+	void runOnce(int timeoutMilliseconds);
+
+	// rimuove i waiter delle coroutine sospese con context (fd, timer, transfer curl), che non verranno più riprese:
+	// da chiamare prima di distruggere le coroutine abbandonate (es. shutdown oltre il timeout)
+	void cancel(const void *context);
+
+	void setResumer(Resumer resumer) { _resumer = std::move(resumer); }
+	void setCurrentContext(void *context) { _currentContext = context; }
+
+	class FdAwaiter
+	{
+	public:
+		FdAwaiter(FCGIEventLoop &loop, const int fd, const uint32_t events, const std::chrono::milliseconds timeout)
+			: _loop(loop), _fd(fd), _events(events), _timeout(timeout)
+		{
+		}
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> handle);
+		// false in caso di timeout
+		bool await_resume() const noexcept { return !_waiter.timedOut; }
+
+	private:
+		FCGIEventLoop &_loop;
+		int _fd;
+		uint32_t _events;
+		std::chrono::milliseconds _timeout;
+		Waiter _waiter;
+	};
+
+	class SleepAwaiter
+	{
+	public:
+		SleepAwaiter(FCGIEventLoop &loop, const std::chrono::milliseconds duration) : _loop(loop), _duration(duration) {}
+		bool await_ready() const noexcept { return _duration.count() <= 0; }
+		void await_suspend(std::coroutine_handle<> handle);
+		void await_resume() const noexcept {}
+
+	private:
+		FCGIEventLoop &_loop;
+		std::chrono::milliseconds _duration;
+		Waiter _waiter;
+	};
+
+	class CurlAwaiter
+	{
+	public:
+		CurlAwaiter(FCGIEventLoop &loop, CURL *curl) : _loop(loop), _curl(curl) {}
+		bool await_ready() const noexcept { return false; }
+		bool await_suspend(std::coroutine_handle<> handle);
+		[[nodiscard]] CURLcode await_resume() const noexcept { return _waiter.curlCode; }
+
+	private:
+		FCGIEventLoop &_loop;
+		CURL *_curl;
+		Waiter _waiter;
+	};
+
+	FdAwaiter readable(const int fd, const std::chrono::milliseconds timeout = std::chrono::milliseconds(-1))
+	{
+		return {*this, fd, EPOLLIN, timeout};
+	}
+	FdAwaiter writable(const int fd, const std::chrono::milliseconds timeout = std::chrono::milliseconds(-1))
+	{
+		return {*this, fd, EPOLLOUT, timeout};
+	}
+	SleepAwaiter sleepFor(const std::chrono::milliseconds duration) { return {*this, duration}; }
+	// la CURL easy handle deve essere già configurata (URL, callback, ...), ritorna il risultato del transfer
+	CurlAwaiter perform(CURL *curl) { return {*this, curl}; }
+
+private:
+	int _epollFd;
+	Resumer _resumer;
+	void *_currentContext{};
+
+	std::unordered_map<int, Waiter *> _fdWaiters;
+	std::multimap<std::chrono::steady_clock::time_point, Waiter *> _timers;
+	std::vector<Waiter *> _readyWaiters;
+
+	CURLM *_curlMulti{};
+	// transfer aggiunti al multi e non ancora terminati, per cancel
+	std::unordered_map<CURL *, Waiter *> _curlWaiters;
+	std::unordered_map<int, uint32_t> _curlSockets;
+	bool _curlTimerActive{};
+	std::chrono::steady_clock::time_point _curlTimeout;
+
+	void addTimer(Waiter &waiter, std::chrono::milliseconds timeout);
+	void removeFdWaiter(const Waiter &waiter);
+	void resume(const Waiter &waiter);
+	void curlSocketAction(int socket, int eventsBitmask);
+	void processCurlMessages();
+
+	static int curlSocketCallback(CURL *curl, curl_socket_t socket, int what, void *userp, void *socketp);
+	static int curlTimerCallback(CURLM *curlMulti, long timeoutMilliseconds, void *userp);
+};
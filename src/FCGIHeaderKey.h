@@ -0,0 +1,83 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+// Nome di un header HTTP già convertito nella chiave CGI usata da FastCGI
+// (es. "x-forwarded-for" -> "HTTP_X_FORWARDED_FOR"), per cui la ricerca dell'header
+// è solamente una ricerca nella mappa, senza allocazioni.
+// Dichiarata constexpr la conversione avviene a compile time:
+//
+//	static constexpr FCGIHeaderKey apiKeyHeader{"x-api-key"};
+//	std::string apiKey = requestData.getHeaderParameter(apiKeyHeader, "", true);
+//
+// altrimenti una sola volta, ad esempio alla registrazione dell'handler.
+// Un nome più lungo di maxNameLength non compila se constexpr e lancia length_error a runtime:
+// per nomi che arrivano dal client usare cgiName(headerName), che non ha limiti di lunghezza
+class FCGIHeaderKey final
+{
+public:
+	static constexpr size_t maxNameLength = 128;
+
+	constexpr explicit FCGIHeaderKey(const std::string_view headerName)
+	{
+		if (headerName.size() > maxNameLength)
+			throw std::length_error("FCGIHeaderKey: header name too long");
+
+		for (const char c : prefix)
+			_cgiName[_length++] = c;
+		for (const char c : headerName)
+			_cgiName[_length++] = cgiChar(c);
+	}
+
+	[[nodiscard]] constexpr std::string_view cgiName() const { return {_cgiName.data(), _length}; }
+
+	// stessa conversione del costruttore, allocando la stringa
+	[[nodiscard]] static std::string cgiName(const std::string_view headerName)
+	{
+		std::string name(prefix);
+		name.reserve(prefix.size() + headerName.size());
+		for (const char c : headerName)
+			name.push_back(cgiChar(c));
+		return name;
+	}
+
+private:
+	static constexpr std::string_view prefix = "HTTP_";
+
+	static constexpr char cgiChar(const char c)
+	{
+		if (c == '-')
+			return '_';
+		if (c >= 'a' && c <= 'z')
+			return static_cast<char>(c - 'a' + 'A');
+		return c;
+	}
+
+	std::array<char, 5 + maxNameLength> _cgiName{};
+	size_t _length{};
+};
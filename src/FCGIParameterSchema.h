@@ -0,0 +1,209 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIHeaderKey.h"
+#include "FCGIRequestData.h"
+#include <bit>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Parametri (query e header) di un handler dichiarati una sola volta, alla registrazione,
+// e letti in una struct P con un solo passaggio sui parametri della richiesta:
+//
+//	struct ListParameters
+//	{
+//		int64_t start;
+//		int32_t rows;
+//		std::string order;
+//		std::string apiKey;
+//	};
+//	static const auto listSchema = FCGIParameterSchema<ListParameters>()
+//		.query("start", &ListParameters::start, 0)
+//		.query("rows", &ListParameters::rows, 10, false, {10, 50, 100})
+//		.query("order", &ListParameters::order, "asc", false, {"asc", "desc"})
+//		.header(FCGIHeaderKey("x-api-key"), &ListParameters::apiKey, "", true);
+//
+//	registerHandler("list", listSchema, [this](const std::string_view &sThreadId, FCGX_Request &request,
+//		const FCGIRequestData &requestData, const ListParameters &parameters) { ... });
+//
+// La validazione segue getQueryParameter/getHeaderParameter: valore vuoto come parametro assente,
+// stringhe decodificate (unescape), valore non valido, non ammesso o mandatory mancante: HTTPError 400
+// da parse, FastCGIError::RequestError da tryParse (senza eccezioni).
+// I valori ammessi sono cercati in un hash set
+template <typename P> class FCGIParameterSchema final
+{
+public:
+	// limite dovuto alla maschera dei parametri ricevuti
+	static constexpr size_t maxParameters = 64;
+
+	template <typename T>
+	FCGIParameterSchema &query(const std::string_view name, T P::*member, std::type_identity_t<T> defaultValue = {},
+		const bool mandatory = false, const std::initializer_list<std::type_identity_t<T>> allowedValues = {})
+	{
+		add(_query, name, member, std::move(defaultValue), mandatory, allowedValues);
+		return *this;
+	}
+
+	template <typename T>
+	FCGIParameterSchema &header(const FCGIHeaderKey &headerKey, T P::*member, std::type_identity_t<T> defaultValue = {},
+		const bool mandatory = false, const std::initializer_list<std::type_identity_t<T>> allowedValues = {})
+	{
+		add(_header, headerKey.cgiName(), member, std::move(defaultValue), mandatory, allowedValues);
+		return *this;
+	}
+
+	[[nodiscard]] P parse(const FCGIRequestData &requestData) const
+	{
+		auto parameters = tryParse(requestData);
+		if (!parameters)
+		{
+			const std::string errorMessage = parameters.error().message();
+			LOG_ERROR(errorMessage);
+			throw parameters.error().exception();
+		}
+
+		return std::move(*parameters);
+	}
+
+	[[nodiscard]] std::expected<P, FastCGIError::RequestError> tryParse(const FCGIRequestData &requestData) const
+	{
+		P parameters = _defaults;
+
+		if (auto assigned = assign(_query, requestData.queryParametersView(), parameters); !assigned)
+			return std::unexpected(std::move(assigned.error()));
+		if (!_header.parameters.empty())
+		{
+			if (auto assigned = assign(_header, requestData.headersView(), parameters); !assigned)
+				return std::unexpected(std::move(assigned.error()));
+		}
+
+		return parameters;
+	}
+
+private:
+	struct Parameter
+	{
+		std::string name;
+		// converte, valida e assegna il valore al campo di P
+		std::function<std::expected<void, FastCGIError::RequestError>(P &, std::string_view)> assign;
+	};
+
+	struct NameHash
+	{
+		using is_transparent = void;
+		size_t operator()(const std::string_view name) const { return std::hash<std::string_view>{}(name); }
+	};
+
+	struct Parameters
+	{
+		std::vector<Parameter> parameters;
+		std::unordered_map<std::string, size_t, NameHash, std::equal_to<>> index;
+		uint64_t mandatoryMask{};
+	};
+
+	Parameters _query;
+	Parameters _header;
+	// P con i valori di default, copiato da parse
+	P _defaults{};
+
+	template <typename T>
+	void add(Parameters &parameters, const std::string_view name, T P::*member, T defaultValue, const bool mandatory,
+		const std::initializer_list<T> allowedValues)
+	{
+		if (parameters.parameters.size() == maxParameters || parameters.index.contains(name))
+			throw std::invalid_argument(std::format("FCGIParameterSchema: too many or duplicated parameters, name: {}", name));
+
+		_defaults.*member = std::move(defaultValue);
+
+		// name viene copiato nella std::function: le string_view degli errori restano valide quanto lo schema
+		std::function<std::expected<void, FastCGIError::RequestError>(P &, std::string_view)> assign;
+		if (allowedValues.size() == 0)
+			assign = [member, name = std::string(name)](P &p, const std::string_view value) -> std::expected<void, FastCGIError::RequestError>
+			{
+				auto parameterValue = convert<T>(value, name);
+				if (!parameterValue)
+					return std::unexpected(std::move(parameterValue.error()));
+				p.*member = std::move(*parameterValue);
+				return {};
+			};
+		else
+			// allowedValuesList formattato una volta sola, nell'ordine della dichiarazione
+			assign = [member, name = std::string(name), allowedSet = std::unordered_set<T>(allowedValues),
+						 allowedValuesList = FastCGIError::RequestError::allowedValuesList(allowedValues)](
+						 P &p, const std::string_view value) -> std::expected<void, FastCGIError::RequestError>
+			{
+				auto parameterValue = convert<T>(value, name);
+				if (!parameterValue)
+					return std::unexpected(std::move(parameterValue.error()));
+				if (!allowedSet.contains(*parameterValue))
+					return std::unexpected(FastCGIError::RequestError::notAllowedValue(name, value, allowedValuesList));
+				p.*member = std::move(*parameterValue);
+				return {};
+			};
+
+		if (mandatory)
+			parameters.mandatoryMask |= uint64_t{1} << parameters.parameters.size();
+		parameters.index.emplace(name, parameters.parameters.size());
+		parameters.parameters.push_back({std::string(name), std::move(assign)});
+	}
+
+	template <typename T>
+	static std::expected<T, FastCGIError::RequestError> convert(const std::string_view value, const std::string_view name)
+	{
+		if constexpr (std::is_same_v<T, std::string>)
+			return FCGIRequestData::unescape(value, true);
+		else
+			return FCGIRequestData::tryParseValue<T>(value, name);
+	}
+
+	template <typename R>
+	static std::expected<void, FastCGIError::RequestError> assign(const Parameters &parameters, R &&requestParameters, P &p)
+	{
+		uint64_t receivedMask = 0;
+		for (const auto &[name, value] : requestParameters)
+		{
+			if (value.empty())
+				continue;
+			const auto it = parameters.index.find(name);
+			if (it == parameters.index.end())
+				continue;
+
+			if (auto assigned = parameters.parameters[it->second].assign(p, value); !assigned)
+				return assigned;
+			receivedMask |= uint64_t{1} << it->second;
+		}
+
+		if (const uint64_t missingMask = parameters.mandatoryMask & ~receivedMask; missingMask != 0)
+			return std::unexpected(FastCGIError::RequestError::missingParameter(parameters.parameters[std::countr_zero(missingMask)].name));
+
+		return {};
+	}
+};
@@ -0,0 +1,136 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory_resource>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Coppie chiave/valore (string_view) di una richiesta in un array contiguo, nell'ordine di inserimento.
+// Una richiesta ha tipicamente una trentina di variabili CGI e pochi parametri di query:
+// la ricerca lineare su un array contiguo (confronto prima della lunghezza) resta in poche cache line
+// ed è più veloce di una hash map, che alloca un nodo per elemento.
+// Le chiavi duplicate non vengono sostituite da append (vedi assignDuplicates), find ritorna la prima.
+class FCGIParametersView
+{
+public:
+	using value_type = std::pair<std::string_view, std::string_view>;
+	using const_iterator = const value_type *;
+
+	[[nodiscard]] const_iterator begin() const { return _data; }
+	[[nodiscard]] const_iterator end() const { return _data + _size; }
+	[[nodiscard]] size_t size() const { return _size; }
+	[[nodiscard]] bool empty() const { return _size == 0; }
+	[[nodiscard]] std::span<const value_type> span() const { return {_data, _size}; }
+
+	[[nodiscard]] const_iterator find(const std::string_view key) const
+	{
+		return std::ranges::find(begin(), end(), key, &value_type::first);
+	}
+
+protected:
+	value_type *_data{};
+	size_t _size{};
+
+	FCGIParametersView() = default;
+	~FCGIParametersView() = default;
+};
+
+// InlineCapacity elementi sono dentro l'oggetto, oltre vengono allocati da memoryResource (es. FCGIRequestArena)
+template <size_t InlineCapacity> class FCGIParametersMap final : public FCGIParametersView
+{
+public:
+	explicit FCGIParametersMap(std::pmr::memory_resource *memoryResource = std::pmr::get_default_resource()) : _storage(memoryResource)
+	{
+		_data = _inline.data();
+	}
+
+	// _data può puntare dentro l'oggetto
+	FCGIParametersMap(const FCGIParametersMap &) = delete;
+	FCGIParametersMap &operator=(const FCGIParametersMap &) = delete;
+
+	void reserve(const size_t capacity)
+	{
+		if (capacity <= _capacity)
+			return;
+
+		std::pmr::vector<value_type> storage(capacity, _storage.get_allocator());
+		std::ranges::copy(begin(), end(), storage.begin());
+		_storage = std::move(storage);
+		_data = _storage.data();
+		_capacity = capacity;
+	}
+
+	// aggiunge senza cercare la chiave (es. environment, dove le chiavi sono già univoche)
+	void append(const std::string_view key, const std::string_view value)
+	{
+		if (_size == _capacity)
+			reserve(_capacity * 2);
+		_data[_size++] = {key, value};
+	}
+
+	// dopo una serie di append con chiavi ripetute (es. a=1&a=2 nella query string): resta una coppia per chiave,
+	// nella posizione della prima occorrenza e con il valore dell'ultima (last wins).
+	// Un solo passaggio invece di una ricerca per ogni append: oltre InlineCapacity elementi le chiavi già viste
+	// sono in una hash map (allocata da memoryResource), altrimenti la ricerca lineare costa meno dell'allocazione
+	void assignDuplicates()
+	{
+		size_t uniqueSize = 0;
+		if (_size <= InlineCapacity)
+		{
+			for (size_t index = 0; index < _size; index++)
+			{
+				const auto it = std::ranges::find(_data, _data + uniqueSize, _data[index].first, &value_type::first);
+				if (it == _data + uniqueSize)
+					_data[uniqueSize++] = _data[index];
+				else
+					it->second = _data[index].second;
+			}
+		}
+		else
+		{
+			std::pmr::unordered_map<std::string_view, size_t> uniqueIndexes(_storage.get_allocator().resource());
+			uniqueIndexes.reserve(_size);
+			for (size_t index = 0; index < _size; index++)
+			{
+				if (const auto [it, inserted] = uniqueIndexes.try_emplace(_data[index].first, uniqueSize); inserted)
+					_data[uniqueSize++] = _data[index];
+				else
+					_data[it->second].second = _data[index].second;
+			}
+		}
+		_size = uniqueSize;
+	}
+
+	void clear() { _size = 0; }
+
+private:
+	std::array<value_type, InlineCapacity> _inline{};
+	std::pmr::vector<value_type> _storage;
+	size_t _capacity{InlineCapacity};
+};
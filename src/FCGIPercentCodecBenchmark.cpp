@@ -0,0 +1,191 @@
+// Microbenchmark di FCGIRequestData::escape/unescape rispetto al percorso curl che sostituiscono
+// (curl_easy_init + curl_easy_escape/curl_easy_unescape + curl_easy_cleanup per ogni chiamata,
+// con replaceAll di '+' prima di unescape come faceva getMapParameter):
+//
+//	FCGIPercentCodecBenchmark [--iterations <number>] [--length <bytes>]
+//
+// Per ogni tipo di valore (solo caratteri non riservati, con %XX, con '+') stampa ns per chiamata e MB/s dei due percorsi,
+// dopo aver verificato che producano lo stesso risultato
+
+#include "FCGIRequestData.h"
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <curl/curl.h>
+#include <format>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+string curlEscape(const string_view value)
+{
+	CURL *curl = curl_easy_init();
+	if (!curl)
+		throw runtime_error("curl_easy_init failed");
+
+	char *encoded = curl_easy_escape(curl, value.data(), static_cast<int>(value.size()));
+	if (!encoded)
+	{
+		curl_easy_cleanup(curl);
+		throw runtime_error("curl_easy_escape failed");
+	}
+	string buffer = encoded;
+	curl_free(encoded);
+	curl_easy_cleanup(curl);
+
+	return buffer;
+}
+
+string curlUnescape(const string_view value)
+{
+	string plusReplaced(value);
+	for (char &c : plusReplaced)
+		if (c == '+')
+			c = ' ';
+
+	CURL *curl = curl_easy_init();
+	if (!curl)
+		throw runtime_error("curl_easy_init failed");
+
+	int decodedLength;
+	char *decoded = curl_easy_unescape(curl, plusReplaced.data(), static_cast<int>(plusReplaced.size()), &decodedLength);
+	if (!decoded)
+	{
+		curl_easy_cleanup(curl);
+		throw runtime_error("curl_easy_unescape failed");
+	}
+	string buffer(decoded, decodedLength);
+	curl_free(decoded);
+	curl_easy_cleanup(curl);
+
+	return buffer;
+}
+
+// valori di query string di length byte: plain (nessuna decodifica), percent (~1 byte su 8 è %XX), plus (spazi come '+')
+vector<string> values(const string_view kind, const size_t length, const size_t count)
+{
+	constexpr string_view unreservedCharacters = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-._~";
+	mt19937 generator(42);
+	uniform_int_distribution<size_t> unreservedIndex(0, unreservedCharacters.size() - 1);
+	uniform_int_distribution<int> byteValue(0, 255);
+
+	vector<string> generatedValues;
+	generatedValues.reserve(count);
+	for (size_t index = 0; index < count; index++)
+	{
+		string value;
+		while (value.size() < length)
+		{
+			const size_t position = value.size();
+			if (kind == "percent" && position % 8 == 7)
+				value += std::format("%{:02X}", byteValue(generator));
+			else if (kind == "plus" && position % 6 == 5)
+				value += '+';
+			else
+				value += unreservedCharacters[unreservedIndex(generator)];
+		}
+		generatedValues.push_back(std::move(value));
+	}
+
+	return generatedValues;
+}
+
+template <typename Codec> double nanosecondsPerCall(const vector<string> &inputs, const int64_t iterations, Codec codec)
+{
+	size_t checksum = 0;
+	const auto start = chrono::steady_clock::now();
+	for (int64_t iteration = 0; iteration < iterations; iteration++)
+		checksum += codec(inputs[iteration % inputs.size()]).size();
+	const auto elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	// checksum evita che il compilatore elimini le chiamate
+	if (checksum == 0)
+		cerr << "";
+
+	return elapsed / static_cast<double>(iterations);
+}
+
+int64_t numericArgument(const string_view name, const string_view value)
+{
+	int64_t number{};
+	if (const auto [ptr, ec] = from_chars(value.data(), value.data() + value.size(), number);
+		ec != errc() || ptr != value.data() + value.size() || number <= 0)
+		throw runtime_error(std::format("Wrong {}: {}", name, value));
+	return number;
+}
+
+int usage()
+{
+	cerr << "Usage: FCGIPercentCodecBenchmark [--iterations <number>] [--length <bytes>]" << endl;
+	return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	int64_t iterations = 200000;
+	int64_t length = 64;
+
+	try
+	{
+		for (int index = 1; index < argc; index++)
+		{
+			const string_view argument = argv[index];
+			if (argument == "--iterations" && index + 1 < argc)
+				iterations = numericArgument(argument, argv[++index]);
+			else if (argument == "--length" && index + 1 < argc)
+				length = numericArgument(argument, argv[++index]);
+			else
+				return usage();
+		}
+
+		curl_global_init(CURL_GLOBAL_DEFAULT);
+
+		for (const string_view kind : {"plain", "percent", "plus"})
+		{
+			const vector<string> encoded = values(kind, static_cast<size_t>(length), 1024);
+			vector<string> decoded;
+			decoded.reserve(encoded.size());
+			for (const string &value : encoded)
+			{
+				string nativeValue = FCGIRequestData::unescape(value, true);
+				if (nativeValue != curlUnescape(value))
+					throw runtime_error(std::format("unescape differs from curl, value: {}", value));
+				if (FCGIRequestData::escape(nativeValue) != curlEscape(nativeValue))
+					throw runtime_error(std::format("escape differs from curl, value: {}", nativeValue));
+				decoded.push_back(std::move(nativeValue));
+			}
+
+			const double nativeUnescape = nanosecondsPerCall(encoded, iterations, [](const string &value) { return FCGIRequestData::unescape(value, true); });
+			const double curlUnescapeTime = nanosecondsPerCall(encoded, iterations, curlUnescape);
+			const double nativeEscape = nanosecondsPerCall(decoded, iterations, [](const string &value) { return FCGIRequestData::escape(value); });
+			const double curlEscapeTime = nanosecondsPerCall(decoded, iterations, curlEscape);
+
+			// MB/s calcolati sui byte in input (length)
+			const auto megabytesPerSecond = [length](const double nanoseconds) { return static_cast<double>(length) / nanoseconds * 1000.0; };
+			cout << std::format(
+						"{:8} unescape: native {:8.1f} ns ({:7.1f} MB/s), curl {:8.1f} ns ({:7.1f} MB/s), speedup {:.1f}x\n"
+						"{:8}   escape: native {:8.1f} ns ({:7.1f} MB/s), curl {:8.1f} ns ({:7.1f} MB/s), speedup {:.1f}x",
+						kind, nativeUnescape, megabytesPerSecond(nativeUnescape), curlUnescapeTime, megabytesPerSecond(curlUnescapeTime),
+						curlUnescapeTime / nativeUnescape, kind, nativeEscape, megabytesPerSecond(nativeEscape), curlEscapeTime,
+						megabytesPerSecond(curlEscapeTime), curlEscapeTime / nativeEscape
+					)
+				 << endl;
+		}
+
+		curl_global_cleanup();
+	}
+	catch (exception &e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
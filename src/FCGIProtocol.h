@@ -0,0 +1,162 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Costanti e codifica dei record del protocollo FastCGI 1.0
+// (https://fastcgi-archives.github.io/FastCGI_Specification.html)
+namespace FCGIProtocol
+{
+
+constexpr uint8_t version1 = 1;
+constexpr size_t headerLength = 8;
+constexpr size_t maxContentLength = 0xFFFF;
+
+enum RecordType : uint8_t
+{
+	beginRequest = 1,
+	abortRequest = 2,
+	endRequest = 3,
+	params = 4,
+	stdIn = 5,
+	stdOut = 6,
+	stdErr = 7,
+	data = 8,
+	getValues = 9,
+	getValuesResult = 10,
+	unknownType = 11
+};
+
+// BEGIN_REQUEST: role e flags
+constexpr uint16_t roleResponder = 1;
+constexpr uint8_t flagKeepConn = 1;
+
+// END_REQUEST: protocolStatus
+enum ProtocolStatus : uint8_t
+{
+	requestComplete = 0,
+	cantMpxConn = 1,
+	overloaded = 2,
+	unknownRole = 3
+};
+
+// nomi delle variabili di FCGI_GET_VALUES
+constexpr std::string_view maxConns = "FCGI_MAX_CONNS";
+constexpr std::string_view maxReqs = "FCGI_MAX_REQS";
+constexpr std::string_view mpxsConns = "FCGI_MPXS_CONNS";
+
+struct RecordHeader
+{
+	uint8_t version;
+	uint8_t type;
+	uint16_t requestId;
+	uint16_t contentLength;
+	uint8_t paddingLength;
+};
+
+inline RecordHeader decodeHeader(const unsigned char *buffer)
+{
+	return RecordHeader{
+		.version = buffer[0],
+		.type = buffer[1],
+		.requestId = static_cast<uint16_t>((buffer[2] << 8) | buffer[3]),
+		.contentLength = static_cast<uint16_t>((buffer[4] << 8) | buffer[5]),
+		.paddingLength = buffer[6]
+	};
+}
+
+inline void encodeHeader(unsigned char *buffer, const uint8_t type, const uint16_t requestId, const uint16_t contentLength, const uint8_t paddingLength = 0)
+{
+	buffer[0] = version1;
+	buffer[1] = type;
+	buffer[2] = static_cast<unsigned char>(requestId >> 8);
+	buffer[3] = static_cast<unsigned char>(requestId);
+	buffer[4] = static_cast<unsigned char>(contentLength >> 8);
+	buffer[5] = static_cast<unsigned char>(contentLength);
+	buffer[6] = paddingLength;
+	buffer[7] = 0;
+}
+
+// lunghezza di un name-value pair: 1 byte se < 128, altrimenti 4 byte con il bit alto a 1
+inline bool decodeNameValueLength(std::string_view &buffer, uint32_t &length)
+{
+	if (buffer.empty())
+		return false;
+
+	const auto *bytes = reinterpret_cast<const unsigned char *>(buffer.data());
+	if ((bytes[0] & 0x80) == 0)
+	{
+		length = bytes[0];
+		buffer.remove_prefix(1);
+		return true;
+	}
+
+	if (buffer.size() < 4)
+		return false;
+	length = (static_cast<uint32_t>(bytes[0] & 0x7F) << 24) | (static_cast<uint32_t>(bytes[1]) << 16) | (static_cast<uint32_t>(bytes[2]) << 8) |
+			 bytes[3];
+	buffer.remove_prefix(4);
+	return true;
+}
+
+// estrae il prossimo name-value pair dal buffer, false se il buffer è terminato o malformato
+inline bool decodeNameValue(std::string_view &buffer, std::string_view &name, std::string_view &value)
+{
+	uint32_t nameLength;
+	uint32_t valueLength;
+	if (!decodeNameValueLength(buffer, nameLength) || !decodeNameValueLength(buffer, valueLength))
+		return false;
+	if (buffer.size() < static_cast<size_t>(nameLength) + valueLength)
+		return false;
+
+	name = buffer.substr(0, nameLength);
+	value = buffer.substr(nameLength, valueLength);
+	buffer.remove_prefix(static_cast<size_t>(nameLength) + valueLength);
+
+	return true;
+}
+
+inline void appendNameValueLength(std::string &buffer, const size_t length)
+{
+	if (length < 0x80)
+		buffer.push_back(static_cast<char>(length));
+	else
+	{
+		buffer.push_back(static_cast<char>(((length >> 24) & 0x7F) | 0x80));
+		buffer.push_back(static_cast<char>(length >> 16));
+		buffer.push_back(static_cast<char>(length >> 8));
+		buffer.push_back(static_cast<char>(length));
+	}
+}
+
+inline void appendNameValue(std::string &buffer, const std::string_view name, const std::string_view value)
+{
+	appendNameValueLength(buffer, name.size());
+	appendNameValueLength(buffer, value.size());
+	buffer.append(name);
+	buffer.append(value);
+}
+
+} // namespace FCGIProtocol
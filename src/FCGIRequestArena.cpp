@@ -0,0 +1,44 @@
+#include "FCGIRequestArena.h"
+#include "ThreadLogger.h"
+
+using namespace std;
+
+FCGIRequestArena::FCGIRequestArena(const size_t initialSize)
+	: _initialSize(initialSize), _initialBuffer(make_unique_for_overwrite<byte[]>(initialSize)),
+	  _resource(_initialBuffer.get(), initialSize, pmr::new_delete_resource())
+{
+}
+
+void *FCGIRequestArena::do_allocate(const size_t bytes, const size_t alignment)
+{
+	_allocated += bytes;
+
+	return _resource.allocate(bytes, alignment);
+}
+
+void FCGIRequestArena::reset()
+{
+	if (_allocated > _highWaterMark)
+	{
+		_highWaterMark = _allocated;
+
+		size_t processHighWaterMark = _processHighWaterMark;
+		while (_allocated > processHighWaterMark && !_processHighWaterMark.compare_exchange_weak(processHighWaterMark, _allocated))
+			;
+	}
+	if (_allocated > _initialSize)
+	{
+		++_processOverflows;
+
+		LOG_DEBUG(
+			"FCGIRequestArena overflow"
+			", allocated: {}"
+			", initialSize: {}",
+			_allocated, _initialSize
+		);
+	}
+
+	// le allocazioni successive ripartono dall'inizio di _initialBuffer
+	_resource.release();
+	_allocated = 0;
+}
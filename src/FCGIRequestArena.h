@@ -0,0 +1,71 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+// Arena (std::pmr) della singola richiesta: FCGIRequestData e la costruzione della risposta
+// allocano da un buffer del thread che viene liberato in blocco al termine della richiesta (reset),
+// senza passare dall'allocatore globale. Oltre initialSize l'arena prosegue su new/delete fino al reset.
+// Non è thread-safe: ogni istanza di FastCGIAPI (thread) ha la propria arena, una richiesta
+// con AsyncHandler sospeso si tiene la propria fino al termine della coroutine.
+class FCGIRequestArena final : public std::pmr::memory_resource
+{
+public:
+	explicit FCGIRequestArena(size_t initialSize);
+	~FCGIRequestArena() override = default;
+
+	FCGIRequestArena(const FCGIRequestArena &) = delete;
+	FCGIRequestArena &operator=(const FCGIRequestArena &) = delete;
+
+	// libera tutta la memoria allocata dalla richiesta, gli oggetti che la usano devono essere già stati distrutti
+	void reset();
+
+	// byte allocati dalla richiesta in corso
+	[[nodiscard]] size_t allocated() const { return _allocated; }
+	// massimo di byte allocati da una richiesta di questa arena
+	[[nodiscard]] size_t highWaterMark() const { return _highWaterMark; }
+
+	// massimo di byte allocati da una richiesta, in tutto il processo
+	static size_t processHighWaterMark() { return _processHighWaterMark; }
+	// richieste che hanno superato initialSize (api->requestArenaSize troppo piccolo)
+	static uint64_t processOverflows() { return _processOverflows; }
+
+private:
+	size_t _initialSize;
+	std::unique_ptr<std::byte[]> _initialBuffer;
+	std::pmr::monotonic_buffer_resource _resource;
+	size_t _allocated{};
+	size_t _highWaterMark{};
+
+	static inline std::atomic<size_t> _processHighWaterMark{};
+	static inline std::atomic<uint64_t> _processOverflows{};
+
+	void *do_allocate(size_t bytes, size_t alignment) override;
+	// la memoria viene liberata solo da reset
+	void do_deallocate(void *, size_t, size_t) override {}
+	[[nodiscard]] bool do_is_equal(const memory_resource &other) const noexcept override { return this == &other; }
+};
@@ -1,57 +1,172 @@
 
 #include "FCGIRequestData.h"
-#include <curl/curl.h>
+#include "FCGIConnection.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <memory>
+#include <unistd.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 using namespace std;
 
+namespace
+{
+int hexDigitValue(const char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	return -1;
+}
+
+bool unreserved(const char c)
+{
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '.' || c == '_' || c == '~';
+}
+
+#ifdef __SSE2__
+// byte di chunk compresi in [low, high]: con il bias di -128 - low il confronto signed equivale a quello unsigned
+__m128i bytesInRange(const __m128i chunk, const char low, const char high)
+{
+	return _mm_cmplt_epi8(
+		_mm_add_epi8(chunk, _mm_set1_epi8(static_cast<char>(-128 - low))), _mm_set1_epi8(static_cast<char>(-128 + (high - low + 1)))
+	);
+}
+#endif
+
+// numero di byte iniziali che la decodifica copia invariati (diversi da '%' e, con plusAsSpace, da '+').
+// Con SSE2 vengono controllati 16 byte alla volta
+size_t plainPrefixLength(const char *data, const size_t size, const bool plusAsSpace)
+{
+	size_t index = 0;
+#ifdef __SSE2__
+	const __m128i percent = _mm_set1_epi8('%');
+	const __m128i plus = _mm_set1_epi8(plusAsSpace ? '+' : '%');
+	for (; index + 16 <= size; index += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index));
+		if (const int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, percent), _mm_cmpeq_epi8(chunk, plus))); mask != 0)
+			return index + __builtin_ctz(mask);
+	}
+#endif
+	for (; index < size; index++)
+	{
+		if (data[index] == '%' || (plusAsSpace && data[index] == '+'))
+			break;
+	}
+
+	return index;
+}
+
+// numero di byte iniziali che la codifica copia invariati (ALPHA, DIGIT, "-._~")
+size_t unreservedPrefixLength(const char *data, const size_t size)
+{
+	size_t index = 0;
+#ifdef __SSE2__
+	for (; index + 16 <= size; index += 16)
+	{
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + index));
+		__m128i unreservedBytes = _mm_or_si128(
+			_mm_or_si128(bytesInRange(chunk, 'a', 'z'), bytesInRange(chunk, 'A', 'Z')),
+			_mm_or_si128(bytesInRange(chunk, '0', '9'), bytesInRange(chunk, '-', '.'))
+		);
+		unreservedBytes = _mm_or_si128(unreservedBytes, _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('_')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('~'))));
+		if (const int mask = ~_mm_movemask_epi8(unreservedBytes) & 0xFFFF; mask != 0)
+			return index + __builtin_ctz(mask);
+	}
+#endif
+	for (; index < size; index++)
+	{
+		if (!unreserved(data[index]))
+			break;
+	}
+
+	return index;
+}
+} // namespace
+
+FCGIRequestData::FCGIRequestData(pmr::memory_resource *memoryResource)
+	: _environment(memoryResource), _requestDetails(memoryResource), _queryParameters(memoryResource), _pathParameters(memoryResource)
+{
+}
+
+FCGIRequestData::~FCGIRequestData()
+{
+	// se l'handler ha spostato il file (rename) unlink fallisce con ENOENT
+	if (!requestBodyFilePath.empty())
+		unlink(requestBodyFilePath.c_str());
+}
+
 void FCGIRequestData::init(const FCGX_Request & request, int64_t& maxAPIContentLength)
+{
+	initEnvironment(request);
+	initRequestBody(request, maxAPIContentLength, {});
+}
+
+void FCGIRequestData::initEnvironment(const FCGX_Request & request)
 {
  	try
  	{
- 		fillEnvironmentDetails(request.envp);
+ 		// le richieste del transport Native mantengono envp fino alla fine della gestione (vedi FCGIConnection::finishRequest)
+		fillEnvironmentDetails(request.envp, !FCGIConnection::isNativeRequest(request));
 
  		requestMethod = getMapParameter(_requestDetails, "REQUEST_METHOD", "");
 
+ 		requestURI = getMapParameter(_requestDetails, "REQUEST_URI", "");
+
+	 	responseBodyCompressed = getHeaderParameter(responseBodyCompressedHeader, "false") == "true";
+
+ 		// REMOTE_ADDR is the address of the load balancer
+ 		// auto remoteAddrIt = requestDetails.find("REMOTE_ADDR");
+ 		clientIPAddress = getHeaderParameter(forwardedForHeader, "");
+
  		// contentLength
+ 		if (requestMethod == "POST" || requestMethod == "PUT")
  		{
- 			if (requestMethod == "POST" || requestMethod == "PUT")
- 			{
- 				string sContentLength = getMapParameter(_requestDetails, "CONTENT_LENGTH", "0");
- 				contentLength = stoul(sContentLength);
- 			}
- 			else
- 				contentLength = 0;
-
- 			if (contentLength > maxAPIContentLength)
- 			{
- 				string errorMessage = std::format(
-					 "ContentLength too long"
-					 ", contentLength: {}"
-					 ", _maxAPIContentLength: {}",
-					 contentLength, maxAPIContentLength
-				 );
- 				LOG_ERROR(errorMessage);
-
- 				throw runtime_error(errorMessage);
- 			}
+ 			string sContentLength = getMapParameter(_requestDetails, "CONTENT_LENGTH", "0");
+ 			contentLength = stoul(sContentLength);
  		}
+ 		else
+ 			contentLength = 0;
+ 	}
+ 	catch (exception &e)
+ 	{
+ 		LOG_ERROR("FCGIRequestData failed"
+ 			", exception: {}", e.what()
+ 		);
+ 		throw;
+ 	}
+}
 
- 		// requestBody
- 		if (contentLength > 0)
+void FCGIRequestData::initRequestBody(const FCGX_Request & request, const int64_t maxAPIContentLength, const BodyOptions &bodyOptions)
+{
+ 	try
+ 	{
+		const int64_t maxContentLength = bodyOptions.mode == BodyMode::Buffered ? maxAPIContentLength : bodyOptions.maxContentLength;
+ 		if (static_cast<int64_t>(contentLength) > maxContentLength)
  		{
-			auto content = new char[contentLength];
- 			contentLength = FCGX_GetStr(content, contentLength, request.in);
- 			requestBody.assign(content, contentLength);
- 			delete[] content;
+ 			string errorMessage = std::format(
+				 "ContentLength too long"
+				 ", contentLength: {}"
+				 ", maxContentLength: {}",
+				 contentLength, maxContentLength
+			 );
+ 			LOG_ERROR(errorMessage);
+
+ 			throw runtime_error(errorMessage);
  		}
 
- 		requestURI = getMapParameter(_requestDetails, "REQUEST_URI", "");
-
-	 	responseBodyCompressed = getHeaderParameter("x-responseBodyCompressed", "false") == "true";
-
- 		// REMOTE_ADDR is the address of the load balancer
- 		// auto remoteAddrIt = requestDetails.find("REMOTE_ADDR");
- 		clientIPAddress = getHeaderParameter("x-forwarded-for", "");
+ 		// requestBody
+ 		if (contentLength > 0)
+			readRequestBody(request, bodyOptions);
  	}
  	catch (exception &e)
  	{
@@ -62,59 +177,359 @@ void FCGIRequestData::init(const FCGX_Request & request, int64_t& maxAPIContentL
  	}
 }
 
-string FCGIRequestData::escape(const string &url)
+size_t FCGIRequestData::readBody(const span<char> buffer) const
+{
+	if (_requestBodyStream == nullptr || _requestBodyRemaining == 0 || buffer.empty())
+		return 0;
+
+	const auto toRead = static_cast<int>(min<unsigned long>({buffer.size(), _requestBodyRemaining, numeric_limits<int>::max()}));
+	const int readBytes = FCGX_GetStr(buffer.data(), toRead, _requestBodyStream);
+	if (readBytes <= 0)
+	{
+		// body più corto di CONTENT_LENGTH (connessione chiusa dal client)
+		_requestBodyRemaining = 0;
+		return 0;
+	}
+	_requestBodyRemaining -= readBytes;
+
+	return readBytes;
+}
+
+void FCGIRequestData::readRequestBody(const FCGX_Request &request, const BodyOptions &bodyOptions)
 {
-	CURL *curl = curl_easy_init();
-	if (!curl)
+	if (bodyOptions.mode == BodyMode::Streaming)
 	{
-		LOG_ERROR("curl_easy_init failed");
+		_requestBodyStream = request.in;
+		_requestBodyRemaining = contentLength;
 
-		throw runtime_error("curl_easy_init failed");
+		return;
 	}
 
-	char *encoded = curl_easy_escape(curl, url.c_str(), url.size());
-	if (!encoded)
+	if (bodyOptions.mode == BodyMode::Spool && static_cast<int64_t>(contentLength) > bodyOptions.spoolThreshold)
 	{
-		LOG_ERROR("curl_easy_escape failed");
-		curl_easy_cleanup(curl);
-		throw runtime_error("curl_easy_escape failed");
+		spoolRequestBody(request.in, bodyOptions.spoolDirectory);
+
+		return;
 	}
 
-	string buffer = encoded;
+	// letto direttamente in requestBody, senza buffer intermedio
+	requestBody.resize(contentLength);
+	contentLength = FCGX_GetStr(requestBody.data(), static_cast<int>(contentLength), request.in);
+	requestBody.resize(contentLength);
+}
+
+void FCGIRequestData::spoolRequestBody(FCGX_Stream *in, const string &spoolDirectory)
+{
+	string filePath = std::format("{}/fcgiRequestBody.XXXXXX", spoolDirectory);
+	const int fileDescriptor = mkostemp(filePath.data(), O_CLOEXEC);
+	if (fileDescriptor == -1)
+	{
+		string errorMessage = std::format(
+			"mkostemp failed"
+			", filePath: {}"
+			", errno: {}",
+			filePath, strerror(errno)
+		);
+		LOG_ERROR(errorMessage);
 
-	curl_free(encoded);
+		throw runtime_error(errorMessage);
+	}
+	requestBodyFilePath = filePath;
+
+	constexpr int bufferSize = 256 * 1024;
+	const auto buffer = make_unique_for_overwrite<char[]>(bufferSize);
+	unsigned long spooled = 0;
+	while (spooled < contentLength)
+	{
+		const int readBytes = FCGX_GetStr(buffer.get(), static_cast<int>(min<unsigned long>(bufferSize, contentLength - spooled)), in);
+		if (readBytes <= 0)
+			break;
+
+		for (int written = 0; written < readBytes;)
+		{
+			const ssize_t writeReturn = write(fileDescriptor, buffer.get() + written, readBytes - written);
+			if (writeReturn == -1)
+			{
+				if (errno == EINTR)
+					continue;
+
+				string errorMessage = std::format(
+					"write of the request body failed"
+					", filePath: {}"
+					", errno: {}",
+					filePath, strerror(errno)
+				);
+				LOG_ERROR(errorMessage);
+				close(fileDescriptor);
+
+				throw runtime_error(errorMessage);
+			}
+			written += static_cast<int>(writeReturn);
+		}
+		spooled += readBytes;
+	}
+	close(fileDescriptor);
 
-	curl_easy_cleanup(curl);
+	contentLength = spooled;
 
-	return buffer;
+	LOG_TRACE(
+		"Request body spooled"
+		", filePath: {}"
+		", contentLength: {}",
+		filePath, contentLength
+	);
 }
 
-string FCGIRequestData::unescape(const string &url)
+string FCGIRequestData::escape(const string_view url)
 {
-	CURL *curl = curl_easy_init();
-	if (!curl)
+	static constexpr char hexDigits[] = "0123456789ABCDEF";
+
+	string encoded;
+	encoded.reserve(url.size() + url.size() / 2);
+
+	size_t index = 0;
+	while (index < url.size())
+	{
+		const size_t plainLength = unreservedPrefixLength(url.data() + index, url.size() - index);
+		encoded.append(url.data() + index, plainLength);
+		index += plainLength;
+		if (index == url.size())
+			break;
+
+		const auto c = static_cast<unsigned char>(url[index++]);
+		encoded.push_back('%');
+		encoded.push_back(hexDigits[c >> 4]);
+		encoded.push_back(hexDigits[c & 0x0F]);
+	}
+
+	return encoded;
+}
+
+string FCGIRequestData::unescape(const string_view url, const bool plusAsSpace)
+{
+	// la decodifica non allunga mai la stringa: si scrive direttamente nel buffer e lo si accorcia alla fine
+	string decoded(url.size(), '\0');
+	char *output = decoded.data();
+
+	size_t index = 0;
+	while (index < url.size())
+	{
+		const size_t plainLength = plainPrefixLength(url.data() + index, url.size() - index, plusAsSpace);
+		memcpy(output, url.data() + index, plainLength);
+		output += plainLength;
+		index += plainLength;
+		if (index == url.size())
+			break;
+
+		if (url[index] == '+')
+		{
+			*output++ = ' ';
+			index++;
+
+			continue;
+		}
+
+		// '%': una sequenza non valida (es. "%G1" o '%' finale) viene lasciata invariata, come curl_easy_unescape
+		const int high = index + 2 < url.size() ? hexDigitValue(url[index + 1]) : -1;
+		const int low = high != -1 ? hexDigitValue(url[index + 2]) : -1;
+		if (low == -1)
+		{
+			*output++ = '%';
+			index++;
+
+			continue;
+		}
+		*output++ = static_cast<char>((high << 4) | low);
+		index += 3;
+	}
+	decoded.resize(output - decoded.data());
+
+	return decoded;
+}
+
+optional<vector<FCGIRequestData::ByteRange>> FCGIRequestData::parseRange(string_view range, const uint64_t size, const size_t maxRanges)
+{
+	constexpr string_view rangeUnit = "bytes=";
+	if (!range.starts_with(rangeUnit))
+		return nullopt;
+	range.remove_prefix(rangeUnit.size());
+
+	const auto parseNumber = [](const string_view text, uint64_t &number)
 	{
-		LOG_ERROR("curl_easy_init failed");
+		const auto [ptr, ec] = from_chars(text.data(), text.data() + text.size(), number);
+		return !text.empty() && ec == errc() && ptr == text.data() + text.size();
+	};
 
-		throw runtime_error("curl_easy_init failed");
+	vector<ByteRange> ranges;
+	size_t rangesNumber = 0;
+	while (!range.empty())
+	{
+		const size_t commaIndex = range.find(',');
+		string_view rangeSpec = range.substr(0, commaIndex);
+		range = commaIndex == string_view::npos ? string_view() : range.substr(commaIndex + 1);
+
+		while (!rangeSpec.empty() && rangeSpec.front() == ' ')
+			rangeSpec.remove_prefix(1);
+		while (!rangeSpec.empty() && rangeSpec.back() == ' ')
+			rangeSpec.remove_suffix(1);
+		if (rangeSpec.empty())
+			continue;
+		if (++rangesNumber > maxRanges)
+			return nullopt;
+
+		const size_t dashIndex = rangeSpec.find('-');
+		if (dashIndex == string_view::npos)
+			return nullopt;
+		const string_view first = rangeSpec.substr(0, dashIndex);
+		const string_view last = rangeSpec.substr(dashIndex + 1);
+
+		ByteRange byteRange{};
+		if (first.empty())
+		{
+			// -500: gli ultimi 500 byte
+			uint64_t suffixLength;
+			if (!parseNumber(last, suffixLength))
+				return nullopt;
+			if (suffixLength == 0 || size == 0)
+				continue;
+			byteRange = {size - min(suffixLength, size), size - 1};
+		}
+		else
+		{
+			if (!parseNumber(first, byteRange.start))
+				return nullopt;
+			if (last.empty())
+				byteRange.end = numeric_limits<uint64_t>::max();
+			else if (!parseNumber(last, byteRange.end) || byteRange.end < byteRange.start)
+				return nullopt;
+			// inizio oltre la fine della risorsa: intervallo non soddisfacibile
+			if (byteRange.start >= size)
+				continue;
+			byteRange.end = min(byteRange.end, size - 1);
+		}
+		ranges.push_back(byteRange);
+	}
+	if (rangesNumber == 0)
+		return nullopt;
+
+	// intervalli sovrapposti o adiacenti uniti (RFC 9110 14.3): nessun byte inviato più volte
+	if (ranges.size() > 1)
+	{
+		ranges::sort(ranges, {}, &ByteRange::start);
+		size_t lastIndex = 0;
+		for (size_t rangeIndex = 1; rangeIndex < ranges.size(); rangeIndex++)
+		{
+			if (ranges[rangeIndex].start <= ranges[lastIndex].end + 1)
+				ranges[lastIndex].end = max(ranges[lastIndex].end, ranges[rangeIndex].end);
+			else
+				ranges[++lastIndex] = ranges[rangeIndex];
+		}
+		ranges.resize(lastIndex + 1);
 	}
 
-	int decodelen;
-	char *decoded = curl_easy_unescape(curl, url.c_str(), url.size(), &decodelen);
-	if (!decoded)
+	return ranges;
+}
+
+bool FCGIRequestData::notModified(const string_view etag, const optional<chrono::system_clock::time_point> lastModified) const
+{
+	if (requestMethod != "GET" && requestMethod != "HEAD")
+		return false;
+
+	if (const string ifNoneMatch = getHeaderParameter(ifNoneMatchHeader, ""); !ifNoneMatch.empty())
+		return etagMatches(ifNoneMatch, etag);
+
+	if (!lastModified)
+		return false;
+
+	const optional<chrono::system_clock::time_point> ifModifiedSince = parseHTTPDate(getHeaderParameter(ifModifiedSinceHeader, ""));
+	// la data HTTP ha la precisione del secondo
+	return ifModifiedSince && chrono::floor<chrono::seconds>(*lastModified) <= *ifModifiedSince;
+}
+
+bool FCGIRequestData::preconditionFailed(const string_view etag) const
+{
+	if (requestMethod == "GET" || requestMethod == "HEAD")
+		return false;
+
+	const string ifNoneMatch = getHeaderParameter(ifNoneMatchHeader, "");
+	return !ifNoneMatch.empty() && etagMatches(ifNoneMatch, etag);
+}
+
+bool FCGIRequestData::etagMatches(string_view ifNoneMatch, const string_view etag)
+{
+	while (!ifNoneMatch.empty())
 	{
-		LOG_ERROR("curl_easy_unescape failed");
-		curl_easy_cleanup(curl);
-		throw runtime_error("curl_easy_unescape failed");
+		const size_t commaIndex = ifNoneMatch.find(',');
+		string_view candidate = ifNoneMatch.substr(0, commaIndex);
+		ifNoneMatch = commaIndex == string_view::npos ? string_view() : ifNoneMatch.substr(commaIndex + 1);
+
+		while (!candidate.empty() && candidate.front() == ' ')
+			candidate.remove_prefix(1);
+		while (!candidate.empty() && candidate.back() == ' ')
+			candidate.remove_suffix(1);
+		if (candidate == "*")
+			return true;
+		if (candidate.starts_with("W/"))
+			candidate.remove_prefix(2);
+		if (candidate.size() >= 2 && candidate.front() == '"' && candidate.back() == '"' && candidate.substr(1, candidate.size() - 2) == etag)
+			return true;
 	}
 
-	string buffer = decoded;
+	return false;
+}
 
-	curl_free(decoded);
+namespace
+{
+constexpr array<string_view, 7> weekdayNames{"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+constexpr array<string_view, 12> monthNames{"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
 
-	curl_easy_cleanup(curl);
+// cifre decimali di text[offset, offset + length)
+optional<int> dateNumber(const string_view text, const size_t offset, const size_t length)
+{
+	int number{};
+	const char *first = text.data() + offset;
+	if (const auto [ptr, ec] = from_chars(first, first + length, number); ec != errc() || ptr != first + length)
+		return nullopt;
+	return number;
+}
+} // namespace
 
-	return buffer;
+optional<chrono::system_clock::time_point> FCGIRequestData::parseHTTPDate(const string_view httpDate)
+{
+	// Sun, 06 Nov 1994 08:49:37 GMT
+	if (httpDate.size() != 29 || httpDate.substr(3, 2) != ", " || httpDate[7] != ' ' || httpDate[11] != ' ' || httpDate[16] != ' ' ||
+		httpDate[19] != ':' || httpDate[22] != ':' || !httpDate.ends_with(" GMT"))
+		return nullopt;
+
+	const auto monthIt = ranges::find(monthNames, httpDate.substr(8, 3));
+	const optional<int> day = dateNumber(httpDate, 5, 2);
+	const optional<int> year = dateNumber(httpDate, 12, 4);
+	const optional<int> hours = dateNumber(httpDate, 17, 2);
+	const optional<int> minutes = dateNumber(httpDate, 20, 2);
+	const optional<int> seconds = dateNumber(httpDate, 23, 2);
+	if (monthIt == monthNames.end() || !day || !year || !hours || !minutes || !seconds || *hours > 23 || *minutes > 59 || *seconds > 60)
+		return nullopt;
+
+	const chrono::year_month_day date{
+		chrono::year(*year), chrono::month(static_cast<unsigned>(monthIt - monthNames.begin() + 1)), chrono::day(static_cast<unsigned>(*day))
+	};
+	if (!date.ok())
+		return nullopt;
+
+	return chrono::sys_days(date) + chrono::hours(*hours) + chrono::minutes(*minutes) + chrono::seconds(*seconds);
+}
+
+string FCGIRequestData::formatHTTPDate(const chrono::system_clock::time_point timePoint)
+{
+	const chrono::sys_days days = chrono::floor<chrono::days>(timePoint);
+	const chrono::year_month_day date(days);
+	const chrono::hh_mm_ss time(chrono::floor<chrono::seconds>(timePoint - days));
+
+	return std::format(
+		"{}, {:02} {} {:04} {:02}:{:02}:{:02} GMT", weekdayNames[chrono::weekday(days).c_encoding()], static_cast<unsigned>(date.day()),
+		monthNames[static_cast<unsigned>(date.month()) - 1], static_cast<int>(date.year()), time.hours().count(), time.minutes().count(),
+		time.seconds().count()
+	);
 }
 
 void FCGIRequestData::parseContentRange(string_view contentRange, uint64_t &contentRangeStart, uint64_t &contentRangeEnd, uint64_t &contentRangeSize)
@@ -139,13 +554,20 @@ void FCGIRequestData::parseContentRange(string_view contentRange, uint64_t &cont
 
 		// Trova i separatori
 		const auto dash = contentRange.find('-');
-		const auto slash = contentRange.find('/');
+		const auto slash = dash == string_view::npos ? string_view::npos : contentRange.find('/', dash + 1);
+		if (slash == string_view::npos)
+			throw runtime_error("Content-Range without '-' or '/'");
 
-		uint64_t start = 0, end = 0, size = 0;
-
-		from_chars(contentRange.data(), contentRange.data() + dash, contentRangeStart);
-		from_chars(contentRange.data() + dash + 1, contentRange.data() + slash, contentRangeEnd);
-		from_chars(contentRange.data() + slash + 1, contentRange.data() + contentRange.size(), contentRangeSize);
+		// ogni numero deve occupare per intero il proprio campo
+		const auto parseNumber = [](const string_view field, uint64_t &number)
+		{
+			if (const auto [ptr, ec] = from_chars(field.data(), field.data() + field.size(), number);
+				field.empty() || ec != errc() || ptr != field.data() + field.size())
+				throw runtime_error("Content-Range with a wrong number");
+		};
+		parseNumber(contentRange.substr(0, dash), contentRangeStart);
+		parseNumber(contentRange.substr(dash + 1, slash - dash - 1), contentRangeEnd);
+		parseNumber(contentRange.substr(slash + 1), contentRangeSize);
 	}
 	catch (exception &e)
 	{
@@ -229,15 +651,35 @@ void FCGIRequestData::parseContentRange(string_view contentRange, uint64_t &cont
 	*/
 }
 
-void FCGIRequestData::fillEnvironmentDetails(const char *const *envp)
+void FCGIRequestData::fillEnvironmentDetails(const char *const *envp, const bool copyEnvironment)
 {
-	int valueIndex;
+	size_t environmentVariablesNumber = 0;
+	{
+		size_t environmentSize = 0;
+		for (const char *const *environmentVariable = envp; *environmentVariable; ++environmentVariable)
+		{
+			if (copyEnvironment)
+				environmentSize += strlen(*environmentVariable);
+			environmentVariablesNumber++;
+		}
+		// la capacità riservata garantisce che gli append seguenti non riallochino _environment
+		if (copyEnvironment)
+			_environment.reserve(environmentSize);
+	}
+	_requestDetails.reserve(environmentVariablesNumber);
 
 	for (; *envp; ++envp)
 	{
-		string environmentKeyValue = *envp;
+		string_view environmentKeyValue = *envp;
+		if (copyEnvironment)
+		{
+			const size_t environmentOffset = _environment.size();
+			_environment.append(environmentKeyValue);
+			environmentKeyValue = string_view(_environment).substr(environmentOffset);
+		}
 
-		if ((valueIndex = environmentKeyValue.find('=')) == string::npos)
+		size_t valueIndex;
+		if ((valueIndex = environmentKeyValue.find('=')) == string_view::npos)
 		{
 			LOG_ERROR(
 				"Unexpected environment variable"
@@ -248,26 +690,19 @@ void FCGIRequestData::fillEnvironmentDetails(const char *const *envp)
 			continue;
 		}
 
-		string key = environmentKeyValue.substr(0, valueIndex);
-		string value = environmentKeyValue.substr(valueIndex + 1);
+		string_view key = environmentKeyValue.substr(0, valueIndex);
+		string_view value = environmentKeyValue.substr(valueIndex + 1);
 
-		_requestDetails.emplace(key, value);
+		_requestDetails.append(key, value);
 
-		if (key == "REQUEST_URI")
-			LOG_TRACE(
-				"Environment variable"
-				", key/Name: {}={}",
-				key, value
-			);
-		else
-			LOG_TRACE(
-				"Environment variable"
-				", key/Name: {}={}",
-				key, value
-			);
+		LOG_TRACE(
+			"Environment variable"
+			", key/Name: {}={}",
+			key, value
+		);
 	}
 
-	if (unordered_map<string, string>::iterator it; (it = _requestDetails.find("QUERY_STRING")) != _requestDetails.end())
+	if (const auto it = _requestDetails.find("QUERY_STRING"); it != _requestDetails.end())
 		fillQueryString(it->second);
 }
 
@@ -324,19 +759,19 @@ void FCGIRequestData::fillQueryString(std::string_view queryString)
 		{
 			const std::size_t equalIndex = token.find('=');
 
-			std::string key;
-			std::string value;
+			std::string_view key;
+			std::string_view value;
 
 			if (equalIndex == std::string_view::npos)
-				key = std::string(token);
+				key = token;
 			else
 			{
-				key = std::string(token.substr(0, equalIndex));
-				value = std::string(token.substr(equalIndex + 1));
+				key = token.substr(0, equalIndex);
+				value = token.substr(equalIndex + 1);
 			}
 
-			// in caso di key duplicata (a=1&a=2) sovrascrivo il valore precedente, tenendo l'ultimo (last wins)
-			_queryParameters[key] = value;
+			// le key duplicate (a=1&a=2) vengono risolte alla fine da assignDuplicates
+			_queryParameters.append(key, value);
 
 			LOG_TRACE(
 				"Query parameter"
@@ -350,21 +785,38 @@ void FCGIRequestData::fillQueryString(std::string_view queryString)
 
 		startParameterIndex = endParameterIndex + 1;
 	}
+
+	// in caso di key duplicata (a=1&a=2) tengo l'ultimo valore (last wins)
+	_queryParameters.assignDuplicates();
 }
 
 unordered_map<string, string> FCGIRequestData::getQueryParameters() const
 {
-	return _queryParameters;
+	unordered_map<string, string> queryParameters;
+	queryParameters.reserve(_queryParameters.size());
+	for (const auto &[key, value] : _queryParameters)
+		queryParameters.insert_or_assign(string(key), string(value));
+	return queryParameters;
 }
 
 vector<pair<string, string>> FCGIRequestData::getHeaders() const
 {
 	vector<pair<string, string>> headers;
-	for (const auto &[key, value]: _requestDetails)
+	for (const auto &[key, value] : headersView())
+		headers.emplace_back(headerName(key), value);
+	return headers;
+}
+
+string FCGIRequestData::headerName(const string_view cgiName)
+{
+	// HTTP_X_FORWARDED_FOR -> x-forwarded-for in un solo passaggio
+	string headerName(cgiName.starts_with("HTTP_") ? cgiName.substr(5) : cgiName);
+	for (char &c : headerName)
 	{
-		if (key.starts_with("HTTP_"))
-			headers.emplace_back(StringUtils::replaceAll(StringUtils::lowerCase(key.substr(5)), "_", "-"),
-				value);
+		if (c == '_')
+			c = '-';
+		else if (c >= 'A' && c <= 'Z')
+			c = static_cast<char>(c - 'A' + 'a');
 	}
-	return headers;
+	return headerName;
 }
\ No newline at end of file
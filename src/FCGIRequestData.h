@@ -22,15 +22,26 @@
 
 #pragma once
 
+#include "FCGIHeaderKey.h"
+#include "FCGIParametersMap.h"
+#include "FCGIResponseCompressor.h"
 #include "HTTPError.h"
 #include "StringUtils.h"
 #include "spdlog/spdlog.h"
+#include <charconv>
+#include <chrono>
+#include <expected>
 #include <fcgiapp.h>
+#include <functional>
+#include <memory_resource>
+#include <optional>
+#include <ranges>
 #include <set>
 #include <span>
 #include <spdlog/fmt/bundled/ranges.h>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 class FCGIRequestData final
 {
@@ -44,19 +55,92 @@ public:
 		virtual ~AuthorizationDetails() = default;
 	};
 
+	// modalità di lettura del body, scelta per handler (vedi FastCGIAPI::registerHandler)
+	enum class BodyMode
+	{
+		// body letto interamente in requestBody
+		Buffered,
+		// body non letto da init: l'handler lo legge a blocchi con readBody
+		Streaming,
+		// body oltre spoolThreshold scritto in un file temporaneo (requestBodyFilePath), altrimenti in requestBody
+		Spool
+	};
+
+	struct BodyOptions
+	{
+		BodyMode mode{BodyMode::Buffered};
+		// limite per Streaming e Spool (per Buffered vale maxAPIContentLength)
+		int64_t maxContentLength{};
+		int64_t spoolThreshold{};
+		std::string spoolDirectory;
+	};
+
 	std::string requestMethod;
 	std::string requestBody;
+	// BodyMode::Spool: file con il body, eliminato dal distruttore se l'handler non lo ha spostato (rename)
+	std::string requestBodyFilePath;
 	unsigned long contentLength;
 	std::string requestURI;
 	std::shared_ptr<AuthorizationDetails> authorizationDetails;
 	bool responseBodyCompressed;
 	std::string clientIPAddress;
+	// route del router di FastCGIAPI (FCGIRouter) trovata per la richiesta, -1 se nessuna
+	int32_t routeIndex{-1};
+	// Content-Encoding della risposta negoziato con Accept-Encoding (Identity: risposta non compressa)
+	// e relativo livello (-1: default dell'encoding)
+	FCGIResponseCompressor::Encoding responseEncoding{FCGIResponseCompressor::Encoding::Identity};
+	int32_t responseCompressionLevel{-1};
+	// responseEncoding Zstd con il dizionario di api->responseCompression->zstdDictionary (il client ne ha inviato l'id)
+	bool responseZstdDictionary{};
+	// la risposta dipende da Accept-Encoding (compressione abilitata per la richiesta): Vary anche se non compressa
+	bool responseEncodingNegotiated{};
+	// chiave di FCGIResponseCache della risposta, vuota se la risposta non va in cache
+	std::string responseCacheKey;
+	// FCGIResponseCache::generation() al calcolo di responseCacheKey (prima dell'handler)
+	uint64_t responseCacheGeneration{};
+
+	// header letti ad ogni richiesta
+	static constexpr FCGIHeaderKey authorizationHeader{"authorization"};
+	static constexpr FCGIHeaderKey forwardedForHeader{"x-forwarded-for"};
+	static constexpr FCGIHeaderKey responseBodyCompressedHeader{"x-responseBodyCompressed"};
+	static constexpr FCGIHeaderKey rangeHeader{"range"};
+	static constexpr FCGIHeaderKey ifNoneMatchHeader{"if-none-match"};
+	static constexpr FCGIHeaderKey ifModifiedSinceHeader{"if-modified-since"};
+
+	// intervallo di byte di un header Range, end incluso
+	struct ByteRange
+	{
+		uint64_t start;
+		uint64_t end;
 
-	~FCGIRequestData() = default;
-	void init(const FCGX_Request & request, int64_t& maxAPIContentLength);
+		[[nodiscard]] uint64_t length() const { return end - start + 1; }
+	};
 
-	static std::string escape(const std::string &url);
-	static std::string unescape(const std::string &url);
+	// memoryResource: memoria per l'environment e le mappe dei parametri (es. FCGIRequestArena)
+	explicit FCGIRequestData(std::pmr::memory_resource *memoryResource = std::pmr::get_default_resource());
+	~FCGIRequestData();
+
+	// le mappe contengono string_view nella memoria della richiesta (o in _environment): non copiabile
+	FCGIRequestData(const FCGIRequestData &) = delete;
+	FCGIRequestData &operator=(const FCGIRequestData &) = delete;
+
+	void init(const FCGX_Request & request, int64_t& maxAPIContentLength);
+	// init in due fasi: initEnvironment legge environment, header, query string e Content-Length,
+	// initRequestBody controlla la Content-Length e legge il body secondo bodyOptions.
+	// FastCGIAPI legge il body solo dopo checkAuthorization: un client non autorizzato non deve poter
+	// far leggere (o scrivere su disco con BodyMode::Spool) fino a maxContentLength byte
+	void initEnvironment(const FCGX_Request & request);
+	void initRequestBody(const FCGX_Request & request, int64_t maxAPIContentLength, const BodyOptions &bodyOptions);
+
+	// BodyMode::Streaming: legge il prossimo blocco del body in buffer, ritorna 0 a body terminato.
+	// Va chiamato prima di inviare la risposta (sendSuccess/sendError chiudono la richiesta)
+	size_t readBody(std::span<char> buffer) const;
+
+	// percent-encoding (RFC 3986): tutti i byte tranne ALPHA, DIGIT e "-._~" diventano %XX
+	static std::string escape(std::string_view url);
+	// decodifica le sequenze %XX; con plusAsSpace ('application/x-www-form-urlencoded', es. query string)
+	// anche '+' diventa spazio, nello stesso passaggio
+	static std::string unescape(std::string_view url, bool plusAsSpace = false);
 
 	std::string getHeaderParameter(
 		const std::string& headerName, const char *defaultParameter,
@@ -82,9 +166,37 @@ public:
 		std::span<const T> allowedValues = {}, bool *isParamPresent = nullptr
 	) const
 	{
-		return getMapParameter(_requestDetails, std::format("HTTP_{}",
-			StringUtils::replaceAll(StringUtils::upperCase(headerName), "-", "_")),
-			std::move(defaultParameter), mandatory, allowedValues, isParamPresent);
+		if (headerName.size() <= FCGIHeaderKey::maxNameLength)
+			return getHeaderParameter(FCGIHeaderKey(headerName), std::move(defaultParameter), mandatory, allowedValues, isParamPresent);
+		// il nome può arrivare dal client: oltre maxNameLength nessuna chiave precalcolata (FCGIHeaderKey lancerebbe length_error)
+		return getMapParameter(_requestDetails, FCGIHeaderKey::cgiName(headerName), std::move(defaultParameter), mandatory, allowedValues, isParamPresent);
+	}
+
+	std::string getHeaderParameter(
+		const FCGIHeaderKey& headerKey, const char *defaultParameter,
+		const bool mandatory, const std::initializer_list<std::string> allowedValues, bool *isParamPresent = nullptr
+	) const
+	{
+		return getHeaderParameter(headerKey, std::string(defaultParameter), mandatory,
+			std::span<const std::string>(allowedValues.begin(), allowedValues.size()), isParamPresent);
+	}
+
+	std::string getHeaderParameter(
+		const FCGIHeaderKey& headerKey, const char *defaultParameter = "",
+		const bool mandatory = false, std::span<const std::string> allowedValues = {}, bool *isParamPresent = nullptr
+	) const
+	{
+		return getHeaderParameter(headerKey, std::string(defaultParameter), mandatory, allowedValues, isParamPresent);
+	}
+
+	template <typename T>
+	requires (!std::is_same_v<T, const char*>)
+	T getHeaderParameter(
+		const FCGIHeaderKey& headerKey, T defaultParameter, const bool mandatory = false,
+		std::span<const T> allowedValues = {}, bool *isParamPresent = nullptr
+	) const
+	{
+		return getMapParameter(_requestDetails, headerKey.cgiName(), std::move(defaultParameter), mandatory, allowedValues, isParamPresent);
 	}
 
 	std::string getQueryParameter(
@@ -137,6 +249,126 @@ public:
 		return getMapParameter(_queryParameters, parameterName, delim, defaultParameter, mandatory, isParamPresent);
 	}
 
+	// come sopra ma aggiunge gli elementi a values, fornito dal chiamante (std::vector, std::set, std::pmr::vector,
+	// già riservato o riutilizzato tra richieste...), per cui con le liste di migliaia di id non ci sono
+	// allocazioni oltre quelle di values. Ritorna false se il parametro non è presente
+	template <typename C>
+	bool getQueryParameterList(const std::string_view parameterName, const char delim, C &values, const bool mandatory = false) const
+	{
+		return getMapParameterList(_queryParameters, parameterName, delim, values, mandatory);
+	}
+
+	// conversione di un valore (non decodificato) nel tipo T: i numerici con std::from_chars,
+	// gli altri tipi con StringUtils::getValue. Valore non valido: HTTPError 400
+	template <typename T>
+	static T parseValue(const std::string_view value, const std::string_view parameterName)
+	{
+		auto parsedValue = tryParseValue<T>(value, parameterName);
+		if (!parsedValue)
+		{
+			const std::string errorMessage = parsedValue.error().message();
+			LOG_ERROR(errorMessage);
+			throw parsedValue.error().exception();
+		}
+
+		return std::move(*parsedValue);
+	}
+
+	// come parseValue, senza eccezioni per i valori numerici
+	template <typename T>
+	static std::expected<T, FastCGIError::RequestError> tryParseValue(const std::string_view value, const std::string_view parameterName)
+	{
+		if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+		{
+			const char *first = value.data();
+			const char *last = value.data() + value.size();
+			// from_chars non accetta il segno '+'
+			if (first != last && *first == '+')
+				first++;
+
+			T parsedValue{};
+			const auto [ptr, ec] = std::from_chars(first, last, parsedValue);
+			if (ec != std::errc() || ptr != last)
+				return std::unexpected(FastCGIError::RequestError::invalidValue(parameterName, value));
+
+			return parsedValue;
+		}
+		else if constexpr (std::is_same_v<T, std::string>)
+			return std::string(value);
+		else
+		{
+			try
+			{
+				return StringUtils::getValue<T>(std::string(value));
+			}
+			catch (const std::exception &)
+			{
+				return std::unexpected(FastCGIError::RequestError::invalidValue(parameterName, value));
+			}
+		}
+	}
+
+	// varianti senza eccezioni di getQueryParameter/getHeaderParameter: parametro mancante, valore
+	// non valido o non ammesso ritornano FastCGIError::RequestError (nessun log, il messaggio viene
+	// formattato solo se richiesto). Le string_view dell'errore sono valide quanto parameterName
+	// (o headerKey, es. static constexpr) e la richiesta
+	template <typename T>
+	std::expected<T, FastCGIError::RequestError> tryGetQueryParameter(
+		const std::string_view parameterName, std::type_identity_t<T> defaultParameter = {}, const bool mandatory = false,
+		std::span<const std::type_identity_t<T>> allowedValues = {}
+	) const
+	{
+		return tryGetMapParameter<T>(_queryParameters, parameterName, std::move(defaultParameter), mandatory, allowedValues);
+	}
+
+	template <typename T>
+	std::expected<T, FastCGIError::RequestError> tryGetHeaderParameter(
+		const FCGIHeaderKey &headerKey, std::type_identity_t<T> defaultParameter = {}, const bool mandatory = false,
+		std::span<const std::type_identity_t<T>> allowedValues = {}
+	) const
+	{
+		return tryGetMapParameter<T>(_requestDetails, headerKey.cgiName(), std::move(defaultParameter), mandatory, allowedValues);
+	}
+
+	// aggiunge a values gli elementi di value (non decodificato) separati da delim, gli elementi vuoti vengono ignorati.
+	// value viene diviso prima della decodifica, per cui un delimitatore codificato (es. "a%2Cb") resta nell'elemento;
+	// ogni elemento viene poi decodificato (vedi unescape) solo se contiene '%' o '+'.
+	// I numerici vengono convertiti con std::from_chars, se values ha reserve viene riservato lo spazio per tutti gli elementi
+	template <typename C>
+	static void splitList(const std::string_view value, const char delim, C &values, const std::string_view parameterName = {})
+	{
+		using T = typename C::value_type;
+
+		if constexpr (requires { values.reserve(size_t{}); })
+			values.reserve(values.size() + std::ranges::count(value, delim) + 1);
+
+		std::string unescapedItem;
+		size_t itemStart = 0;
+		while (itemStart <= value.size())
+		{
+			size_t itemEnd = value.find(delim, itemStart);
+			if (itemEnd == std::string_view::npos)
+				itemEnd = value.size();
+
+			std::string_view item = value.substr(itemStart, itemEnd - itemStart);
+			if (item.find_first_of("%+") != std::string_view::npos)
+			{
+				unescapedItem = unescape(item, true);
+				item = unescapedItem;
+			}
+
+			if (!item.empty())
+			{
+				if constexpr (requires { values.push_back(std::declval<T>()); })
+					values.push_back(parseValue<T>(item, parameterName));
+				else
+					values.insert(parseValue<T>(item, parameterName));
+			}
+
+			itemStart = itemEnd + 1;
+		}
+	}
+
 	template <typename T>
 	std::optional<T> getOptHeaderParameter(const std::string& parameterName, std::initializer_list<T> allowedValues) const
 	{
@@ -150,6 +382,19 @@ public:
 		return getOptMapParameter<T>(_requestDetails, parameterName, allowedValues);
 	}
 
+	template <typename T>
+	std::optional<T> getOptHeaderParameter(const FCGIHeaderKey& headerKey, std::initializer_list<T> allowedValues) const
+	{
+		return getOptMapParameter<T>(_requestDetails, headerKey.cgiName(),
+			std::span<const T>(allowedValues.begin(), allowedValues.size()));
+	}
+
+	template <typename T>
+	std::optional<T> getOptHeaderParameter(const FCGIHeaderKey& headerKey, std::span<const T> allowedValues = {}) const
+	{
+		return getOptMapParameter<T>(_requestDetails, headerKey.cgiName(), allowedValues);
+	}
+
 	template <typename T>
 	std::optional<T> getOptQueryParameter(const std::string& parameterName, std::initializer_list<T> allowedValues) const
 	{
@@ -163,23 +408,140 @@ public:
 		return getOptMapParameter<T>(_queryParameters, parameterName, allowedValues);
 	}
 
+	// copia dei parametri di query, valori come ricevuti (non decodificati), con le chiavi duplicate vale l'ultimo
 	[[nodiscard]] std::unordered_map<std::string, std::string> getQueryParameters() const;
+	// copia degli header della richiesta, con il nome HTTP in minuscolo (es. "x-forwarded-for")
 	[[nodiscard]] std::vector<std::pair<std::string, std::string>> getHeaders() const;
 
+	// come getQueryParameters ma senza copie: nell'ordine della query string, valori non decodificati (vedi unescape).
+	// Le string_view sono valide fino alla distruzione di FCGIRequestData
+	[[nodiscard]] std::span<const FCGIParametersView::value_type> queryParametersView() const { return _queryParameters.span(); }
+	// come getHeaders ma senza copie (variabili HTTP_*): la chiave è il nome CGI
+	// (confrontabile con FCGIHeaderKey::cgiName(), vedi headerName per il nome HTTP)
+	[[nodiscard]] auto headersView() const
+	{
+		return _requestDetails | std::views::filter([](const FCGIParametersView::value_type &parameter)
+			{ return parameter.first.starts_with("HTTP_"); });
+	}
+	// HTTP_X_FORWARDED_FOR -> x-forwarded-for
+	static std::string headerName(std::string_view cgiName);
+
+	// parametri del path della route ({name}, vedi FCGIRouter), decodificati ('+' resta '+')
+	[[nodiscard]] std::string getPathParameter(const std::string_view parameterName, const char *defaultParameter = "") const
+	{
+		const auto it = _pathParameters.find(parameterName);
+		if (it == _pathParameters.end())
+			return defaultParameter;
+		return unescape(it->second);
+	}
+
+	template <typename T>
+	requires (!std::is_same_v<T, const char*>)
+	[[nodiscard]] T getPathParameter(const std::string_view parameterName, T defaultParameter) const
+	{
+		const auto it = _pathParameters.find(parameterName);
+		if (it == _pathParameters.end())
+			return defaultParameter;
+		if constexpr (std::is_same_v<T, std::string>)
+			return unescape(it->second);
+		else
+			return parseValue<T>(it->second, parameterName);
+	}
+
+	[[nodiscard]] std::span<const FCGIParametersView::value_type> getPathParameters() const { return _pathParameters.span(); }
+
+	// REQUEST_URI come ricevuto (non decodificato, a differenza di requestURI): un %2F non separa i segmenti del path
+	[[nodiscard]] std::string_view rawRequestURI() const
+	{
+		const auto it = _requestDetails.find("REQUEST_URI");
+		return it == _requestDetails.end() ? std::string_view() : it->second;
+	}
+
+	// header come ricevuto, senza la decodifica di getHeaderParameter (percent e '+' come spazio, es. per i '+' del base64
+	// di Authorization), nullopt se assente
+	[[nodiscard]] std::optional<std::string_view> getRawHeaderParameter(const FCGIHeaderKey &headerKey) const
+	{
+		const auto it = _requestDetails.find(headerKey.cgiName());
+		return it == _requestDetails.end() ? std::nullopt : std::optional(it->second);
+	}
+
+	// usato dal router: value deve puntare in rawRequestURI
+	void addPathParameter(const std::string_view parameterName, const std::string_view value) { _pathParameters.append(parameterName, value); }
+
+	// Range: bytes=0-499,1000-,-500 su una risorsa di size byte.
+	// nullopt: header non valido o con più di maxRanges intervalli, va ignorato (risposta 200 con l'intera risorsa).
+	// Vettore vuoto: nessun intervallo soddisfacibile (416).
+	// Gli intervalli sono ordinati per inizio, quelli sovrapposti o adiacenti uniti
+	static std::optional<std::vector<ByteRange>> parseRange(std::string_view range, uint64_t size, size_t maxRanges = 16);
+
+	// richiesta condizionale (If-None-Match, If-Modified-Since) soddisfatta dalla risposta con etag
+	// (senza virgolette) e lastModified: la risposta può essere 304. Solo per GET e HEAD,
+	// If-None-Match ha la precedenza (RFC 9110 13.2.2), If-Modified-Since vale se lastModified è noto
+	[[nodiscard]] bool notModified(std::string_view etag, std::optional<std::chrono::system_clock::time_point> lastModified = std::nullopt) const;
+	// If-None-Match che corrisponde a etag con un metodo diverso da GET e HEAD: la risposta è 412 (RFC 9110 13.1.2)
+	[[nodiscard]] bool preconditionFailed(std::string_view etag) const;
+	// If-None-Match (lista di ETag o "*") con confronto debole (W/ ignorato)
+	static bool etagMatches(std::string_view ifNoneMatch, std::string_view etag);
+	// IMF-fixdate (Sun, 06 Nov 1994 08:49:37 GMT), nullopt per gli altri formati (la data va ignorata)
+	static std::optional<std::chrono::system_clock::time_point> parseHTTPDate(std::string_view httpDate);
+	static std::string formatHTTPDate(std::chrono::system_clock::time_point timePoint);
+
 	static void parseContentRange(std::string_view contentRange, uint64_t &contentRangeStart, uint64_t &contentRangeEnd,
 		uint64_t &contentRangeSize);
 
 private:
-	std::unordered_map<std::string, std::string> _requestDetails;
-	std::unordered_map<std::string, std::string> _queryParameters;
+	using ParametersMap = FCGIParametersView;
+
+	// copia dell'environment della richiesta (una sola allocazione) quando envp viene liberato prima
+	// della fine della gestione della richiesta (libfcgi: FCGX_Finish_r dentro sendSuccess).
+	// Con il transport Native envp resta valido fino alla distruzione di FCGIRequestData e non viene copiato
+	std::pmr::string _environment;
+	// chiavi e valori puntano in envp oppure in _environment.
+	// Capacità inline dimensionate sulle richieste tipiche (una trentina di variabili CGI, pochi parametri di query)
+	FCGIParametersMap<48> _requestDetails;
+	FCGIParametersMap<16> _queryParameters;
+	FCGIParametersMap<8> _pathParameters;
+
+	// BodyMode::Streaming
+	FCGX_Stream *_requestBodyStream{};
+	mutable unsigned long _requestBodyRemaining{};
+
+	void readRequestBody(const FCGX_Request &request, const BodyOptions &bodyOptions);
+	void spoolRequestBody(FCGX_Stream *in, const std::string &spoolDirectory);
+
+	void fillEnvironmentDetails(const char *const *envp, bool copyEnvironment);
+	void fillQueryString(std::string_view queryString);
 
+	template <typename T>
+	static std::expected<T, FastCGIError::RequestError> tryGetMapParameter(
+		const ParametersMap &mapParameters, const std::string_view parameterName, T defaultParameter,
+		const bool mandatory, std::span<const T> allowedValues)
+	{
+		const auto it = mapParameters.find(parameterName);
+		if (it == mapParameters.end() || it->second.empty())
+		{
+			if (mandatory)
+				return std::unexpected(FastCGIError::RequestError::missingParameter(parameterName));
+			return defaultParameter;
+		}
 
-	void fillEnvironmentDetails(const char *const *envp);
-	void fillQueryString(std::string_view queryString);
+		std::expected<T, FastCGIError::RequestError> parameterValue;
+		if constexpr (std::is_same_v<T, std::string>)
+			parameterValue = unescape(it->second, true);
+		else
+			parameterValue = tryParseValue<T>(it->second, parameterName);
+
+		if (parameterValue && !allowedValues.empty() && std::ranges::find(allowedValues, *parameterValue) == allowedValues.end())
+			return std::unexpected(FastCGIError::RequestError::notAllowedValue(
+				parameterName, it->second, FastCGIError::RequestError::allowedValuesList(allowedValues)
+			));
+
+		return parameterValue;
+	}
 
 	template <typename T>
 	static std::optional<T> getOptMapParameter(
-		const std::unordered_map<std::string, std::string> &mapParameters, const std::string& parameterName,
+		const ParametersMap &mapParameters, const std::string_view parameterName,
 		std::span<const T> allowedValues = {})
 	{
 		T parameterValue;
@@ -190,22 +552,15 @@ private:
 
 		if constexpr (std::is_same_v<T, std::string>)
 		{
-			// 2021-01-07: Remark: we have FIRST to replace + in space and then apply
-			// unescape
-			//	That  because if we have really a + char (%2B into the std::string), and we
-			// do the replace 	after unescape, this char will be changed to space and we
-			// do not want it
-			std::string plus = "+";
-			std::string plusDecoded = " ";
-			const std::string firstDecoding = StringUtils::replaceAll(StringUtils::getValue<T>(it->second), plus, plusDecoded);
-
-			parameterValue = unescape(firstDecoding);
+			// '+' diventa spazio nello stesso passaggio della decodifica dei %XX,
+			// per cui un '+' reale (%2B) resta '+'
+			parameterValue = unescape(it->second, true);
 		}
 		else
 		{
 			try
 			{
-				parameterValue = StringUtils::getValue<T>(it->second);
+				parameterValue = StringUtils::getValue<T>(std::string(it->second));
 			}
 			catch (const std::exception &e)
 			{
@@ -234,7 +589,7 @@ private:
 	}
 
 	static std::string getMapParameter(
-		const std::unordered_map<std::string, std::string> &mapParameters, const std::string &parameterName, const char *defaultParameter,
+		const ParametersMap &mapParameters, const std::string_view parameterName, const char *defaultParameter,
 		const bool mandatory = false, std::span<const std::string> allowedValues = {}, bool *isParamPresent = nullptr
 	)
 	{
@@ -245,7 +600,7 @@ private:
 	template <typename T>
 	requires (!std::is_same_v<T, const char*>)
 	static T getMapParameter(
-		const std::unordered_map<std::string, std::string> &mapParameters, const std::string& parameterName, T defaultParameter,
+		const ParametersMap &mapParameters, const std::string_view parameterName, T defaultParameter,
 		const bool mandatory = false, std::span<const T> allowedValues = {}, bool *isParamPresent = nullptr
 	)
 	{
@@ -258,22 +613,15 @@ private:
 				*isParamPresent = true;
 			if constexpr (std::is_same_v<T, std::string>)
 			{
-				// 2021-01-07: Remark: we have FIRST to replace + in space and then apply
-				// unescape
-				//	That  because if we have really a + char (%2B into the std::string), and we
-				// do the replace 	after unescape, this char will be changed to space and we
-				// do not want it
-				std::string plus = "+";
-				std::string plusDecoded = " ";
-				const std::string firstDecoding = StringUtils::replaceAll(StringUtils::getValue<T>(it->second), plus, plusDecoded);
-
-				parameterValue = unescape(firstDecoding);
+				// '+' diventa spazio nello stesso passaggio della decodifica dei %XX,
+				// per cui un '+' reale (%2B) resta '+'
+				parameterValue = unescape(it->second, true);
 			}
 			else
 			{
 				try
 				{
-					parameterValue = StringUtils::getValue<T>(it->second);
+					parameterValue = StringUtils::getValue<T>(std::string(it->second));
 				}
 				catch (const std::exception &e)
 				{
@@ -313,48 +661,15 @@ private:
 		return parameterValue;
 	}
 
-	template <typename T, template <class...> class C>
-	requires (std::is_same_v<C<T>, std::vector<T>> || std::is_same_v<C<T>, std::set<T>>)
-	static C<T> getMapParameter(
-		const std::unordered_map<std::string, std::string> &mapParameters, const std::string& parameterName, char delim, C<T> defaultParameter, const bool mandatory = false,
-		bool *isParamPresent = nullptr
+	// aggiunge a values gli elementi del parametro (vedi splitList), false se il parametro non è presente
+	template <typename C>
+	static bool getMapParameterList(
+		const ParametersMap &mapParameters, const std::string_view parameterName, const char delim, C &values, const bool mandatory = false
 	)
 	{
-		C<T> parameterValue;
-
-		auto it = mapParameters.find(parameterName);
-		if (it != mapParameters.end() && !it->second.empty())
-		{
-			if (isParamPresent != nullptr)
-				*isParamPresent = true;
-			std::stringstream ss(it->second);
-			std::string token;
-			while (getline(ss, token, delim))
-			{
-				if (!token.empty())
-				{
-					try
-					{
-						if constexpr (std::is_same_v<C<T>, std::vector<T>>)
-							parameterValue.push_back(StringUtils::getValue<T>(token));
-						else
-							parameterValue.insert(StringUtils::getValue<T>(token));
-					}
-					catch (const std::exception &e)
-					{
-						const std::string errorMessage = std::format("StringUtils::getValue failed"
-							", parameterName: {}"
-							", exception: {}", parameterName, e.what());
-						LOG_ERROR(errorMessage);
-						throw FastCGIError::HTTPError(400, errorMessage);
-					}
-				}
-			}
-		}
-		else
+		const auto it = mapParameters.find(parameterName);
+		if (it == mapParameters.end() || it->second.empty())
 		{
-			if (isParamPresent != nullptr)
-				*isParamPresent = false;
 			if (mandatory)
 			{
 				const std::string errorMessage = std::format("Missing mandatory query parameter: {}", parameterName);
@@ -362,9 +677,29 @@ private:
 				throw FastCGIError::HTTPError(400, errorMessage);
 			}
 
-			parameterValue = std::move(defaultParameter);
+			return false;
 		}
 
+		splitList(it->second, delim, values, parameterName);
+
+		return true;
+	}
+
+	template <typename T, template <class...> class C>
+	requires (std::is_same_v<C<T>, std::vector<T>> || std::is_same_v<C<T>, std::set<T>>)
+	static C<T> getMapParameter(
+		const ParametersMap &mapParameters, const std::string_view parameterName, char delim, C<T> defaultParameter, const bool mandatory = false,
+		bool *isParamPresent = nullptr
+	)
+	{
+		C<T> parameterValue;
+
+		const bool paramPresent = getMapParameterList(mapParameters, parameterName, delim, parameterValue, mandatory);
+		if (isParamPresent != nullptr)
+			*isParamPresent = paramPresent;
+		if (!paramPresent)
+			parameterValue = std::move(defaultParameter);
+
 		return parameterValue;
 	}
 };
@@ -0,0 +1,129 @@
+#include "FCGIResponseCache.h"
+#include "FCGIXXHash.h"
+#include "ThreadLogger.h"
+#include <algorithm>
+#include <format>
+
+using namespace std;
+
+FCGIResponseCache::FCGIResponseCache(const size_t maxEntries, const size_t maxBodySize)
+	: _maxEntries(maxEntries), _maxShardEntries(max<size_t>(1, maxEntries / shardsNumber)), _maxBodySize(maxBodySize)
+{
+}
+
+shared_ptr<FCGIResponseCache> FCGIResponseCache::processCache(const size_t maxEntries, const size_t maxBodySize)
+{
+	lock_guard locker(_processCacheMutex);
+
+	if (!_processCache)
+	{
+		_processCache = make_shared<FCGIResponseCache>(maxEntries, maxBodySize);
+
+		LOG_INFO(
+			"FCGIResponseCache created"
+			", maxEntries: {}"
+			", maxBodySize: {}",
+			maxEntries, maxBodySize
+		);
+	}
+	else if (_processCache->_maxEntries != maxEntries || _processCache->_maxBodySize != maxBodySize)
+		LOG_WARN(
+			"FCGIResponseCache already created with a different configuration, it is used as is"
+			", maxEntries: {}"
+			", maxBodySize: {}"
+			", requested maxEntries: {}"
+			", requested maxBodySize: {}",
+			_processCache->_maxEntries, _processCache->_maxBodySize, maxEntries, maxBodySize
+		);
+
+	return _processCache;
+}
+
+size_t FCGIResponseCache::shardIndex(const string_view key)
+{
+	// i bit alti dell'hash per lo shard, i bassi restano per i bucket della mappa dello shard
+	return (KeyHash{}(key) >> ((sizeof(size_t) - 1) * 8)) % shardsNumber;
+}
+
+shared_ptr<const FCGIResponseCache::Response> FCGIResponseCache::find(const string_view key) const
+{
+	const Shard &keyShard = _shards[shardIndex(key)];
+
+	shared_lock locker(keyShard.mutex);
+
+	const auto it = keyShard.entries.find(key);
+	if (it == keyShard.entries.end() || it->second.expiration <= chrono::steady_clock::now())
+		return nullptr;
+
+	return it->second.response;
+}
+
+void FCGIResponseCache::insert(
+	const string_view key, shared_ptr<const Response> response, const chrono::seconds ttl, vector<string> tags, const uint64_t generation
+)
+{
+	Shard &keyShard = _shards[shardIndex(key)];
+	const auto now = chrono::steady_clock::now();
+
+	lock_guard locker(keyShard.mutex);
+
+	// invalidate incrementa _generation prima di svuotare gli shard: sotto il lock dello shard o l'inserimento vede
+	// il nuovo valore, o la entry inserita viene poi eliminata dall'invalidate
+	if (_generation.load(memory_order_acquire) != generation)
+	{
+		LOG_DEBUG(
+			"FCGIResponseCache insert skipped, invalidated while the response was produced"
+			", key: {}",
+			key
+		);
+
+		return;
+	}
+
+	if (keyShard.entries.size() >= _maxShardEntries && !keyShard.entries.contains(key))
+	{
+		// shard pieno: prima le entry scadute, altrimenti quella più vicina alla scadenza
+		erase_if(keyShard.entries, [now](const auto &entry) { return entry.second.expiration <= now; });
+		if (keyShard.entries.size() >= _maxShardEntries)
+			keyShard.entries.erase(ranges::min_element(keyShard.entries, {}, [](const auto &entry) { return entry.second.expiration; }));
+	}
+
+	keyShard.entries.insert_or_assign(string(key), Entry{std::move(response), now + ttl, std::move(tags)});
+}
+
+size_t FCGIResponseCache::invalidate(const string_view tag)
+{
+	_generation.fetch_add(1, memory_order_acq_rel);
+
+	size_t invalidated = 0;
+	for (Shard &keyShard : _shards)
+	{
+		lock_guard locker(keyShard.mutex);
+		invalidated += erase_if(keyShard.entries, [tag](const auto &entry) { return ranges::find(entry.second.tags, tag) != entry.second.tags.end(); });
+	}
+
+	LOG_INFO(
+		"FCGIResponseCache invalidate"
+		", tag: {}"
+		", invalidated: {}",
+		tag, invalidated
+	);
+
+	return invalidated;
+}
+
+void FCGIResponseCache::clear()
+{
+	_generation.fetch_add(1, memory_order_acq_rel);
+
+	for (Shard &keyShard : _shards)
+	{
+		lock_guard locker(keyShard.mutex);
+		keyShard.entries.clear();
+	}
+}
+
+string FCGIResponseCache::etag(const string_view body)
+{
+	return std::format("{:016x}", FCGIXXHash::hash64(body));
+}
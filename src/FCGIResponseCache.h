@@ -0,0 +1,126 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIResponseCompressor.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Cache (di processo) delle risposte GET delle route con cacheTTL (FCGIRouter::RouteOptions):
+// una richiesta la cui risposta è in cache viene servita prima di manageRequestAndResponse, senza eseguire l'handler.
+// La chiave (vedi FastCGIAPI) comprende path normalizzato, parametri della query string scelti dalla route
+// e utente autenticato. Ogni risposta ha ETag (hash del body) e Last-Modified: le richieste condizionali
+// (If-None-Match, If-Modified-Since) soddisfatte vengono risposte con 304.
+// Le varianti compresse (Content-Encoding) vengono aggiunte alla risposta in cache alla prima richiesta che le accetta.
+// Invalidazione per scadenza (ttl della route) o per tag (invalidate).
+// Shard con shared_mutex come FCGIAuthorizationCache: le ricerche prendono il lock condiviso del solo shard
+class FCGIResponseCache final
+{
+public:
+	// risposta in cache, condivisa in sola lettura tra richieste e thread
+	struct Response
+	{
+		// riga di header Content-Type come inviata da sendSuccess (vuota per body vuoto)
+		std::string contentType;
+		// hash del body senza virgolette (ETag: "etag", W/"etag" per i body compressi)
+		std::string etag;
+		// inserimento in cache (Last-Modified, per If-Modified-Since)
+		std::chrono::system_clock::time_point lastModified;
+		std::string body;
+		// body compresso per encoding (indice FCGIResponseCompressor::Encoding), nullptr se non ancora calcolato
+		mutable std::array<std::atomic<std::shared_ptr<const std::string>>, 4> encodedBodies;
+	};
+
+	FCGIResponseCache(size_t maxEntries, size_t maxBodySize);
+	~FCGIResponseCache() = default;
+
+	FCGIResponseCache(const FCGIResponseCache &) = delete;
+	FCGIResponseCache &operator=(const FCGIResponseCache &) = delete;
+
+	// ritorna la cache del processo, creandola alla prima chiamata: le chiamate successive
+	// con una configurazione diversa ricevono la stessa cache (con un warning)
+	static std::shared_ptr<FCGIResponseCache> processCache(size_t maxEntries, size_t maxBodySize);
+
+	// nullptr se la risposta non è in cache o è scaduta
+	[[nodiscard]] std::shared_ptr<const Response> find(std::string_view key) const;
+	// generation: generation() letto prima di produrre la risposta. Se nel frattempo c'è stata una invalidate/clear
+	// la risposta può essere già superata e non viene inserita
+	void insert(std::string_view key, std::shared_ptr<const Response> response, std::chrono::seconds ttl, std::vector<std::string> tags,
+		uint64_t generation);
+
+	// elimina le risposte con il tag, ritorna il numero di risposte eliminate
+	size_t invalidate(std::string_view tag);
+	void clear();
+
+	// incrementato da ogni invalidate/clear
+	[[nodiscard]] uint64_t generation() const { return _generation.load(std::memory_order_acquire); }
+
+	// body più grandi non vengono messi in cache
+	[[nodiscard]] size_t maxBodySize() const { return _maxBodySize; }
+
+	// XXH64 del body in esadecimale
+	static std::string etag(std::string_view body);
+
+private:
+	struct KeyHash
+	{
+		using is_transparent = void;
+		size_t operator()(const std::string_view key) const { return std::hash<std::string_view>{}(key); }
+	};
+
+	struct Entry
+	{
+		std::shared_ptr<const Response> response;
+		std::chrono::steady_clock::time_point expiration;
+		std::vector<std::string> tags;
+	};
+
+	// allineato alla cache line: i lock di shard diversi non condividono la linea
+	struct alignas(64) Shard
+	{
+		mutable std::shared_mutex mutex;
+		std::unordered_map<std::string, Entry, KeyHash, std::equal_to<>> entries;
+	};
+
+	static constexpr size_t shardsNumber = 16;
+
+	// come richiesto a processCache, per segnalare configurazioni diverse
+	size_t _maxEntries;
+	size_t _maxShardEntries;
+	size_t _maxBodySize;
+	std::atomic<uint64_t> _generation{};
+	std::array<Shard, shardsNumber> _shards;
+
+	static inline std::mutex _processCacheMutex;
+	static inline std::shared_ptr<FCGIResponseCache> _processCache;
+
+	static size_t shardIndex(std::string_view key);
+};
@@ -0,0 +1,311 @@
+#include "FCGIResponseCompressor.h"
+#include "FCGIZstdDictionary.h"
+#include "ThreadLogger.h"
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <format>
+#include <stdexcept>
+#include <zlib.h>
+#ifdef FASTCGIAPI_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace
+{
+// crescita dell'output per ogni chiamata a deflate/ZSTD_compressStream2
+constexpr size_t outputChunkSize = 16 * 1024;
+
+bool equalsIgnoreCase(const string_view first, const string_view second)
+{
+	return ranges::equal(first, second, [](const char a, const char b) { return tolower(static_cast<unsigned char>(a)) == tolower(static_cast<unsigned char>(b)); });
+}
+
+string_view trimmed(string_view text)
+{
+	while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+		text.remove_prefix(1);
+	while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+		text.remove_suffix(1);
+	return text;
+}
+} // namespace
+
+FCGIResponseCompressor::FCGIResponseCompressor() = default;
+
+FCGIResponseCompressor::~FCGIResponseCompressor()
+{
+	if (_gzipStream)
+		deflateEnd(_gzipStream.get());
+	if (_deflateStream)
+		deflateEnd(_deflateStream.get());
+#ifdef FASTCGIAPI_ZSTD
+	ZSTD_freeCCtx(static_cast<ZSTD_CCtx *>(_zstdContext));
+#endif
+}
+
+bool FCGIResponseCompressor::supported(const Encoding encoding)
+{
+#ifdef FASTCGIAPI_ZSTD
+	return encoding != Encoding::Identity;
+#else
+	return encoding == Encoding::Gzip || encoding == Encoding::Deflate;
+#endif
+}
+
+string_view FCGIResponseCompressor::name(const Encoding encoding)
+{
+	switch (encoding)
+	{
+	case Encoding::Gzip:
+		return "gzip";
+	case Encoding::Deflate:
+		return "deflate";
+	case Encoding::Zstd:
+		return "zstd";
+	default:
+		return "identity";
+	}
+}
+
+optional<FCGIResponseCompressor::Encoding> FCGIResponseCompressor::encoding(const string_view name)
+{
+	if (equalsIgnoreCase(name, "gzip") || equalsIgnoreCase(name, "x-gzip"))
+		return Encoding::Gzip;
+	if (equalsIgnoreCase(name, "deflate"))
+		return Encoding::Deflate;
+	if (equalsIgnoreCase(name, "zstd"))
+		return Encoding::Zstd;
+	if (equalsIgnoreCase(name, "identity"))
+		return Encoding::Identity;
+	return nullopt;
+}
+
+int FCGIResponseCompressor::defaultLevel(const Encoding encoding)
+{
+	// zstd 3 comprime come gzip 6 con una frazione della CPU
+	return encoding == Encoding::Zstd ? 3 : 6;
+}
+
+FCGIResponseCompressor::Encoding FCGIResponseCompressor::negotiate(string_view acceptEncoding, const uint32_t enabledEncodings)
+{
+	// q di ogni encoding indicato (-1: non indicato) e di "*" (gli encoding non indicati)
+	array<float, 4> qualities{-1, -1, -1, -1};
+	float wildcardQuality = -1;
+
+	while (!acceptEncoding.empty())
+	{
+		const size_t commaIndex = acceptEncoding.find(',');
+		const string_view item = acceptEncoding.substr(0, commaIndex);
+		acceptEncoding = commaIndex == string_view::npos ? string_view() : acceptEncoding.substr(commaIndex + 1);
+
+		const size_t semicolonIndex = item.find(';');
+		const string_view codingName = trimmed(item.substr(0, semicolonIndex));
+		if (codingName.empty())
+			continue;
+
+		float quality = 1;
+		if (semicolonIndex != string_view::npos)
+		{
+			const string_view parameter = trimmed(item.substr(semicolonIndex + 1));
+			if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+			{
+				if (const auto [ptr, ec] = from_chars(parameter.data() + 2, parameter.data() + parameter.size(), quality); ec != errc())
+					quality = 0;
+			}
+		}
+
+		if (codingName == "*")
+			wildcardQuality = quality;
+		else if (const optional<Encoding> codingEncoding = encoding(codingName))
+			qualities[static_cast<size_t>(*codingEncoding)] = quality;
+	}
+
+	Encoding bestEncoding = Encoding::Identity;
+	float bestQuality = 0;
+	for (const Encoding candidate : {Encoding::Zstd, Encoding::Gzip, Encoding::Deflate})
+	{
+		if ((enabledEncodings & encodingBit(candidate)) == 0 || !supported(candidate))
+			continue;
+
+		float quality = qualities[static_cast<size_t>(candidate)];
+		if (quality < 0)
+			quality = wildcardQuality < 0 ? 0 : wildcardQuality;
+		// strettamente maggiore: a parità di q vince l'ordine di preferenza
+		if (quality > bestQuality)
+		{
+			bestEncoding = candidate;
+			bestQuality = quality;
+		}
+	}
+
+	return bestEncoding;
+}
+
+void FCGIResponseCompressor::begin(const Encoding encoding, int level, [[maybe_unused]] const FCGIZstdDictionary *dictionary)
+{
+	if (!supported(encoding))
+	{
+		string errorMessage = std::format(
+			"Response encoding not supported"
+			", encoding: {}",
+			name(encoding)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	if (level < 0)
+		level = defaultLevel(encoding);
+	_encoding = encoding;
+
+	if (encoding == Encoding::Gzip || encoding == Encoding::Deflate)
+		zlibStream(encoding, level);
+#ifdef FASTCGIAPI_ZSTD
+	else
+	{
+		if (_zstdContext == nullptr)
+			_zstdContext = ZSTD_createCCtx();
+		auto *zstdContext = static_cast<ZSTD_CCtx *>(_zstdContext);
+		ZSTD_CCtx_reset(zstdContext, ZSTD_reset_session_only);
+		// il reset della sessione mantiene il dizionario: va sempre impostato (nullptr lo rimuove)
+		ZSTD_CCtx_refCDict(zstdContext, dictionary == nullptr ? nullptr : static_cast<const ZSTD_CDict *>(dictionary->compressionDictionary()));
+		if (dictionary == nullptr)
+			ZSTD_CCtx_setParameter(zstdContext, ZSTD_c_compressionLevel, level);
+	}
+#endif
+}
+
+void FCGIResponseCompressor::compress(const string_view in, string &out, const Mode mode)
+{
+	if (_encoding == Encoding::Zstd)
+		compressZstd(in, out, mode);
+	else
+		compressZlib(in, out, mode);
+}
+
+string_view FCGIResponseCompressor::compress(const Encoding encoding, const int level, const string_view in, const FCGIZstdDictionary *dictionary)
+{
+	begin(encoding, level, dictionary);
+
+	_output.clear();
+	if (encoding == Encoding::Zstd)
+	{
+#ifdef FASTCGIAPI_ZSTD
+		// dimensione nota: viene scritta nell'header del frame
+		ZSTD_CCtx_setPledgedSrcSize(static_cast<ZSTD_CCtx *>(_zstdContext), in.size());
+		_output.reserve(ZSTD_compressBound(in.size()));
+#endif
+	}
+	else
+		_output.reserve(deflateBound(encoding == Encoding::Gzip ? _gzipStream.get() : _deflateStream.get(), in.size()));
+	compress(in, _output, Mode::Finish);
+
+	return _output;
+}
+
+z_stream_s &FCGIResponseCompressor::zlibStream(const Encoding encoding, const int level)
+{
+	const bool gzip = encoding == Encoding::Gzip;
+	unique_ptr<z_stream_s> &stream = gzip ? _gzipStream : _deflateStream;
+	int &streamLevel = gzip ? _gzipLevel : _deflateLevel;
+
+	if (!stream)
+	{
+		stream = make_unique<z_stream_s>();
+		// windowBits 15 (+16: header e trailer gzip invece di zlib)
+		if (const int result = deflateInit2(stream.get(), level, Z_DEFLATED, 15 + (gzip ? 16 : 0), 8, Z_DEFAULT_STRATEGY); result != Z_OK)
+		{
+			stream.reset();
+
+			string errorMessage = std::format(
+				"deflateInit2 failed"
+				", encoding: {}"
+				", level: {}"
+				", result: {}",
+				name(encoding), level, result
+			);
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+		streamLevel = level;
+	}
+	else
+	{
+		deflateReset(stream.get());
+		// dopo il reset non ci sono dati in sospeso: il cambio di livello non produce output
+		if (level != streamLevel)
+		{
+			deflateParams(stream.get(), level, Z_DEFAULT_STRATEGY);
+			streamLevel = level;
+		}
+	}
+
+	return *stream;
+}
+
+void FCGIResponseCompressor::compressZlib(const string_view in, string &out, const Mode mode)
+{
+	z_stream_s &stream = _encoding == Encoding::Gzip ? *_gzipStream : *_deflateStream;
+	const int flush = mode == Mode::Continue ? Z_NO_FLUSH : (mode == Mode::Flush ? Z_SYNC_FLUSH : Z_FINISH);
+
+	stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(in.data()));
+	stream.avail_in = static_cast<uInt>(in.size());
+	do
+	{
+		const size_t outputStart = out.size();
+		out.resize(outputStart + outputChunkSize);
+		stream.next_out = reinterpret_cast<Bytef *>(out.data() + outputStart);
+		stream.avail_out = outputChunkSize;
+
+		const int result = deflate(&stream, flush);
+		out.resize(outputStart + outputChunkSize - stream.avail_out);
+		if (result == Z_STREAM_ERROR)
+		{
+			string errorMessage = std::format(
+				"deflate failed"
+				", encoding: {}",
+				name(_encoding)
+			);
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+	} while (stream.avail_out == 0);
+}
+
+void FCGIResponseCompressor::compressZstd([[maybe_unused]] const string_view in, [[maybe_unused]] string &out, [[maybe_unused]] const Mode mode)
+{
+#ifdef FASTCGIAPI_ZSTD
+	auto *zstdContext = static_cast<ZSTD_CCtx *>(_zstdContext);
+	const ZSTD_EndDirective endDirective = mode == Mode::Continue ? ZSTD_e_continue : (mode == Mode::Flush ? ZSTD_e_flush : ZSTD_e_end);
+
+	ZSTD_inBuffer input{in.data(), in.size(), 0};
+	size_t remaining;
+	do
+	{
+		const size_t outputStart = out.size();
+		out.resize(outputStart + outputChunkSize);
+		ZSTD_outBuffer output{out.data() + outputStart, outputChunkSize, 0};
+
+		remaining = ZSTD_compressStream2(zstdContext, &output, &input, endDirective);
+		out.resize(outputStart + output.pos);
+		if (ZSTD_isError(remaining))
+		{
+			string errorMessage = std::format(
+				"ZSTD_compressStream2 failed"
+				", error: {}",
+				ZSTD_getErrorName(remaining)
+			);
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+		// continue: fino al consumo dell'input, flush/end: fino allo svuotamento del contesto
+	} while (endDirective == ZSTD_e_continue ? input.pos < input.size : remaining != 0);
+#endif
+}
@@ -0,0 +1,106 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+struct z_stream_s;
+class FCGIZstdDictionary;
+
+// Compressione del body della risposta (Content-Encoding) negoziata con Accept-Encoding: gzip, deflate e,
+// se la libreria è compilata con FASTCGIAPI_ZSTD, zstd.
+// I contesti di compressione (zlib e zstd) vengono creati al primo uso e riutilizzati dalle compressioni
+// successive: FastCGIAPI ne tiene un pool per thread. La compressione può essere fatta in un colpo solo
+// (compress) oppure a pezzi (begin + compress con Mode), es. insieme a FCGIResponseStream
+class FCGIResponseCompressor final
+{
+public:
+	enum class Encoding : uint8_t
+	{
+		Identity,
+		Gzip,
+		Deflate,
+		Zstd
+	};
+
+	enum class Mode : uint8_t
+	{
+		// l'output può restare nel contesto in attesa di altro input
+		Continue,
+		// tutto l'input ricevuto diventa output decodificabile (es. prima di un flush dello stream)
+		Flush,
+		// fine del body
+		Finish
+	};
+
+	// bitmask degli encoding abilitati (es. api->responseCompression->encodings)
+	static constexpr uint32_t encodingBit(const Encoding encoding) { return 1U << static_cast<uint32_t>(encoding); }
+	// Gzip | Deflate | Zstd
+	static constexpr uint32_t allEncodings = 0b1110;
+
+	FCGIResponseCompressor();
+	~FCGIResponseCompressor();
+
+	FCGIResponseCompressor(const FCGIResponseCompressor &) = delete;
+	FCGIResponseCompressor &operator=(const FCGIResponseCompressor &) = delete;
+
+	// false per Zstd se la libreria è compilata senza FASTCGIAPI_ZSTD
+	static bool supported(Encoding encoding);
+	// valore di Content-Encoding
+	static std::string_view name(Encoding encoding);
+	static std::optional<Encoding> encoding(std::string_view name);
+	static int defaultLevel(Encoding encoding);
+
+	// encoding da usare per la risposta: quello con il q più alto in acceptEncoding tra gli abilitati
+	// (a parità di q: zstd, gzip, deflate), Identity se nessuno è accettato
+	static Encoding negotiate(std::string_view acceptEncoding, uint32_t enabledEncodings);
+
+	// level -1: defaultLevel(encoding). dictionary (solo Zstd): il livello è quello del dizionario
+	void begin(Encoding encoding, int level = -1, const FCGIZstdDictionary *dictionary = nullptr);
+	// comprime in e accoda l'output a out
+	void compress(std::string_view in, std::string &out, Mode mode);
+
+	// compressione completa di in, la string_view ritornata punta in un buffer del compressore
+	// valido fino alla compressione successiva
+	std::string_view compress(Encoding encoding, int level, std::string_view in, const FCGIZstdDictionary *dictionary = nullptr);
+
+private:
+	Encoding _encoding{Encoding::Identity};
+
+	// gzip e deflate (formato zlib) richiedono due inizializzazioni diverse (windowBits)
+	std::unique_ptr<z_stream_s> _gzipStream;
+	std::unique_ptr<z_stream_s> _deflateStream;
+	int _gzipLevel{};
+	int _deflateLevel{};
+	// ZSTD_CCtx, void per non esporre zstd.h
+	void *_zstdContext{};
+
+	std::string _output;
+
+	z_stream_s &zlibStream(Encoding encoding, int level);
+	void compressZlib(std::string_view in, std::string &out, Mode mode);
+	void compressZstd(std::string_view in, std::string &out, Mode mode);
+};
@@ -0,0 +1,193 @@
+#include "FCGIResponseStream.h"
+#include "FCGIConnection.h"
+#include "FastCGIAPI.h"
+#include <exception>
+#include <format>
+
+using namespace std;
+
+FCGIResponseStream::FCGIResponseStream(FastCGIAPI &api, FCGX_Request &request, const int htmlResponseCode, const string_view contentType)
+	: _api(api), _request(request), _htmlResponseCode(htmlResponseCode), _headers(api.requestArena()), _uncaughtExceptions(std::uncaught_exceptions()),
+	  _requestData(api._currentRequestData),
+	  _encoding(_requestData != nullptr ? _requestData->responseEncoding : FCGIResponseCompressor::Encoding::Identity),
+	  _compressionLevel(_requestData != nullptr ? _requestData->responseCompressionLevel : -1)
+{
+	if (!contentType.empty())
+		header("Content-Type", contentType);
+}
+
+FCGIResponseStream::~FCGIResponseStream()
+{
+	// eccezione prima della prima write/flush: niente status 200, la richiesta resta aperta per la risposta di errore
+	if (!_finished && !_headersSent && std::uncaught_exceptions() > _uncaughtExceptions)
+	{
+		_finished = true;
+
+		LOG_DEBUG("Response stream not started, exception in progress: the request is left to the error response");
+
+		return;
+	}
+
+	try
+	{
+		finish();
+	}
+	catch (exception &e)
+	{
+		LOG_ERROR(
+			"FCGIResponseStream finish failed"
+			", exception: {}",
+			e.what()
+		);
+	}
+}
+
+FCGIResponseStream &FCGIResponseStream::status(const int htmlResponseCode)
+{
+	if (_headersSent)
+		LOG_ERROR(
+			"Response headers already sent, status ignored"
+			", htmlResponseCode: {}",
+			htmlResponseCode
+		);
+	else
+		_htmlResponseCode = htmlResponseCode;
+
+	return *this;
+}
+
+FCGIResponseStream &FCGIResponseStream::header(const string_view name, const string_view value)
+{
+	if (_headersSent)
+		LOG_ERROR(
+			"Response headers already sent, header ignored"
+			", name: {}",
+			name
+		);
+	else
+		std::format_to(back_inserter(_headers), "{}: {}\r\n", name, value);
+
+	return *this;
+}
+
+FCGIResponseStream &FCGIResponseStream::contentLength(const uint64_t contentLength)
+{
+	// Content-Length è la lunghezza del body inviato: con la compressione non sarebbe nota
+	if (!_headersSent)
+		_encoding = FCGIResponseCompressor::Encoding::Identity;
+
+	return header("Content-Length", std::to_string(contentLength));
+}
+
+bool FCGIResponseStream::write(const string_view chunk)
+{
+	if (!writable())
+		return false;
+
+	if (!_headersSent && !sendHeaders())
+		return false;
+
+	if (chunk.empty())
+		return true;
+
+	if (_compressor ? !putCompressed(chunk, FCGIResponseCompressor::Mode::Continue) : FCGIConnection::putStr(_request, chunk) < 0)
+		return false;
+	_bodySize += chunk.size();
+
+	return true;
+}
+
+bool FCGIResponseStream::flush()
+{
+	if (!writable())
+		return false;
+
+	if (!_headersSent && !sendHeaders())
+		return false;
+
+	if (_compressor && !putCompressed({}, FCGIResponseCompressor::Mode::Flush))
+		return false;
+
+	return FCGX_FFlush(_request.out) == 0;
+}
+
+void FCGIResponseStream::finish()
+{
+	if (_finished)
+		return;
+	_finished = true;
+
+	// risposta già chiusa da altri (es. sendError)
+	if (_api._fcgxFinishDone)
+	{
+		releaseCompressor();
+		return;
+	}
+
+	if (!_headersSent)
+		sendHeaders();
+	if (_compressor)
+	{
+		putCompressed({}, FCGIResponseCompressor::Mode::Finish);
+		releaseCompressor();
+	}
+
+	LOG_DEBUG(
+		"Response stream finished"
+		", htmlResponseCode: {}"
+		", bodySize: {}",
+		_htmlResponseCode, _bodySize
+	);
+
+	FastCGIAPI::finishRequest(_request);
+	_api._fcgxFinishDone = true;
+}
+
+bool FCGIResponseStream::writable()
+{
+	if (_finished || _api._fcgxFinishDone)
+	{
+		LOG_ERROR(
+			"response was already done"
+			", bodySize: {}",
+			_bodySize
+		);
+
+		return false;
+	}
+
+	return _request.out->isClosed == 0;
+}
+
+bool FCGIResponseStream::sendHeaders()
+{
+	_headersSent = true;
+
+	if (_requestData != nullptr)
+		_api.formatResponseEncodingHeaders(back_inserter(_headers), *_requestData, _encoding != FCGIResponseCompressor::Encoding::Identity);
+	if (_encoding != FCGIResponseCompressor::Encoding::Identity)
+	{
+		_compressor = _api.acquireResponseCompressor();
+		_compressor->begin(_encoding, _compressionLevel, _api.responseZstdDictionary(*_requestData));
+	}
+
+	const string_view status = FastCGIError::HTTPError::statusLine(static_cast<int16_t>(_htmlResponseCode));
+	FCGX_PutStr(status.data(), static_cast<int>(status.size()), _request.out);
+	FCGX_PutStr(_headers.data(), static_cast<int>(_headers.size()), _request.out);
+
+	return FCGX_PutStr("\r\n", 2, _request.out) == 2;
+}
+
+bool FCGIResponseStream::putCompressed(const string_view chunk, const FCGIResponseCompressor::Mode mode)
+{
+	_compressedChunk.clear();
+	_compressor->compress(chunk, _compressedChunk, mode);
+
+	return _compressedChunk.empty() || FCGIConnection::putStr(_request, _compressedChunk) >= 0;
+}
+
+void FCGIResponseStream::releaseCompressor()
+{
+	if (_compressor)
+		_api.releaseResponseCompressor(std::move(_compressor));
+}
@@ -0,0 +1,99 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIResponseCompressor.h"
+#include <cstdint>
+#include <fcgiapp.h>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+class FastCGIAPI;
+class FCGIRequestData;
+
+// Risposta scritta a pezzi (es. export o liste grandi prodotte incrementalmente), ottenuta con
+// FastCGIAPI::responseStream:
+//
+//	auto stream = responseStream(request, 200, "text/csv");
+//	stream.header("Content-Disposition", "attachment; filename=export.csv");
+//	for (...)
+//		if (!stream.write(row))
+//			break; // client disconnesso
+//	stream.finish();
+//
+// Status e header vengono inviati con la prima write/flush, dopo non sono più modificabili.
+// Senza contentLength il body viene inviato senza Content-Length (nginx lo inoltra al client in chunked).
+// write accumula nel buffer dello stream FastCGI (i chunk grandi vengono inviati senza copie),
+// flush invia subito quanto scritto. Con un Content-Encoding negoziato (Accept-Encoding) il body viene
+// compresso a pezzi, salvo con contentLength (la lunghezza dichiarata è quella non compressa). finish chiude la richiesta al posto di sendSuccess;
+// se non viene chiamato lo fa il distruttore. In caso di eccezione: se gli header non sono ancora stati inviati
+// il distruttore non chiude la richiesta (la risposta di errore resta a chi gestisce l'eccezione), altrimenti
+// la chiude (la risposta già iniziata non può più diventare una risposta di errore e risulta troncata)
+class FCGIResponseStream final
+{
+public:
+	FCGIResponseStream(FastCGIAPI &api, FCGX_Request &request, int htmlResponseCode, std::string_view contentType);
+	~FCGIResponseStream();
+
+	FCGIResponseStream(const FCGIResponseStream &) = delete;
+	FCGIResponseStream &operator=(const FCGIResponseStream &) = delete;
+
+	// ignorati (LOG_ERROR) dopo l'invio degli header
+	FCGIResponseStream &status(int htmlResponseCode);
+	FCGIResponseStream &header(std::string_view name, std::string_view value);
+	FCGIResponseStream &contentLength(uint64_t contentLength);
+
+	// false se la risposta non può più essere scritta (client disconnesso, richiesta già chiusa)
+	bool write(std::string_view chunk);
+	bool flush();
+	void finish();
+
+	[[nodiscard]] bool headersSent() const { return _headersSent; }
+	[[nodiscard]] uint64_t bodySize() const { return _bodySize; }
+
+private:
+	FastCGIAPI &_api;
+	FCGX_Request &_request;
+	int _htmlResponseCode;
+	// header oltre a Status, nell'arena della richiesta
+	std::pmr::string _headers;
+	bool _headersSent{};
+	bool _finished{};
+	uint64_t _bodySize{};
+	// std::uncaught_exceptions() alla costruzione: il distruttore riconosce lo stack unwinding di un'eccezione
+	int _uncaughtExceptions;
+
+	// richiesta della risposta (encoding negoziato e dizionario zstd), nullptr fuori da una richiesta
+	const FCGIRequestData *_requestData;
+	// encoding negoziato per la richiesta, Identity se il body non viene compresso
+	FCGIResponseCompressor::Encoding _encoding;
+	int32_t _compressionLevel;
+	std::unique_ptr<FCGIResponseCompressor> _compressor;
+	std::string _compressedChunk;
+
+	bool writable();
+	bool putCompressed(std::string_view chunk, FCGIResponseCompressor::Mode mode);
+	void releaseCompressor();
+	bool sendHeaders();
+};
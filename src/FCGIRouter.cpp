@@ -0,0 +1,228 @@
+#include "FCGIRouter.h"
+#include "ThreadLogger.h"
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+// primo segmento di path e resto dopo il '/'
+pair<string_view, string_view> splitSegment(const string_view path)
+{
+	const size_t slashIndex = path.find('/');
+	if (slashIndex == string_view::npos)
+		return {path, {}};
+	return {path.substr(0, slashIndex), path.substr(slashIndex + 1)};
+}
+} // namespace
+
+size_t FCGIRouter::addRoute(const string_view method, const string_view pathPattern, RouteOptions options)
+{
+	const optional<Method> routeMethod = FCGIRouter::method(method);
+	if (!routeMethod || !pathPattern.starts_with('/'))
+	{
+		string errorMessage = std::format(
+			"Wrong route"
+			", method: {}"
+			", pathPattern: {}",
+			method, pathPattern
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	Route route{string(method), string(pathPattern), std::move(options), {}};
+
+	uint32_t nodeIndex = 0;
+	string_view path = normalizedPath(pathPattern);
+	while (!path.empty())
+	{
+		const auto [segment, remainingPath] = splitSegment(path);
+		path = remainingPath;
+
+		if (segment.size() > 2 && segment.front() == '{' && segment.back() == '}')
+		{
+			if (route.parameterNames.size() == maxPathParameters)
+			{
+				string errorMessage = std::format(
+					"Too many route path parameters"
+					", pathPattern: {}"
+					", maxPathParameters: {}",
+					pathPattern, maxPathParameters
+				);
+				LOG_ERROR(errorMessage);
+
+				throw runtime_error(errorMessage);
+			}
+			route.parameterNames.emplace_back(segment.substr(1, segment.size() - 2));
+
+			if (_nodes[nodeIndex].parameterChild == 0)
+			{
+				_nodes[nodeIndex].parameterChild = _nodes.size();
+				_nodes.emplace_back();
+			}
+			nodeIndex = _nodes[nodeIndex].parameterChild;
+		}
+		else
+		{
+			auto &children = _nodes[nodeIndex].children;
+			auto it = ranges::lower_bound(children, segment, {}, [](const auto &child) { return string_view(child.first); });
+			if (it == children.end() || it->first != segment)
+			{
+				it = children.emplace(it, string(segment), _nodes.size());
+				// emplace_back dopo aver usato children: può riallocare _nodes
+				const uint32_t childIndex = it->second;
+				_nodes.emplace_back();
+				nodeIndex = childIndex;
+			}
+			else
+				nodeIndex = it->second;
+		}
+	}
+
+	int32_t &routeIndex = _nodes[nodeIndex].routes[static_cast<size_t>(*routeMethod)];
+	if (routeIndex != -1)
+	{
+		string errorMessage = std::format(
+			"Route already registered"
+			", method: {}"
+			", pathPattern: {}"
+			", registeredPathPattern: {}",
+			method, pathPattern, _routes[routeIndex].pathPattern
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+	routeIndex = static_cast<int32_t>(_routes.size());
+	_routes.push_back(std::move(route));
+
+	LOG_INFO(
+		"Route registered"
+		", method: {}"
+		", pathPattern: {}"
+		", routeIndex: {}",
+		method, pathPattern, routeIndex
+	);
+
+	return routeIndex;
+}
+
+optional<size_t> FCGIRouter::match(const string_view method, const string_view path, PathParameterValues &parameterValues) const
+{
+	const optional<Method> requestMethod = FCGIRouter::method(method);
+	if (!requestMethod || !path.starts_with('/'))
+		return nullopt;
+
+	const string_view normalizedRequestPath = normalizedPath(path.substr(0, path.find('?')));
+	int32_t routeIndex = -1;
+	if (!matchNode(0, normalizedRequestPath, *requestMethod, parameterValues, 0, routeIndex) &&
+		(*requestMethod != Method::Head || !matchNode(0, normalizedRequestPath, Method::Get, parameterValues, 0, routeIndex)))
+		return nullopt;
+
+	return routeIndex;
+}
+
+string FCGIRouter::allowedMethods(const string_view path) const
+{
+	if (!path.starts_with('/'))
+		return {};
+
+	uint32_t methods = 0;
+	collectMethods(0, normalizedPath(path.substr(0, path.find('?'))), methods);
+	// HEAD è servito dalla route GET
+	if (methods & (1U << static_cast<size_t>(Method::Get)))
+		methods |= 1U << static_cast<size_t>(Method::Head);
+
+	// nell'ordine di Method
+	constexpr array<string_view, static_cast<size_t>(Method::Count)> methodNames = {"GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"};
+	string allowed;
+	for (size_t methodIndex = 0; methodIndex < methodNames.size(); methodIndex++)
+	{
+		if (!(methods & (1U << methodIndex)))
+			continue;
+		if (!allowed.empty())
+			allowed += ", ";
+		allowed += methodNames[methodIndex];
+	}
+
+	return allowed;
+}
+
+void FCGIRouter::collectMethods(const uint32_t nodeIndex, const string_view path, uint32_t &methods) const
+{
+	const Node &node = _nodes[nodeIndex];
+	if (path.empty())
+	{
+		for (size_t methodIndex = 0; methodIndex < node.routes.size(); methodIndex++)
+			if (node.routes[methodIndex] != -1)
+				methods |= 1U << methodIndex;
+		return;
+	}
+
+	const auto [segment, remainingPath] = splitSegment(path);
+
+	if (const auto it = ranges::lower_bound(node.children, segment, {}, [](const auto &child) { return string_view(child.first); });
+		it != node.children.end() && it->first == segment)
+		collectMethods(it->second, remainingPath, methods);
+
+	if (node.parameterChild != 0 && !segment.empty())
+		collectMethods(node.parameterChild, remainingPath, methods);
+}
+
+bool FCGIRouter::matchNode(
+	const uint32_t nodeIndex, const string_view path, const Method method, PathParameterValues &parameterValues, const size_t parametersNumber,
+	int32_t &routeIndex
+) const
+{
+	const Node &node = _nodes[nodeIndex];
+	if (path.empty())
+	{
+		routeIndex = node.routes[static_cast<size_t>(method)];
+		return routeIndex != -1;
+	}
+
+	const auto [segment, remainingPath] = splitSegment(path);
+
+	// prima il segmento statico, altrimenti (anche se la discesa statica fallisce più in profondità) il parametro
+	if (const auto it = ranges::lower_bound(node.children, segment, {}, [](const auto &child) { return string_view(child.first); });
+		it != node.children.end() && it->first == segment && matchNode(it->second, remainingPath, method, parameterValues, parametersNumber, routeIndex))
+		return true;
+
+	if (node.parameterChild == 0 || segment.empty())
+		return false;
+	parameterValues[parametersNumber] = segment;
+
+	return matchNode(node.parameterChild, remainingPath, method, parameterValues, parametersNumber + 1, routeIndex);
+}
+
+optional<FCGIRouter::Method> FCGIRouter::method(const string_view method)
+{
+	if (method == "GET")
+		return Method::Get;
+	if (method == "POST")
+		return Method::Post;
+	if (method == "PUT")
+		return Method::Put;
+	if (method == "DELETE")
+		return Method::Delete;
+	if (method == "HEAD")
+		return Method::Head;
+	if (method == "PATCH")
+		return Method::Patch;
+	if (method == "OPTIONS")
+		return Method::Options;
+	return nullopt;
+}
+
+string_view FCGIRouter::normalizedPath(string_view path)
+{
+	// senza il '/' iniziale e quello finale: "/users/" e "/users" sono la stessa route
+	path.remove_prefix(1);
+	if (path.ends_with('/'))
+		path.remove_suffix(1);
+	return path;
+}
@@ -0,0 +1,128 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIRequestData.h"
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// opzioni di una route di FCGIRouter (fuori dalla classe: usata come argomento di default `= {}`)
+struct FCGIRouteOptions
+{
+	// se presente sostituisce FastCGIAPI::basicAuthenticationRequired per la route
+	std::optional<bool> authorizationRequired;
+	// se presente sostituisce api->responseETag per la route
+	std::optional<bool> responseETag;
+	// false: la risposta non viene mai compressa (requestData.responseBodyCompressed e Accept-Encoding ignorati)
+	bool responseCompression{true};
+	// livello di compressione della risposta, -1: quello di api->responseCompression per l'encoding negoziato
+	int32_t compressionLevel{-1};
+	FCGIRequestData::BodyMode bodyMode{FCGIRequestData::BodyMode::Buffered};
+	// GET: risposte 200 di sendSuccess in FCGIResponseCache per cacheTTL (0: nessuna cache)
+	std::chrono::seconds cacheTTL{0};
+	// parametri della query string che fanno parte della chiave della cache (gli altri sono ignorati)
+	std::vector<std::string> cacheQueryParameters;
+	// tag delle risposte in cache per FastCGIAPI::invalidateResponseCache, {name} diventa il parametro del path
+	// (es. "orders:{userId}")
+	std::vector<std::string> cacheTags;
+};
+
+// Route REST (metodo HTTP + path di REQUEST_URI) con parametri nel path:
+//
+//	GET /users/{userId}/orders/{orderId}
+//
+// Le route vengono compilate alla registrazione in un trie per segmento di path (figli statici ordinati,
+// ricerca binaria) con, per ogni nodo, la route di ogni metodo. La ricerca di una richiesta è una
+// discesa del trie senza allocazioni: i valori dei parametri sono string_view nel path della richiesta.
+// Un segmento statico ha la precedenza su un parametro nella stessa posizione.
+// Le route non sono thread-safe in registrazione: vanno registrate prima di gestire le richieste
+class FCGIRouter final
+{
+public:
+	static constexpr size_t maxPathParameters = 8;
+
+	using RouteOptions = FCGIRouteOptions;
+
+	struct Route
+	{
+		std::string method;
+		std::string pathPattern;
+		RouteOptions options;
+		// nomi dei parametri ({name}) nell'ordine del path
+		std::vector<std::string> parameterNames;
+	};
+
+	using PathParameterValues = std::array<std::string_view, maxPathParameters>;
+
+	// ritorna l'indice della route (ordine di registrazione)
+	size_t addRoute(std::string_view method, std::string_view pathPattern, RouteOptions options = {});
+
+	// path: REQUEST_URI con o senza query string. Valori dei parametri in parameterValues,
+	// nell'ordine di route(index).parameterNames. HEAD senza una route propria usa la route GET
+	[[nodiscard]] std::optional<size_t> match(std::string_view method, std::string_view path, PathParameterValues &parameterValues) const;
+
+	// metodi delle route di path per l'header Allow di un 405 (es. "GET, HEAD, POST"), vuoto se path non corrisponde a nessuna route
+	[[nodiscard]] std::string allowedMethods(std::string_view path) const;
+
+	[[nodiscard]] const Route &route(const size_t routeIndex) const { return _routes[routeIndex]; }
+	[[nodiscard]] bool empty() const { return _routes.empty(); }
+
+private:
+	enum class Method : uint8_t
+	{
+		Get,
+		Head,
+		Post,
+		Put,
+		Delete,
+		Patch,
+		Options,
+		Count
+	};
+
+	struct Node
+	{
+		// segmento statico -> indice del nodo, ordinati per segmento
+		std::vector<std::pair<std::string, uint32_t>> children;
+		// nodo del segmento parametro, 0 se assente (il nodo 0 è la radice)
+		uint32_t parameterChild{};
+		std::array<int32_t, static_cast<size_t>(Method::Count)> routes;
+
+		Node() { routes.fill(-1); }
+	};
+
+	std::vector<Node> _nodes{1};
+	std::vector<Route> _routes;
+
+	static std::optional<Method> method(std::string_view method);
+	static std::string_view normalizedPath(std::string_view path);
+	bool matchNode(uint32_t nodeIndex, std::string_view path, Method method, PathParameterValues &parameterValues, size_t parametersNumber,
+		int32_t &routeIndex) const;
+	// come matchNode ma visita tutti i nodi di path (statici e parametri), bit Method dei metodi registrati in methods
+	void collectMethods(uint32_t nodeIndex, std::string_view path, uint32_t &methods) const;
+};
@@ -0,0 +1,119 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+// Coroutine restituita dagli handler asincroni (FastCGIAPI::AsyncHandler).
+// La coroutine parte sospesa (lazy) e viene avviata da FastCGIAPI, può fare co_await
+// degli awaitable di FCGIEventLoop e di altri FCGITask:
+//
+//	FCGITask MyAPI::getStatus(std::string_view sThreadId, FCGX_Request &request, const FCGIRequestData &requestData)
+//	{
+//		co_await _eventLoop.sleepFor(std::chrono::milliseconds(10));
+//		sendSuccess(sThreadId, requestData.responseBodyCompressed, request, requestData.requestURI,
+//			requestData.requestMethod, 200, R"({"status": "ok"})");
+//	}
+class FCGITask final
+{
+public:
+	struct promise_type
+	{
+		std::exception_ptr exception;
+		// coroutine da riprendere al termine (co_await di un FCGITask)
+		std::coroutine_handle<> continuation;
+
+		FCGITask get_return_object() { return FCGITask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+
+		std::suspend_always initial_suspend() noexcept { return {}; }
+
+		auto final_suspend() noexcept
+		{
+			struct FinalAwaiter
+			{
+				bool await_ready() noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept
+				{
+					if (const std::coroutine_handle<> continuation = handle.promise().continuation)
+						return continuation;
+					return std::noop_coroutine();
+				}
+				void await_resume() noexcept {}
+			};
+			return FinalAwaiter{};
+		}
+
+		void return_void() {}
+
+		void unhandled_exception() { exception = std::current_exception(); }
+	};
+
+	FCGITask() = default;
+	explicit FCGITask(const std::coroutine_handle<promise_type> handle) : _handle(handle) {}
+	FCGITask(FCGITask &&other) noexcept : _handle(std::exchange(other._handle, {})) {}
+	FCGITask &operator=(FCGITask &&other) noexcept
+	{
+		if (this != &other)
+		{
+			if (_handle)
+				_handle.destroy();
+			_handle = std::exchange(other._handle, {});
+		}
+		return *this;
+	}
+	FCGITask(const FCGITask &) = delete;
+	FCGITask &operator=(const FCGITask &) = delete;
+
+	~FCGITask()
+	{
+		if (_handle)
+			_handle.destroy();
+	}
+
+	[[nodiscard]] bool done() const { return !_handle || _handle.done(); }
+
+	void resume()
+	{
+		if (_handle && !_handle.done())
+			_handle.resume();
+	}
+
+	void rethrowIfFailed() const
+	{
+		if (_handle && _handle.promise().exception)
+			std::rethrow_exception(_handle.promise().exception);
+	}
+
+	// co_await di un FCGITask all'interno di un altro FCGITask
+	[[nodiscard]] bool await_ready() const noexcept { return done(); }
+	std::coroutine_handle<> await_suspend(const std::coroutine_handle<> continuation) noexcept
+	{
+		_handle.promise().continuation = continuation;
+		return _handle;
+	}
+	void await_resume() const { rethrowIfFailed(); }
+
+private:
+	std::coroutine_handle<promise_type> _handle;
+};
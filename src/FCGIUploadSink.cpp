@@ -0,0 +1,379 @@
+#include "FCGIUploadSink.h"
+#include "ThreadLogger.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <memory>
+#include <stdexcept>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+constexpr char rangesMagic[8] = {'F', 'C', 'G', 'I', 'R', 'N', 'G', '1'};
+
+struct RangesHeader
+{
+	char magic[8];
+	uint64_t totalSize;
+	uint64_t rangesNumber;
+};
+
+// lock del file .ranges: lo stesso upload può ricevere blocchi in parallelo da thread o processi diversi
+class RangesLock final
+{
+public:
+	explicit RangesLock(const int fileDescriptor) : _fileDescriptor(fileDescriptor)
+	{
+		while (flock(_fileDescriptor, LOCK_EX) == -1 && errno == EINTR)
+			;
+	}
+	~RangesLock() { flock(_fileDescriptor, LOCK_UN); }
+
+	RangesLock(const RangesLock &) = delete;
+	RangesLock &operator=(const RangesLock &) = delete;
+
+private:
+	int _fileDescriptor;
+};
+} // namespace
+
+FCGIUploadSink::FCGIUploadSink(string filePath, const uint64_t totalSize)
+	: _filePath(std::move(filePath)), _rangesFilePath(_filePath + ".ranges"), _totalSize(totalSize)
+{
+	_rangesFileDescriptor = open(_rangesFilePath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (_rangesFileDescriptor == -1)
+	{
+		string errorMessage = std::format(
+			"open of the upload ranges file failed"
+			", rangesFilePath: {}"
+			", errno: {}",
+			_rangesFilePath, strerror(errno)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	_fileDescriptor = open(_filePath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (_fileDescriptor == -1)
+	{
+		string errorMessage = std::format(
+			"open of the upload file failed"
+			", filePath: {}"
+			", errno: {}",
+			_filePath, strerror(errno)
+		);
+		LOG_ERROR(errorMessage);
+		close(_rangesFileDescriptor);
+
+		throw runtime_error(errorMessage);
+	}
+
+	RangesLock rangesLock(_rangesFileDescriptor);
+
+	uint64_t storedTotalSize = 0;
+	if (loadRanges(_rangesFileDescriptor, storedTotalSize, _ranges) && storedTotalSize != _totalSize)
+	{
+		string errorMessage = std::format(
+			"Upload size does not match the upload in progress"
+			", filePath: {}"
+			", totalSize: {}"
+			", storedTotalSize: {}",
+			_filePath, _totalSize, storedTotalSize
+		);
+		LOG_ERROR(errorMessage);
+		close(_fileDescriptor);
+		close(_rangesFileDescriptor);
+
+		throw FastCGIError::HTTPError(409, errorMessage);
+	}
+
+	if (_ranges.empty())
+	{
+		// nuovo upload: il file (che potrebbe esistere ed essere più grande, es. upload precedente) viene portato
+		// alla dimensione totale e preallocato per intero, i blocchi vengono scritti al loro offset
+		if (ftruncate(_fileDescriptor, static_cast<off_t>(_totalSize)) == -1)
+		{
+			string errorMessage = std::format(
+				"ftruncate failed"
+				", filePath: {}"
+				", errno: {}",
+				_filePath, strerror(errno)
+			);
+			LOG_ERROR(errorMessage);
+			close(_fileDescriptor);
+			close(_rangesFileDescriptor);
+
+			throw runtime_error(errorMessage);
+		}
+		if (const int returnCode = posix_fallocate(_fileDescriptor, 0, static_cast<off_t>(_totalSize)); returnCode != 0)
+			// es. EOPNOTSUPP su alcuni filesystem: il file è solo esteso (sparse)
+			LOG_WARN(
+				"posix_fallocate failed, the file is only extended"
+				", filePath: {}"
+				", error: {}",
+				_filePath, strerror(returnCode)
+			);
+		storeRanges();
+	}
+}
+
+FCGIUploadSink::~FCGIUploadSink()
+{
+	if (_fileDescriptor != -1)
+		close(_fileDescriptor);
+	if (_rangesFileDescriptor != -1)
+		close(_rangesFileDescriptor);
+}
+
+uint64_t FCGIUploadSink::write(const FCGIRequestData &requestData, const uint64_t start, const uint64_t size)
+{
+	if (start + size > _totalSize)
+	{
+		string errorMessage = std::format(
+			"Upload range exceeds the upload size"
+			", filePath: {}"
+			", start: {}"
+			", size: {}"
+			", totalSize: {}",
+			_filePath, start, size, _totalSize
+		);
+		LOG_ERROR(errorMessage);
+
+		throw FastCGIError::HTTPError(416, errorMessage);
+	}
+
+	uint64_t written;
+	if (!requestData.requestBodyFilePath.empty())
+		written = writeFromSpoolFile(requestData.requestBodyFilePath, start, size);
+	else if (!requestData.requestBody.empty())
+		written = writeFromBuffer(string_view(requestData.requestBody).substr(0, size), start);
+	else
+		written = writeFromStream(requestData, start, size);
+
+	if (written > 0)
+		addRange(start, start + written);
+
+	LOG_TRACE(
+		"Upload range written"
+		", filePath: {}"
+		", start: {}"
+		", written: {}"
+		", receivedPrefix: {}"
+		", totalSize: {}",
+		_filePath, start, written, receivedPrefix(), _totalSize
+	);
+
+	return written;
+}
+
+uint64_t FCGIUploadSink::receivedPrefix() const
+{
+	if (_ranges.empty() || _ranges.front().first != 0)
+		return 0;
+
+	return _ranges.front().second;
+}
+
+uint64_t FCGIUploadSink::receivedPrefix(const string &filePath)
+{
+	const string rangesFilePath = filePath + ".ranges";
+	const int rangesFileDescriptor = open(rangesFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (rangesFileDescriptor == -1)
+	{
+		// senza .ranges l'upload è completo (il file esiste) oppure non è mai iniziato
+		struct stat fileStat{};
+		if (stat(filePath.c_str(), &fileStat) == 0)
+			return fileStat.st_size;
+		return 0;
+	}
+
+	uint64_t totalSize = 0;
+	vector<pair<uint64_t, uint64_t>> ranges;
+	{
+		RangesLock rangesLock(rangesFileDescriptor);
+		loadRanges(rangesFileDescriptor, totalSize, ranges);
+	}
+	close(rangesFileDescriptor);
+
+	if (ranges.empty() || ranges.front().first != 0)
+		return 0;
+
+	return ranges.front().second;
+}
+
+uint64_t FCGIUploadSink::writeFromSpoolFile(const string &spoolFilePath, const uint64_t start, const uint64_t size)
+{
+	const int spoolFileDescriptor = open(spoolFilePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (spoolFileDescriptor == -1)
+	{
+		string errorMessage = std::format(
+			"open of the spool file failed"
+			", spoolFilePath: {}"
+			", errno: {}",
+			spoolFilePath, strerror(errno)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	auto inputOffset = static_cast<off_t>(0);
+	auto outputOffset = static_cast<off_t>(start);
+	uint64_t written = 0;
+	while (written < size)
+	{
+		const ssize_t copied = copy_file_range(spoolFileDescriptor, &inputOffset, _fileDescriptor, &outputOffset, size - written, 0);
+		if (copied == -1 && errno == EINTR)
+			continue;
+		if (copied == -1)
+		{
+			string errorMessage = std::format(
+				"copy_file_range failed"
+				", spoolFilePath: {}"
+				", filePath: {}"
+				", errno: {}",
+				spoolFilePath, _filePath, strerror(errno)
+			);
+			LOG_ERROR(errorMessage);
+			close(spoolFileDescriptor);
+
+			throw runtime_error(errorMessage);
+		}
+		if (copied == 0)
+			break;
+		written += copied;
+	}
+	close(spoolFileDescriptor);
+
+	return written;
+}
+
+uint64_t FCGIUploadSink::writeFromStream(const FCGIRequestData &requestData, const uint64_t start, const uint64_t size)
+{
+	constexpr size_t bufferSize = 256 * 1024;
+	const auto buffer = make_unique_for_overwrite<char[]>(bufferSize);
+
+	uint64_t written = 0;
+	while (written < size)
+	{
+		const size_t readBytes = requestData.readBody(span(buffer.get(), min<uint64_t>(bufferSize, size - written)));
+		if (readBytes == 0)
+			break;
+		written += writeFromBuffer(string_view(buffer.get(), readBytes), start + written);
+	}
+
+	return written;
+}
+
+uint64_t FCGIUploadSink::writeFromBuffer(const string_view data, const uint64_t start)
+{
+	size_t written = 0;
+	while (written < data.size())
+	{
+		const ssize_t writeReturn = pwrite(_fileDescriptor, data.data() + written, data.size() - written, static_cast<off_t>(start + written));
+		if (writeReturn == -1 && errno == EINTR)
+			continue;
+		if (writeReturn == -1)
+		{
+			string errorMessage = std::format(
+				"pwrite failed"
+				", filePath: {}"
+				", offset: {}"
+				", errno: {}",
+				_filePath, start + written, strerror(errno)
+			);
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+		written += writeReturn;
+	}
+
+	return written;
+}
+
+void FCGIUploadSink::addRange(const uint64_t start, const uint64_t end)
+{
+	RangesLock rangesLock(_rangesFileDescriptor);
+
+	// riletti sotto lock: nel frattempo altri blocchi potrebbero essere stati scritti da altre richieste
+	uint64_t storedTotalSize = 0;
+	loadRanges(_rangesFileDescriptor, storedTotalSize, _ranges);
+
+	// inserimento ordinato e fusione con gli intervalli sovrapposti o adiacenti
+	auto it = ranges::lower_bound(_ranges, start, {}, &pair<uint64_t, uint64_t>::first);
+	if (it != _ranges.begin() && prev(it)->second >= start)
+		--it;
+	uint64_t mergedStart = start;
+	uint64_t mergedEnd = end;
+	auto last = it;
+	while (last != _ranges.end() && last->first <= mergedEnd)
+	{
+		mergedStart = min(mergedStart, last->first);
+		mergedEnd = max(mergedEnd, last->second);
+		++last;
+	}
+	it = _ranges.erase(it, last);
+	_ranges.insert(it, {mergedStart, mergedEnd});
+
+	if (complete())
+	{
+		unlink(_rangesFilePath.c_str());
+
+		LOG_INFO(
+			"Upload completed"
+			", filePath: {}"
+			", totalSize: {}",
+			_filePath, _totalSize
+		);
+
+		return;
+	}
+
+	storeRanges();
+}
+
+bool FCGIUploadSink::loadRanges(const int rangesFileDescriptor, uint64_t &totalSize, vector<pair<uint64_t, uint64_t>> &ranges)
+{
+	ranges.clear();
+
+	RangesHeader header{};
+	if (pread(rangesFileDescriptor, &header, sizeof(header), 0) != sizeof(header) || memcmp(header.magic, rangesMagic, sizeof(rangesMagic)) != 0)
+		return false;
+
+	totalSize = header.totalSize;
+	ranges.resize(header.rangesNumber);
+	const auto rangesSize = static_cast<ssize_t>(ranges.size() * sizeof(pair<uint64_t, uint64_t>));
+	if (pread(rangesFileDescriptor, ranges.data(), rangesSize, sizeof(header)) != rangesSize)
+	{
+		ranges.clear();
+		return false;
+	}
+
+	return true;
+}
+
+void FCGIUploadSink::storeRanges() const
+{
+	RangesHeader header{};
+	memcpy(header.magic, rangesMagic, sizeof(rangesMagic));
+	header.totalSize = _totalSize;
+	header.rangesNumber = _ranges.size();
+
+	const auto rangesSize = static_cast<ssize_t>(_ranges.size() * sizeof(pair<uint64_t, uint64_t>));
+	if (pwrite(_rangesFileDescriptor, &header, sizeof(header), 0) != sizeof(header) ||
+		pwrite(_rangesFileDescriptor, _ranges.data(), rangesSize, sizeof(header)) != rangesSize ||
+		ftruncate(_rangesFileDescriptor, static_cast<off_t>(sizeof(header) + rangesSize)) == -1)
+		LOG_ERROR(
+			"write of the upload ranges file failed"
+			", rangesFilePath: {}"
+			", errno: {}",
+			_rangesFilePath, strerror(errno)
+		);
+}
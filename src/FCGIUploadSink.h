@@ -0,0 +1,77 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include "FCGIRequestData.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Destinazione di un upload a blocchi ripristinabile (Content-Range: bytes <start>-<end>/<size>).
+// Ogni blocco viene scritto direttamente al proprio offset del file (preallocato a <size> byte),
+// senza bufferizzare l'intero body:
+//	- BodyMode::Spool: copy_file_range dal file di spool (copia nel kernel)
+//	- BodyMode::Streaming: pwrite a blocchi letti da request.in
+//	- BodyMode::Buffered: pwrite di requestBody
+// Gli intervalli ricevuti vengono mantenuti ordinati e fusi nel file <filePath>.ranges
+// (un solo intervallo per un upload sequenziale), per cui un HEAD o la ripresa di un upload
+// interrotto, anche da un altro thread o processo, sanno da quale byte ripartire.
+// Il file .ranges viene eliminato quando l'upload è completo.
+class FCGIUploadSink final
+{
+public:
+	FCGIUploadSink(std::string filePath, uint64_t totalSize);
+	~FCGIUploadSink();
+
+	FCGIUploadSink(const FCGIUploadSink &) = delete;
+	FCGIUploadSink &operator=(const FCGIUploadSink &) = delete;
+
+	// scrive il body della richiesta nell'intervallo [start, start + size), ritorna i byte scritti
+	uint64_t write(const FCGIRequestData &requestData, uint64_t start, uint64_t size);
+
+	[[nodiscard]] uint64_t totalSize() const { return _totalSize; }
+	// byte contigui ricevuti a partire dall'inizio del file (offset da cui il client deve riprendere)
+	[[nodiscard]] uint64_t receivedPrefix() const;
+	[[nodiscard]] bool complete() const { return receivedPrefix() == _totalSize; }
+
+	// come receivedPrefix senza aprire l'upload (es. HEAD): 0 se l'upload non esiste,
+	// la dimensione del file se l'upload è già completo
+	static uint64_t receivedPrefix(const std::string &filePath);
+
+private:
+	std::string _filePath;
+	std::string _rangesFilePath;
+	uint64_t _totalSize;
+	int _fileDescriptor{-1};
+	int _rangesFileDescriptor{-1};
+	// intervalli [start, end) ricevuti, ordinati e non sovrapposti
+	std::vector<std::pair<uint64_t, uint64_t>> _ranges;
+
+	uint64_t writeFromSpoolFile(const std::string &spoolFilePath, uint64_t start, uint64_t size);
+	uint64_t writeFromStream(const FCGIRequestData &requestData, uint64_t start, uint64_t size);
+	uint64_t writeFromBuffer(std::string_view data, uint64_t start);
+	void addRange(uint64_t start, uint64_t end);
+
+	static bool loadRanges(int rangesFileDescriptor, uint64_t &totalSize, std::vector<std::pair<uint64_t, uint64_t>> &ranges);
+	void storeRanges() const;
+};
@@ -0,0 +1,107 @@
+#include "FCGIWorkerPool.h"
+#include "ThreadLogger.h"
+
+using namespace std;
+
+FCGIWorkerPool::FCGIWorkerPool(const int32_t workerQueues, const int32_t queueDepth)
+	: _queueDepth(queueDepth), _workerQueues(max(workerQueues, 1))
+{
+}
+
+shared_ptr<FCGIWorkerPool> FCGIWorkerPool::processPool(const int32_t workerQueues, const int32_t queueDepth)
+{
+	lock_guard locker(_processPoolMutex);
+
+	if (!_processPool)
+	{
+		_processPool = make_shared<FCGIWorkerPool>(workerQueues, queueDepth);
+
+		LOG_INFO(
+			"FCGIWorkerPool created"
+			", workerQueues: {}"
+			", queueDepth: {}",
+			workerQueues, queueDepth
+		);
+	}
+
+	return _processPool;
+}
+
+bool FCGIWorkerPool::push(FCGXRequestPtr &&request)
+{
+	if (_queued.fetch_add(1) >= _queueDepth)
+	{
+		--_queued;
+		return false;
+	}
+
+	WorkerQueue &workerQueue = _workerQueues[_nextWorkerQueue++ % _workerQueues.size()];
+	{
+		lock_guard locker(workerQueue.mutex);
+		if (_closed)
+		{
+			--_queued;
+			return false;
+		}
+		workerQueue.requests.push_back(std::move(request));
+	}
+	_available.release();
+
+	return true;
+}
+
+FCGXRequestPtr FCGIWorkerPool::pop(const int32_t workerIndex, const chrono::milliseconds timeout)
+{
+	if (!_available.try_acquire_for(timeout))
+		return nullptr;
+
+	// il token garantisce che almeno una richiesta sia presente in una delle deque:
+	// prima la propria (dalla testa), poi quelle degli altri worker (dalla coda)
+	const size_t workerQueuesNumber = _workerQueues.size();
+	const size_t ownQueueIndex = workerIndex < 0 ? 0 : workerIndex % workerQueuesNumber;
+	while (true)
+	{
+		for (size_t queueOffset = 0; queueOffset < workerQueuesNumber; queueOffset++)
+		{
+			WorkerQueue &workerQueue = _workerQueues[(ownQueueIndex + queueOffset) % workerQueuesNumber];
+
+			lock_guard locker(workerQueue.mutex);
+			if (workerQueue.requests.empty())
+				continue;
+
+			FCGXRequestPtr request;
+			if (queueOffset == 0)
+			{
+				request = std::move(workerQueue.requests.front());
+				workerQueue.requests.pop_front();
+			}
+			else
+			{
+				request = std::move(workerQueue.requests.back());
+				workerQueue.requests.pop_back();
+			}
+			--_queued;
+
+			return request;
+		}
+	}
+}
+
+vector<FCGXRequestPtr> FCGIWorkerPool::workerStopped()
+{
+	vector<FCGXRequestPtr> requests;
+	if (--_runningWorkers > 0)
+		return requests;
+
+	_closed = true;
+	for (WorkerQueue &workerQueue : _workerQueues)
+	{
+		lock_guard locker(workerQueue.mutex);
+		for (FCGXRequestPtr &request : workerQueue.requests)
+			requests.push_back(std::move(request));
+		workerQueue.requests.clear();
+	}
+	_queued -= static_cast<int32_t>(requests.size());
+
+	return requests;
+}
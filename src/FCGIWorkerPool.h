@@ -0,0 +1,98 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fcgiapp.h>
+#include <memory>
+#include <mutex>
+#include <semaphore>
+#include <vector>
+
+// FCGX_Request posseduta (coda del pool, AsyncRequest): al rilascio FCGX_Free chiude anche la connessione
+// rimasta aperta da FCGX_Finish_r con FCGI_KEEP_CONN, altrimenti ipcFd e la memoria della richiesta andrebbero persi
+struct FCGXRequestDeleter
+{
+	void operator()(FCGX_Request *request) const
+	{
+		FCGX_Free(request, 1);
+		delete request;
+	}
+};
+using FCGXRequestPtr = std::unique_ptr<FCGX_Request, FCGXRequestDeleter>;
+
+// Coda delle richieste accettate dai thread acceptor e non ancora gestite dai thread worker.
+// Ogni worker ha la propria deque: l'acceptor distribuisce le richieste round-robin,
+// il worker preleva dalla testa della propria deque e, se è vuota, "ruba" dalla coda
+// delle deque degli altri worker, per cui un handler lento non blocca le richieste
+// assegnate al suo worker.
+// L'istanza è unica per processo ed è condivisa da tutte le istanze di FastCGIAPI (una per thread).
+// Il numero dei thread è deciso dall'applicazione (un thread per istanza di FastCGIAPI), il pool decide
+// solo il numero delle deque: i worker oltre workerQueues condividono la deque (workerIndex % workerQueues).
+class FCGIWorkerPool final
+{
+public:
+	FCGIWorkerPool(int32_t workerQueues, int32_t queueDepth);
+	~FCGIWorkerPool() = default;
+
+	// ritorna il pool del processo, creandolo alla prima chiamata
+	static std::shared_ptr<FCGIWorkerPool> processPool(int32_t workerQueues, int32_t queueDepth);
+
+	// ritorna l'ordinale del thread chiamante (0, 1, 2, ...), usato per assegnare il ruolo di acceptor o worker
+	int32_t registerThread() { return _registeredThreads++; }
+
+	// false se la coda ha già queueDepth richieste o se il pool è chiuso, in questo caso la richiesta resta al chiamante
+	bool push(FCGXRequestPtr &&request);
+
+	// nullptr se entro timeout non è arrivata nessuna richiesta
+	FCGXRequestPtr pop(int32_t workerIndex, std::chrono::milliseconds timeout);
+
+	// il worker inizia/termina il proprio loop. L'ultimo worker che termina chiude il pool e ritorna
+	// le richieste ancora in coda (a cui nessun altro worker risponderebbe), le push successive falliscono
+	void workerStarted() { ++_runningWorkers; }
+	std::vector<FCGXRequestPtr> workerStopped();
+
+	[[nodiscard]] int32_t queued() const { return _queued; }
+
+private:
+	struct WorkerQueue
+	{
+		std::mutex mutex;
+		std::deque<FCGXRequestPtr> requests;
+	};
+
+	int32_t _queueDepth;
+	std::vector<WorkerQueue> _workerQueues;
+	std::atomic<int32_t> _queued{};
+	std::atomic<uint32_t> _nextWorkerQueue{};
+	std::atomic<int32_t> _registeredThreads{};
+	std::atomic<int32_t> _runningWorkers{};
+	// letto da push sotto il mutex della deque, per cui nessuna richiesta può essere accodata dopo lo svuotamento
+	std::atomic<bool> _closed{};
+	// un token per ogni richiesta presente nelle deque
+	std::counting_semaphore<> _available{0};
+
+	static inline std::mutex _processPoolMutex;
+	static inline std::shared_ptr<FCGIWorkerPool> _processPool;
+};
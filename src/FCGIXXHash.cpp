@@ -0,0 +1,101 @@
+#include "FCGIXXHash.h"
+#include <bit>
+#include <cstring>
+
+using namespace std;
+
+namespace
+{
+constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+
+// letture little endian non allineate (memcpy viene compilato in una load)
+uint64_t read64(const char *data)
+{
+	uint64_t value;
+	memcpy(&value, data, sizeof(value));
+	if constexpr (endian::native == endian::big)
+		value = __builtin_bswap64(value);
+	return value;
+}
+
+uint32_t read32(const char *data)
+{
+	uint32_t value;
+	memcpy(&value, data, sizeof(value));
+	if constexpr (endian::native == endian::big)
+		value = __builtin_bswap32(value);
+	return value;
+}
+
+uint64_t round(uint64_t accumulator, const uint64_t input)
+{
+	accumulator += input * prime2;
+	accumulator = rotl(accumulator, 31);
+	return accumulator * prime1;
+}
+
+uint64_t mergeRound(uint64_t accumulator, const uint64_t value)
+{
+	accumulator ^= round(0, value);
+	return accumulator * prime1 + prime4;
+}
+} // namespace
+
+uint64_t FCGIXXHash::hash64(const string_view data, const uint64_t seed)
+{
+	const char *position = data.data();
+	const char *end = position + data.size();
+	uint64_t hash;
+
+	if (data.size() >= 32)
+	{
+		uint64_t lane1 = seed + prime1 + prime2;
+		uint64_t lane2 = seed + prime2;
+		uint64_t lane3 = seed;
+		uint64_t lane4 = seed - prime1;
+
+		const char *limit = end - 32;
+		do
+		{
+			lane1 = round(lane1, read64(position));
+			lane2 = round(lane2, read64(position + 8));
+			lane3 = round(lane3, read64(position + 16));
+			lane4 = round(lane4, read64(position + 24));
+			position += 32;
+		} while (position <= limit);
+
+		hash = rotl(lane1, 1) + rotl(lane2, 7) + rotl(lane3, 12) + rotl(lane4, 18);
+		hash = mergeRound(hash, lane1);
+		hash = mergeRound(hash, lane2);
+		hash = mergeRound(hash, lane3);
+		hash = mergeRound(hash, lane4);
+	}
+	else
+		hash = seed + prime5;
+
+	hash += data.size();
+
+	// ultimi (meno di 32) byte
+	for (; position + 8 <= end; position += 8)
+		hash = rotl(hash ^ round(0, read64(position)), 27) * prime1 + prime4;
+	if (position + 4 <= end)
+	{
+		hash = rotl(hash ^ read32(position) * prime1, 23) * prime2 + prime3;
+		position += 4;
+	}
+	for (; position < end; position++)
+		hash = rotl(hash ^ static_cast<uint8_t>(*position) * prime5, 11) * prime1;
+
+	// avalanche
+	hash ^= hash >> 33;
+	hash *= prime2;
+	hash ^= hash >> 29;
+	hash *= prime3;
+	hash ^= hash >> 32;
+
+	return hash;
+}
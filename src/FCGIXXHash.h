@@ -0,0 +1,35 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// XXH64 (https://github.com/Cyan4973/xxHash, stesso risultato dell'implementazione di riferimento):
+// hash non crittografico per gli ETag dei body delle risposte.
+// Quattro accumulatori indipendenti su blocchi di 32 byte: le moltiplicazioni dei quattro lane
+// vengono eseguite in parallelo dalla CPU (qualche GB/s per core, un body di 1 MB costa meno di un ms)
+class FCGIXXHash final
+{
+public:
+	static uint64_t hash64(std::string_view data, uint64_t seed = 0);
+};
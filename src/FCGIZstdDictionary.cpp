@@ -0,0 +1,95 @@
+#include "FCGIZstdDictionary.h"
+#include "ThreadLogger.h"
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#ifdef FASTCGIAPI_ZSTD
+#include <zdict.h>
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+FCGIZstdDictionary::FCGIZstdDictionary(const string &path, const int level) : _path(path), _level(level)
+{
+#ifdef FASTCGIAPI_ZSTD
+	ifstream dictionaryFile(path, ios::binary);
+	const string dictionary((istreambuf_iterator<char>(dictionaryFile)), istreambuf_iterator<char>());
+	if (dictionaryFile.bad() || dictionary.empty())
+	{
+		string errorMessage = std::format(
+			"Failed to read the zstd dictionary"
+			", path: {}",
+			path
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	// 0: dizionario "raw" (senza header ZDICT), utilizzabile ma senza id da negoziare con il client
+	_id = ZDICT_getDictID(dictionary.data(), dictionary.size());
+	if (_id == 0)
+	{
+		string errorMessage = std::format(
+			"zstd dictionary without id (not trained with ZDICT/zstd --train)"
+			", path: {}",
+			path
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	// ZSTD_createCDict copia il dizionario: il buffer letto può essere rilasciato
+	_compressionDictionary = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+	if (_compressionDictionary == nullptr)
+	{
+		string errorMessage = std::format(
+			"ZSTD_createCDict failed"
+			", path: {}"
+			", level: {}",
+			path, level
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	LOG_INFO(
+		"zstd dictionary loaded"
+		", path: {}"
+		", size: {}"
+		", id: {}"
+		", level: {}",
+		path, dictionary.size(), _id, level
+	);
+#else
+	string errorMessage = std::format(
+		"zstd dictionary configured but the library is built without zstd (FASTCGIAPI_ZSTD)"
+		", path: {}",
+		path
+	);
+	LOG_ERROR(errorMessage);
+
+	throw runtime_error(errorMessage);
+#endif
+}
+
+FCGIZstdDictionary::~FCGIZstdDictionary()
+{
+#ifdef FASTCGIAPI_ZSTD
+	ZSTD_freeCDict(static_cast<ZSTD_CDict *>(_compressionDictionary));
+#endif
+}
+
+shared_ptr<FCGIZstdDictionary> FCGIZstdDictionary::processDictionary(const string &path, const int level)
+{
+	lock_guard locker(_processDictionaryMutex);
+
+	if (!_processDictionary || _processDictionary->path() != path || _processDictionary->level() != level)
+		_processDictionary = make_shared<FCGIZstdDictionary>(path, level);
+
+	return _processDictionary;
+}
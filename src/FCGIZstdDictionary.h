@@ -0,0 +1,69 @@
+/*
+ This program is free software; you can redistribute it and/or
+ modify it under the terms of the GNU General Public License
+ as published by the Free Software Foundation; either
+ version 2 of the License, or (at your option) any later
+ version.
+
+ This program is distributed in the hope that it will be useful,
+ but WITHOUT ANY WARRANTY; without even the implied warranty of
+ MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ GNU General Public License for more details.
+
+ You should have received a copy of the GNU General Public License
+ along with this program; if not, write to the Free Software
+ Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+
+ Commercial use other than under the terms of the GNU General Public
+ License is allowed only after express negotiation of conditions
+ with the authors.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+// Dizionario zstd (addestrato con FCGIZstdDictionaryTrainer sui body delle risposte) per comprimere
+// le risposte JSON piccole: i nomi dei campi ripetuti in ogni risposta sono già nel dizionario.
+// Il dizionario viene caricato una volta per processo e condiviso da tutti i thread: il contesto
+// di compressione predigerito (ZSTD_CDict) è in sola lettura.
+// Protocollo con il client (proprietario, non quello di RFC 9842 con Available-Dictionary e dcz:
+// per questo il rel non è quello standard "compression-dictionary", che il browser userebbe per RFC 9842):
+//	- le risposte a un client che accetta zstd annunciano il dizionario con
+//	  Link: <url>; rel="x-zstd-dictionary" (url: api->responseCompression->zstdDictionary->url)
+//	- il client che ha scaricato il dizionario invia X-Zstd-Dictionary-Id con l'id del dizionario
+//	  (ZDICT_getDictID, anche nell'header del dizionario stesso)
+//	- la risposta compressa con il dizionario ha Content-Encoding: zstd e X-Zstd-Dictionary-Id;
+//	  il frame zstd riporta l'id del dizionario necessario alla decompressione
+class FCGIZstdDictionary final
+{
+public:
+	// path: dizionario nel formato di ZDICT_trainFromBuffer (zstd --train)
+	FCGIZstdDictionary(const std::string &path, int level);
+	~FCGIZstdDictionary();
+
+	FCGIZstdDictionary(const FCGIZstdDictionary &) = delete;
+	FCGIZstdDictionary &operator=(const FCGIZstdDictionary &) = delete;
+
+	// ritorna il dizionario del processo, caricandolo alla prima chiamata
+	static std::shared_ptr<FCGIZstdDictionary> processDictionary(const std::string &path, int level);
+
+	[[nodiscard]] uint32_t id() const { return _id; }
+	[[nodiscard]] int level() const { return _level; }
+	[[nodiscard]] const std::string &path() const { return _path; }
+	// ZSTD_CDict, void per non esporre zstd.h
+	[[nodiscard]] const void *compressionDictionary() const { return _compressionDictionary; }
+
+private:
+	std::string _path;
+	int _level;
+	uint32_t _id{};
+	void *_compressionDictionary{};
+
+	static inline std::mutex _processDictionaryMutex;
+	static inline std::shared_ptr<FCGIZstdDictionary> _processDictionary;
+};
@@ -0,0 +1,177 @@
+// Addestra il dizionario zstd per api->responseCompression->zstdDictionary (FCGIZstdDictionary)
+// dai body delle risposte catturati:
+//
+//	FCGIZstdDictionaryTrainer [--maxSize <bytes>] [--level <level>] [--lines] <dictionary> <samples>...
+//
+// samples: file (un campione per file) o directory (ogni file regolare, ricorsivamente, è un campione).
+// --lines: ogni riga dei file è un campione (es. un body JSON per riga).
+// Al termine stampa l'id del dizionario e il rapporto di compressione dei campioni con e senza dizionario
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <zdict.h>
+#include <zstd.h>
+
+using namespace std;
+
+namespace
+{
+// i campioni vengono concatenati in un unico buffer, come richiesto da ZDICT_trainFromBuffer
+struct Samples
+{
+	string buffer;
+	vector<size_t> sizes;
+
+	void add(const string_view sample)
+	{
+		if (sample.empty())
+			return;
+		buffer += sample;
+		sizes.push_back(sample.size());
+	}
+};
+
+void addFile(const filesystem::path &path, const bool lines, Samples &samples)
+{
+	ifstream file(path, ios::binary);
+	if (!file)
+		throw runtime_error(std::format("Failed to open the sample, path: {}", path.string()));
+
+	if (lines)
+	{
+		string line;
+		while (getline(file, line))
+			samples.add(line);
+	}
+	else
+		samples.add(string((istreambuf_iterator<char>(file)), istreambuf_iterator<char>()));
+}
+
+int64_t numericArgument(const string_view name, const string_view value)
+{
+	int64_t number{};
+	if (const auto [ptr, ec] = from_chars(value.data(), value.data() + value.size(), number); ec != errc() || ptr != value.data() + value.size())
+		throw runtime_error(std::format("Wrong {}: {}", name, value));
+	return number;
+}
+
+int usage()
+{
+	cerr << "Usage: FCGIZstdDictionaryTrainer [--maxSize <bytes>] [--level <level>] [--lines] <dictionary> <samples>..." << endl;
+	return 1;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+	// 110 KB: default di zstd --train
+	size_t maxDictionarySize = 112640;
+	int level = 3;
+	bool lines = false;
+	vector<string_view> paths;
+
+	try
+	{
+		for (int index = 1; index < argc; index++)
+		{
+			const string_view argument = argv[index];
+			if ((argument == "--maxSize" || argument == "--level") && index + 1 < argc)
+			{
+				const int64_t value = numericArgument(argument, argv[++index]);
+				if (argument == "--maxSize")
+					maxDictionarySize = static_cast<size_t>(value);
+				else
+					level = static_cast<int>(value);
+			}
+			else if (argument == "--lines")
+				lines = true;
+			else if (argument.starts_with("--"))
+				return usage();
+			else
+				paths.push_back(argument);
+		}
+		if (paths.size() < 2)
+			return usage();
+
+		Samples samples;
+		for (size_t index = 1; index < paths.size(); index++)
+		{
+			const filesystem::path path(paths[index]);
+			if (filesystem::is_directory(path))
+			{
+				for (const auto &entry : filesystem::recursive_directory_iterator(path))
+					if (entry.is_regular_file())
+						addFile(entry.path(), lines, samples);
+			}
+			else
+				addFile(path, lines, samples);
+		}
+		if (samples.sizes.empty())
+			throw runtime_error("No samples found");
+
+		string dictionary(maxDictionarySize, '\0');
+		const size_t dictionarySize = ZDICT_trainFromBuffer(
+			dictionary.data(), dictionary.size(), samples.buffer.data(), samples.sizes.data(), static_cast<unsigned>(samples.sizes.size())
+		);
+		if (ZDICT_isError(dictionarySize))
+			throw runtime_error(std::format(
+				"ZDICT_trainFromBuffer failed (too few or too small samples?)"
+				", error: {}"
+				", samples: {}",
+				ZDICT_getErrorName(dictionarySize), samples.sizes.size()
+			));
+		dictionary.resize(dictionarySize);
+
+		ofstream dictionaryFile(string(paths[0]), ios::binary | ios::trunc);
+		dictionaryFile.write(dictionary.data(), static_cast<streamsize>(dictionary.size()));
+		if (!dictionaryFile.flush())
+			throw runtime_error(std::format("Failed to write the dictionary, path: {}", paths[0]));
+
+		// verifica: ogni campione compresso da solo, come una risposta, con e senza dizionario
+		ZSTD_CCtx *context = ZSTD_createCCtx();
+		ZSTD_CDict *compressionDictionary = ZSTD_createCDict(dictionary.data(), dictionary.size(), level);
+		string compressed(ZSTD_compressBound(ranges::max(samples.sizes)), '\0');
+		size_t withoutDictionary = 0;
+		size_t withDictionary = 0;
+		size_t sampleOffset = 0;
+		for (const size_t sampleSize : samples.sizes)
+		{
+			const char *sample = samples.buffer.data() + sampleOffset;
+			withoutDictionary += ZSTD_compressCCtx(context, compressed.data(), compressed.size(), sample, sampleSize, level);
+			withDictionary += ZSTD_compress_usingCDict(context, compressed.data(), compressed.size(), sample, sampleSize, compressionDictionary);
+			sampleOffset += sampleSize;
+		}
+		ZSTD_freeCDict(compressionDictionary);
+		ZSTD_freeCCtx(context);
+
+		cout << std::format(
+					"dictionary: {}\n"
+					"id: {}\n"
+					"size: {}\n"
+					"samples: {} ({} bytes)\n"
+					"level: {}\n"
+					"ratio without dictionary: {:.2f}\n"
+					"ratio with dictionary: {:.2f}",
+					paths[0], ZDICT_getDictID(dictionary.data(), dictionary.size()), dictionary.size(), samples.sizes.size(), samples.buffer.size(), level,
+					static_cast<double>(samples.buffer.size()) / withoutDictionary, static_cast<double>(samples.buffer.size()) / withDictionary
+				)
+			 << endl;
+	}
+	catch (exception &e)
+	{
+		cerr << e.what() << endl;
+		return 1;
+	}
+
+	return 0;
+}
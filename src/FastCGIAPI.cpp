@@ -1,11 +1,25 @@
 
 #include "Compressor.h"
+#include <charconv>
 #include <fstream>
 #include <iostream>
 #include <sstream>
+#include <ranges>
 #include <utility>
+#include <cstring>
 #include <sys/utsname.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <curl/curl.h>
+#include "FCGIBase64.h"
+#include "FCGIConnection.h"
+#include "FCGIUploadSink.h"
+#include "FCGIWorkerPool.h"
 //
 #include "FastCGIAPI.h" // has to be the last one otherwise errors...
 
@@ -26,6 +40,10 @@ void FastCGIAPI::init(const json &configurationRoot, mutex *fcgiAcceptMutex)
 
 	_fcgxFinishDone = false;
 
+	// le coroutine degli AsyncHandler vengono riprese con lo stato (_fcgxFinishDone) della propria richiesta
+	_eventLoop.setResumer([this](void *context, const coroutine_handle<> handle)
+						  { resumeAsyncRequest(*static_cast<AsyncRequest *>(context), handle); });
+
 	{
 		struct utsname unUtsname{};
 		if (uname(&unUtsname) != -1)
@@ -43,6 +61,279 @@ void FastCGIAPI::loadConfiguration(json configurationRoot)
 		", api->maxContentLength: {}",
 		_maxAPIContentLength
 	);
+
+	_maxStreamingContentLength =
+		JSONUtils::as<int64_t>(configurationRoot["api"]["requestBody"], "maxStreamingContentLength", _maxAPIContentLength);
+	LOG_TRACE(
+		"Configuration item"
+		", api->requestBody->maxStreamingContentLength: {}",
+		_maxStreamingContentLength
+	);
+	_requestBodySpoolThreshold = JSONUtils::as<int64_t>(configurationRoot["api"]["requestBody"], "spoolThreshold", static_cast<int64_t>(1024 * 1024));
+	LOG_TRACE(
+		"Configuration item"
+		", api->requestBody->spoolThreshold: {}",
+		_requestBodySpoolThreshold
+	);
+	_requestBodySpoolDirectory = JSONUtils::as<string>(configurationRoot["api"]["requestBody"], "spoolDirectory", "/tmp");
+	LOG_TRACE(
+		"Configuration item"
+		", api->requestBody->spoolDirectory: {}",
+		_requestBodySpoolDirectory
+	);
+
+	_requestArenaSize = JSONUtils::as<int64_t>(configurationRoot["api"], "requestArenaSize", static_cast<int64_t>(64 * 1024));
+	LOG_TRACE(
+		"Configuration item"
+		", api->requestArenaSize: {}",
+		_requestArenaSize
+	);
+	_requestArena = make_unique<FCGIRequestArena>(_requestArenaSize);
+	_currentRequestArena = _requestArena.get();
+	_responseETagEnabled = JSONUtils::as<bool>(configurationRoot["api"], "responseETag", false);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseETag: {}",
+		_responseETagEnabled
+	);
+
+	string acceptMode = JSONUtils::as<string>(configurationRoot["api"], "acceptMode", "mutex");
+	LOG_TRACE(
+		"Configuration item"
+		", api->acceptMode: {}",
+		acceptMode
+	);
+	if (acceptMode == "mutex")
+		_acceptMode = AcceptMode::Mutex;
+	else if (acceptMode == "reusePort")
+		_acceptMode = AcceptMode::ReusePort;
+	else
+	{
+		string errorMessage = std::format(
+			"Wrong api->acceptMode configuration item"
+			", acceptMode: {}",
+			acceptMode
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	_listenAddress = JSONUtils::as<string>(configurationRoot["api"], "listenAddress", "");
+	LOG_TRACE(
+		"Configuration item"
+		", api->listenAddress: {}",
+		_listenAddress
+	);
+	_listenBacklog = JSONUtils::as<int32_t>(configurationRoot["api"], "listenBacklog", 1024);
+	LOG_TRACE(
+		"Configuration item"
+		", api->listenBacklog: {}",
+		_listenBacklog
+	);
+	string transport = JSONUtils::as<string>(configurationRoot["api"], "transport", "libfcgi");
+	LOG_TRACE(
+		"Configuration item"
+		", api->transport: {}",
+		transport
+	);
+	if (transport == "libfcgi")
+		_transport = Transport::LibFcgi;
+	else if (transport == "native")
+		_transport = Transport::Native;
+	else
+	{
+		string errorMessage = std::format(
+			"Wrong api->transport configuration item"
+			", transport: {}",
+			transport
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+	_fcgiMaxConnections = JSONUtils::as<int32_t>(configurationRoot["api"], "fcgiMaxConnections", 1024);
+	LOG_TRACE(
+		"Configuration item"
+		", api->fcgiMaxConnections: {}",
+		_fcgiMaxConnections
+	);
+	_fcgiMaxRequests = JSONUtils::as<int32_t>(configurationRoot["api"], "fcgiMaxRequests", _fcgiMaxConnections);
+	LOG_TRACE(
+		"Configuration item"
+		", api->fcgiMaxRequests: {}",
+		_fcgiMaxRequests
+	);
+
+	_asyncShutdownTimeoutInSeconds = JSONUtils::as<int64_t>(configurationRoot["api"], "asyncShutdownTimeoutInSeconds", 30);
+	LOG_TRACE(
+		"Configuration item"
+		", api->asyncShutdownTimeoutInSeconds: {}",
+		_asyncShutdownTimeoutInSeconds
+	);
+
+	_workerPoolAcceptorThreads = JSONUtils::as<int32_t>(configurationRoot["api"]["workerPool"], "acceptorThreads", 0);
+	LOG_TRACE(
+		"Configuration item"
+		", api->workerPool->acceptorThreads: {}",
+		_workerPoolAcceptorThreads
+	);
+	_workerPoolWorkerQueues = JSONUtils::as<int32_t>(configurationRoot["api"]["workerPool"], "workerQueues", 0);
+	LOG_TRACE(
+		"Configuration item"
+		", api->workerPool->workerQueues: {}",
+		_workerPoolWorkerQueues
+	);
+	const int32_t workerPoolQueueDepth = JSONUtils::as<int32_t>(configurationRoot["api"]["workerPool"], "queueDepth", 1024);
+	LOG_TRACE(
+		"Configuration item"
+		", api->workerPool->queueDepth: {}",
+		workerPoolQueueDepth
+	);
+	if (_workerPoolAcceptorThreads > 0)
+	{
+		if (_transport == Transport::Native || _workerPoolWorkerQueues <= 0)
+		{
+			string errorMessage = std::format(
+				"api->workerPool requires api->transport libfcgi and api->workerPool->workerQueues > 0"
+				", transport: {}"
+				", workerQueues: {}",
+				transport, _workerPoolWorkerQueues
+			);
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+
+		_workerPool = FCGIWorkerPool::processPool(_workerPoolWorkerQueues, workerPoolQueueDepth);
+	}
+
+	const int64_t authorizationCacheMaxEntries = JSONUtils::as<int64_t>(configurationRoot["api"]["authorizationCache"], "maxEntries", 0);
+	LOG_TRACE(
+		"Configuration item"
+		", api->authorizationCache->maxEntries: {}",
+		authorizationCacheMaxEntries
+	);
+	const int64_t authorizationCacheTTLInSeconds = JSONUtils::as<int64_t>(configurationRoot["api"]["authorizationCache"], "ttlInSeconds", 60);
+	LOG_TRACE(
+		"Configuration item"
+		", api->authorizationCache->ttlInSeconds: {}",
+		authorizationCacheTTLInSeconds
+	);
+	if (authorizationCacheMaxEntries > 0)
+		_authorizationCache = FCGIAuthorizationCache::processCache(authorizationCacheMaxEntries, chrono::seconds(authorizationCacheTTLInSeconds));
+
+	// usata solo dalle route con cacheTTL
+	const int64_t responseCacheMaxEntries = JSONUtils::as<int64_t>(configurationRoot["api"]["responseCache"], "maxEntries", 10000);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCache->maxEntries: {}",
+		responseCacheMaxEntries
+	);
+	const int64_t responseCacheMaxBodySize = JSONUtils::as<int64_t>(configurationRoot["api"]["responseCache"], "maxBodySize", 1024 * 1024);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCache->maxBodySize: {}",
+		responseCacheMaxBodySize
+	);
+	if (responseCacheMaxEntries > 0)
+		_responseCache = FCGIResponseCache::processCache(responseCacheMaxEntries, responseCacheMaxBodySize);
+
+	_responseCompressionEnabled = JSONUtils::as<bool>(configurationRoot["api"]["responseCompression"], "enabled", false);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->enabled: {}",
+		_responseCompressionEnabled
+	);
+	_responseCompressionMinSize = JSONUtils::as<int64_t>(configurationRoot["api"]["responseCompression"], "minSize", 1024);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->minSize: {}",
+		_responseCompressionMinSize
+	);
+	const string responseCompressionEncodings = JSONUtils::as<string>(configurationRoot["api"]["responseCompression"], "encodings", "zstd,gzip,deflate");
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->encodings: {}",
+		responseCompressionEncodings
+	);
+	_responseCompressionEncodings = 0;
+	for (const auto encodingName : views::split(responseCompressionEncodings, ','))
+	{
+		const optional<FCGIResponseCompressor::Encoding> encoding = FCGIResponseCompressor::encoding(string_view(encodingName));
+		if (!encoding || *encoding == FCGIResponseCompressor::Encoding::Identity)
+		{
+			string errorMessage = std::format(
+				"Wrong api->responseCompression->encodings"
+				", encodings: {}",
+				responseCompressionEncodings
+			);
+			LOG_ERROR(errorMessage);
+
+			throw runtime_error(errorMessage);
+		}
+		if (!FCGIResponseCompressor::supported(*encoding))
+			LOG_WARN(
+				"Response encoding not supported by this build, ignored"
+				", encoding: {}",
+				string_view(encodingName)
+			);
+		_responseCompressionEncodings |= FCGIResponseCompressor::encodingBit(*encoding);
+	}
+	_gzipCompressionLevel = JSONUtils::as<int32_t>(
+		configurationRoot["api"]["responseCompression"], "gzipLevel", FCGIResponseCompressor::defaultLevel(FCGIResponseCompressor::Encoding::Gzip)
+	);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->gzipLevel: {}",
+		_gzipCompressionLevel
+	);
+	_zstdCompressionLevel = JSONUtils::as<int32_t>(
+		configurationRoot["api"]["responseCompression"], "zstdLevel", FCGIResponseCompressor::defaultLevel(FCGIResponseCompressor::Encoding::Zstd)
+	);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->zstdLevel: {}",
+		_zstdCompressionLevel
+	);
+	const string zstdDictionaryPath =
+		JSONUtils::as<string>(configurationRoot["api"]["responseCompression"]["zstdDictionary"], "path", "");
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->zstdDictionary->path: {}",
+		zstdDictionaryPath
+	);
+	_zstdDictionaryURL = JSONUtils::as<string>(configurationRoot["api"]["responseCompression"]["zstdDictionary"], "url", "");
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->zstdDictionary->url: {}",
+		_zstdDictionaryURL
+	);
+	_zstdDictionaryMinSize = JSONUtils::as<int64_t>(configurationRoot["api"]["responseCompression"]["zstdDictionary"], "minSize", 64);
+	LOG_TRACE(
+		"Configuration item"
+		", api->responseCompression->zstdDictionary->minSize: {}",
+		_zstdDictionaryMinSize
+	);
+	if (!zstdDictionaryPath.empty())
+	{
+		if ((_responseCompressionEncodings & FCGIResponseCompressor::encodingBit(FCGIResponseCompressor::Encoding::Zstd)) == 0)
+			LOG_WARN(
+				"zstd dictionary configured but zstd is not in api->responseCompression->encodings, ignored"
+				", zstdDictionaryPath: {}",
+				zstdDictionaryPath
+			);
+		else
+			_zstdDictionary = FCGIZstdDictionary::processDictionary(zstdDictionaryPath, _zstdCompressionLevel);
+	}
+
+	if (_acceptMode == AcceptMode::ReusePort && _listenAddress.empty())
+	{
+		string errorMessage = "api->listenAddress is mandatory when api->acceptMode is reusePort";
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
 }
 
 int FastCGIAPI::operator()()
@@ -55,114 +346,490 @@ int FastCGIAPI::operator()()
 		sThreadId = ss.str();
 	}
 
-	FCGX_Request request;
+	// con il worker pool i primi _workerPoolAcceptorThreads thread accettano le richieste,
+	// gli altri le gestiscono (e non aprono nessun socket)
+	if (_workerPool)
+	{
+		if (const int32_t threadIndex = _workerPool->registerThread(); threadIndex >= _workerPoolAcceptorThreads)
+		{
+			const int32_t workerIndex = threadIndex - _workerPoolAcceptorThreads;
+			LOG_INFO(
+				"FastCGIAPI worker thread"
+				", threadId: {}"
+				", workerIndex: {}"
+				", workerQueue: {}",
+				sThreadId, workerIndex, workerIndex % _workerPoolWorkerQueues
+			);
+
+			workerRequestsLoop(sThreadId, workerIndex);
+
+			LOG_INFO(
+				"FastCGIAPI shutdown"
+				", threadId: {}"
+				", requestArenaHighWaterMark: {}"
+				", processRequestArenaHighWaterMark: {}"
+				", processRequestArenaOverflows: {}",
+				sThreadId, _requestArena->highWaterMark(), FCGIRequestArena::processHighWaterMark(), FCGIRequestArena::processOverflows()
+			);
+
+			return 0;
+		}
+	}
 
 	// 0 is file number for STDIN by default
 	// The fastcgi process is launched by spawn-fcgi (see scripts/mmsApi.sh
 	// scripts/mmsEncoder.sh) specifying the port to be used to listen to nginx
 	// calls The nginx process is configured to proxy the requests to
 	// 127.0.0.1:<port> specified by spawn-fcgi
+	// In case of AcceptMode::ReusePort the process is not launched by spawn-fcgi
+	// and every thread opens its own socket on api->listenAddress
 	int sock_fd = 0;
+	if (_acceptMode == AcceptMode::ReusePort)
+	{
+		try
+		{
+			sock_fd = openReusePortSocket(_listenAddress, _listenBacklog);
+		}
+		catch (exception &e)
+		{
+			LOG_ERROR(
+				"openReusePortSocket failed"
+				", threadId: {}"
+				", exception: {}",
+				sThreadId, e.what()
+			);
+
+			return 1;
+		}
+		lock_guard<mutex> locker(_listenSocketMutex);
+		_listenSocket = sock_fd;
+	}
 	LOG_TRACE(
 		"FastCGIAPI::FCGX_OpenSocket"
 		", threadId: {}"
 		", sock_fd: {}",
 		sThreadId, sock_fd
 	);
-	FCGX_InitRequest(&request, sock_fd, 0);
+
+	if (_transport == Transport::Native)
+		nativeRequestsLoop(sThreadId, sock_fd);
+	else if (_workerPool)
+		acceptorRequestsLoop(sThreadId, sock_fd);
+	else
+		fcgiRequestsLoop(sThreadId, sock_fd);
+
+	if (_acceptMode == AcceptMode::ReusePort)
+	{
+		lock_guard<mutex> locker(_listenSocketMutex);
+		close(sock_fd);
+		_listenSocket = -1;
+	}
+
+	LOG_INFO(
+		"FastCGIAPI shutdown"
+		", threadId: {}"
+		", requestArenaHighWaterMark: {}"
+		", processRequestArenaHighWaterMark: {}"
+		", processRequestArenaOverflows: {}",
+		sThreadId, _requestArena->highWaterMark(), FCGIRequestArena::processHighWaterMark(), FCGIRequestArena::processOverflows()
+	);
+
+	return 0;
+}
+
+void FastCGIAPI::fcgiRequestsLoop(const string &sThreadId, const int sock_fd)
+{
+	// la FCGX_Request viene riusata per tutte le richieste, tranne quando un AsyncHandler si sospende:
+	// in questo caso passa all'AsyncRequest e ne viene allocata una nuova
+	FCGXRequestPtr request(new FCGX_Request());
+	FCGX_InitRequest(request.get(), sock_fd, 0);
 
 	while (!_shutdown)
 	{
-		int returnAcceptCode;
+		// con AsyncHandler sospesi il thread non può bloccarsi in FCGX_Accept_r:
+		// attende il socket in listen insieme all'event loop
+		const bool asyncRequestsPending = !_asyncRequests.empty();
+		if (asyncRequestsPending && !waitListenSocket(request->ipcFd != -1 ? request->ipcFd : sock_fd))
+			continue;
+
+		if (!acceptRequest(sThreadId, *request, sock_fd, !asyncRequestsPending))
+			continue;
+
+		if (processRequest(sThreadId, *request))
 		{
-			LOG_TRACE(
-				"FastCGIAPI::ready"
-				", threadId: {}",
-				sThreadId
-			);
-			lock_guard locker(*_fcgiAcceptMutex);
+			_asyncRequests.back()->ownedRequest = std::move(request);
+			request.reset(new FCGX_Request());
+			FCGX_InitRequest(request.get(), sock_fd, 0);
+		}
 
-			LOG_TRACE(
-				"FastCGIAPI::listen"
-				", threadId: {}",
-				sThreadId
-			);
+		// Note: the fcgi_streambuf destructor will auto flush
+	}
 
-			if (_shutdown)
-				continue;
+	drainAsyncRequests();
+}
 
-			/*
-			Con FastCGI (fcgiapp) bisogna serializzare FCGX_Accept_r se:
-			- usi lo stesso socket
-			- la libreria non è thread-safe per accept concorrenti
-			Per questo si utilizza il mutex.
-			*/
-			returnAcceptCode = FCGX_Accept_r(&request);
-		}
-		LOG_TRACE(
-			"FCGX_Accept_r"
+void FastCGIAPI::acceptorRequestsLoop(const string &sThreadId, const int sock_fd)
+{
+	// il thread accetta solamente le richieste e le passa ai worker tramite _workerPool.
+	// Ogni richiesta in coda ha la propria FCGX_Request, rilasciata (e la connessione chiusa, vedi FCGXRequestDeleter)
+	// dal worker dopo finishRequest
+	while (!_shutdown)
+	{
+		FCGXRequestPtr request(new FCGX_Request());
+		FCGX_InitRequest(request.get(), sock_fd, 0);
+
+		if (!acceptRequest(sThreadId, *request, sock_fd, true))
+			continue;
+
+		if (_workerPool->push(std::move(request)))
+			continue;
+
+		// coda piena (o pool chiuso dallo shutdown dei worker): la richiesta viene rifiutata subito
+		// invece di lasciarla scadere in nginx
+		LOG_WARN(
+			"FCGIWorkerPool queue is full or closed, request rejected"
 			", threadId: {}"
-			", returnAcceptCode: {}",
-			sThreadId, returnAcceptCode
+			", queued: {}",
+			sThreadId, _workerPool->queued()
 		);
 
-		if (returnAcceptCode != 0)
-		{
-			_shutdown = true;
+		rejectRequest(*request);
+	}
+}
+
+void FastCGIAPI::rejectRequest(FCGX_Request &request)
+{
+	_fcgxFinishDone = false;
+	sendError(request, 503, FastCGIError::HTTPError::getHtmlStandardMessage(503));
+	if (!_fcgxFinishDone)
+		finishRequest(request);
+}
 
-			FCGX_Finish_r(&request);
+void FastCGIAPI::workerRequestsLoop(const string &sThreadId, const int32_t workerIndex)
+{
+	_workerPool->workerStarted();
 
-			continue;
-		}
+	while (!_shutdown)
+	{
+		// timeout per controllare periodicamente _shutdown,
+		// con AsyncHandler sospesi il thread non si blocca sulla coda ma fa girare l'event loop
+		FCGXRequestPtr request = _workerPool->pop(workerIndex, chrono::milliseconds(_asyncRequests.empty() ? 1000 : 0));
+		const bool requestReceived = request != nullptr;
+		if (requestReceived && processRequest(sThreadId, *request))
+			_asyncRequests.back()->ownedRequest = std::move(request);
+
+		if (!_asyncRequests.empty())
+			_eventLoop.runOnce(requestReceived ? 0 : 1);
+	}
+
+	drainAsyncRequests();
+
+	// l'ultimo worker risponde alle richieste rimaste in coda, che altrimenti resterebbero senza risposta
+	const vector<FCGXRequestPtr> queuedRequests = _workerPool->workerStopped();
+	if (!queuedRequests.empty())
+		LOG_WARN(
+			"FastCGIAPI shutdown, queued requests rejected"
+			", threadId: {}"
+			", queuedRequests: {}",
+			sThreadId, queuedRequests.size()
+		);
+	for (const FCGXRequestPtr &request : queuedRequests)
+		rejectRequest(*request);
+}
 
-		_fcgxFinishDone = false;
+bool FastCGIAPI::acceptRequest(const string &sThreadId, FCGX_Request &request, const int sock_fd, const bool blocking)
+{
+	int returnAcceptCode;
+	{
+		LOG_TRACE(
+			"FastCGIAPI::ready"
+			", threadId: {}",
+			sThreadId
+		);
+		unique_lock<mutex> locker;
+		if (_acceptMode == AcceptMode::Mutex)
+			locker = unique_lock(*_fcgiAcceptMutex);
 
 		LOG_TRACE(
-			"Request to be managed"
+			"FastCGIAPI::listen"
 			", threadId: {}",
 			sThreadId
 		);
 
-		FCGIRequestData requestData;
-		try
+		if (_shutdown)
+			return false;
+
+		// non bloccante: waitListenSocket ha segnalato il socket pronto ma, senza il socket
+		// dedicato (ReusePort), un altro thread potrebbe aver già preso la connessione
+		if (!blocking && _acceptMode == AcceptMode::Mutex && !socketReadable(request.ipcFd != -1 ? request.ipcFd : sock_fd, 0))
+			return false;
+
+		/*
+		Con FastCGI (fcgiapp) bisogna serializzare FCGX_Accept_r se:
+		- usi lo stesso socket
+		- la libreria non è thread-safe per accept concorrenti
+		Per questo si utilizza il mutex.
+		Con AcceptMode::ReusePort il socket è del singolo thread e il mutex non serve.
+		*/
+		returnAcceptCode = FCGX_Accept_r(&request);
+	}
+	LOG_TRACE(
+		"FCGX_Accept_r"
+		", threadId: {}"
+		", returnAcceptCode: {}",
+		sThreadId, returnAcceptCode
+	);
+
+	if (returnAcceptCode != 0)
+	{
+		_shutdown = true;
+
+		FCGX_Finish_r(&request);
+
+		return false;
+	}
+
+	return true;
+}
+
+void FastCGIAPI::nativeRequestsLoop(const string &sThreadId, const int sock_fd)
+{
+	// Il socket in listen viene messo non bloccante: più thread possono fare poll sullo stesso
+	// socket (AcceptMode::Mutex) e chi perde la accept riceve EAGAIN, per cui il mutex non serve.
+	// Ogni thread gestisce le proprie connessioni (keep-alive) e le relative richieste una alla volta
+	if (const int flags = fcntl(sock_fd, F_GETFL); flags == -1 || fcntl(sock_fd, F_SETFL, flags | O_NONBLOCK) == -1)
+	{
+		LOG_ERROR(
+			"fcntl O_NONBLOCK failed"
+			", threadId: {}"
+			", sock_fd: {}"
+			", errno: {}",
+			sThreadId, sock_fd, strerror(errno)
+		);
+
+		return;
+	}
+
+	vector<unique_ptr<FCGIConnection>> connections;
+	vector<pollfd> pollFds;
+	while (!_shutdown)
+	{
+		bool bufferedInput = false;
+
+		pollFds.clear();
+		pollFds.push_back({sock_fd, static_cast<short>(_nativeConnectionsNumber < _fcgiMaxConnections ? POLLIN : 0), 0});
+		for (const auto &connection : connections)
 		{
-			requestData.init(request, _maxAPIContentLength);
+			// la connessione con un AsyncHandler sospeso viene letta solo dopo il termine della richiesta
+			// (fd -1: la connessione busy, o chiusa, viene ignorata da poll, altrimenti POLLHUP/POLLERR, riportati anche
+			// con events 0, lo sveglierebbero ad ogni iterazione se il peer chiude durante la sospensione)
+			pollFds.push_back({connection->closed() || connection->busy() ? -1 : connection->socket(), POLLIN, 0});
+			bufferedInput |= !connection->busy() && connection->hasBufferedInput();
 		}
-		catch (exception &e)
-		{
-			LOG_ERROR(e.what());
+		pollFds.push_back({_eventLoop.fd(), POLLIN, 0});
 
-			sendError(request, 500, e.what());
+		// timeout per controllare periodicamente _shutdown
+		int timeout = bufferedInput ? 0 : 1000;
+		if (const int eventLoopTimeout = _eventLoop.nextTimeout(); eventLoopTimeout != -1)
+			timeout = min(timeout, eventLoopTimeout);
+		if (poll(pollFds.data(), pollFds.size(), timeout) == -1)
+		{
+			if (errno == EINTR)
+				continue;
 
-			if (!_fcgxFinishDone)
-				FCGX_Finish_r(&request);
+			LOG_ERROR(
+				"poll failed"
+				", threadId: {}"
+				", errno: {}",
+				sThreadId, strerror(errno)
+			);
+			_shutdown = true;
 
-			// throw runtime_error(errorMessage);
 			continue;
 		}
 
-		bool authorizationPresent = basicAuthenticationRequired(requestData);
-		if (authorizationPresent)
+		// le connessioni già esistenti vengono servite prima di accettarne di nuove
+		for (size_t connectionIndex = 0; connectionIndex < connections.size(); connectionIndex++)
 		{
-			try
-			{
-				string authorization = requestData.getHeaderParameter("authorization", "", true);
+			FCGIConnection &connection = *connections[connectionIndex];
+			if ((pollFds[connectionIndex + 1].revents == 0 && !connection.hasBufferedInput()) || connection.closed() || connection.busy())
+				continue;
 
-				string authorizationPrefix = "Basic ";
-				if (!authorization.starts_with(authorizationPrefix))
-				{
-					LOG_ERROR(
-						"No 'Basic' authorization is present into the request"
-						", threadId: {}"
-						", Authorization: {}",
-						sThreadId, authorization
-					);
+			// se l'AsyncHandler si sospende la FCGX_Request resta del FCGIConnection (busy) fino a finishRequest
+			if (FCGX_Request *request = connection.readRequest(); request != nullptr)
+				processRequest(sThreadId, *request);
+		}
 
-					throw FastCGIError::HTTPError(401);
-				}
+		if (!_asyncRequests.empty() || pollFds.back().revents != 0)
+			_eventLoop.runOnce(0);
 
-				string usernameAndPasswordBase64 = authorization.substr(authorizationPrefix.length());
-				string usernameAndPassword = base64_decode(usernameAndPasswordBase64);
+		if (pollFds[0].revents & POLLIN)
+		{
+			const int connectionSocket = accept4(sock_fd, nullptr, nullptr, SOCK_CLOEXEC);
+			if (connectionSocket != -1)
+			{
+				++_nativeConnectionsNumber;
+				connections.push_back(make_unique<FCGIConnection>(connectionSocket, _fcgiMaxConnections, _fcgiMaxRequests));
+
+				LOG_TRACE(
+					"FastCGIAPI::accept"
+					", threadId: {}"
+					", connectionSocket: {}"
+					", nativeConnectionsNumber: {}",
+					sThreadId, connectionSocket, _nativeConnectionsNumber.load()
+				);
+			}
+			else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR && errno != ECONNABORTED)
+			{
+				LOG_ERROR(
+					"accept failed"
+					", threadId: {}"
+					", errno: {}",
+					sThreadId, strerror(errno)
+				);
+				// stesso comportamento di FCGX_Accept_r in errore
+				_shutdown = true;
+			}
+		}
+
+		const size_t connectionsBefore = connections.size();
+		// la connessione chiusa con un AsyncHandler sospeso resta viva fino al suo finishRequest:
+		// l'AsyncRequest usa la FCGX_Request che appartiene al FCGIConnection
+		erase_if(connections, [](const unique_ptr<FCGIConnection> &connection) { return connection->closed() && !connection->busy(); });
+		_nativeConnectionsNumber -= static_cast<int32_t>(connectionsBefore - connections.size());
+	}
+
+	// le richieste sospese usano le connessioni, che vanno chiuse dopo
+	drainAsyncRequests();
+
+	_nativeConnectionsNumber -= static_cast<int32_t>(connections.size());
+}
+
+void FastCGIAPI::finishRequest(FCGX_Request &request)
+{
+	if (FCGIConnection::isNativeRequest(request))
+		FCGIConnection::finishRequest(request);
+	else
+		FCGX_Finish_r(&request);
+}
+
+bool FastCGIAPI::processRequest(const string &sThreadId, FCGX_Request &request)
+{
+	// requestData e tutto ciò che usa l'arena vengono distrutti dentro manageRequest, prima del reset
+	const bool asyncRequestSuspended = manageRequest(sThreadId, request);
+	_currentRequestData = nullptr;
+	if (asyncRequestSuspended)
+	{
+		// l'arena resta all'AsyncRequest fino al termine della coroutine, il thread ne usa una nuova
+		_asyncRequests.back()->requestArena = std::move(_requestArena);
+		_requestArena = make_unique<FCGIRequestArena>(_requestArenaSize);
+		_currentRequestArena = _requestArena.get();
+
+		return true;
+	}
+
+	_requestArena->reset();
+
+	return false;
+}
+
+bool FastCGIAPI::manageRequest(const string &sThreadId, FCGX_Request &request)
+{
+	_fcgxFinishDone = false;
+
+	LOG_TRACE(
+		"Request to be managed"
+		", threadId: {}",
+		sThreadId
+	);
+
+	// nello heap perchè, se un AsyncHandler si sospende, deve sopravvivere a processRequest
+	auto ownedRequestData = make_unique<FCGIRequestData>(_requestArena.get());
+	FCGIRequestData &requestData = *ownedRequestData;
+	_currentRequestData = &requestData;
+	string allowedMethods;
+	try
+	{
+		// il body viene letto solo dopo l'autorizzazione (vedi initRequestBody)
+		requestData.initEnvironment(request);
+		allowedMethods = routeRequest(requestData);
+		negotiateResponseEncoding(requestData);
+	}
+	catch (exception &e)
+	{
+		LOG_ERROR(e.what());
+
+		sendError(request, 500, e.what());
+
+		if (!_fcgxFinishDone)
+			finishRequest(request);
+
+		// throw runtime_error(errorMessage);
+		return false;
+	}
+
+	if (!allowedMethods.empty())
+	{
+		sendMethodNotAllowed(request, allowedMethods);
+
+		if (!_fcgxFinishDone)
+			finishRequest(request);
+
+		return false;
+	}
+
+	// basicAuthenticationRequired solo se la route non indica authorizationRequired
+	optional<bool> routeAuthorizationRequired;
+	if (requestData.routeIndex >= 0)
+		routeAuthorizationRequired = _router.route(requestData.routeIndex).options.authorizationRequired;
+	const bool authorizationPresent = routeAuthorizationRequired ? *routeAuthorizationRequired : basicAuthenticationRequired(requestData);
+	if (authorizationPresent)
+	{
+		try
+		{
+			// valore non decodificato: con getHeaderParameter i '+' del base64 diventerebbero spazi
+			const optional<string_view> authorizationHeader = requestData.getRawHeaderParameter(FCGIRequestData::authorizationHeader);
+			if (!authorizationHeader)
+			{
+				const string errorMessage = std::format("Missing mandatory header/query parameter: {}", FCGIRequestData::authorizationHeader.cgiName());
+				LOG_ERROR(errorMessage);
+				throw FastCGIError::HTTPError(400, errorMessage);
+			}
+			string authorization(*authorizationHeader);
+
+			string authorizationPrefix = "Basic ";
+			if (!authorization.starts_with(authorizationPrefix))
+			{
+				LOG_ERROR(
+					"No 'Basic' authorization is present into the request"
+					", threadId: {}"
+					", Authorization: {}",
+					sThreadId, authorization
+				);
+
+				throw FastCGIError::HTTPError(401);
+			}
+
+			string usernameAndPasswordBase64 = authorization.substr(authorizationPrefix.length());
+			// credenziali già verificate: nessuna decodifica e nessuna chiamata a checkAuthorization
+			if (_authorizationCache)
+				requestData.authorizationDetails = _authorizationCache->find(usernameAndPasswordBase64);
+			if (!requestData.authorizationDetails)
+			{
+				auto decodedUsernameAndPassword = FCGIBase64::decode(usernameAndPasswordBase64);
+				if (!decodedUsernameAndPassword)
+				{
+					LOG_ERROR(
+						"Wrong Authorization format"
+						", threadId: {}"
+						", usernameAndPasswordBase64: {}"
+						", error: {}",
+						sThreadId, usernameAndPasswordBase64, decodedUsernameAndPassword.error().message()
+					);
+
+					throw FastCGIError::HTTPError(401);
+				}
+				string usernameAndPassword = std::move(*decodedUsernameAndPassword);
 				LOG_TRACE("Credentials"
 					", usernameAndPasswordBase64: {}"
 					", usernameAndPassword: {}", usernameAndPasswordBase64, usernameAndPassword
@@ -184,102 +851,147 @@ int FastCGIAPI::operator()()
 				string userName = usernameAndPassword.substr(0, userNameSeparator);
 				string password = usernameAndPassword.substr(userNameSeparator + 1);
 
+				// prima di checkAuthorization: una invalidateAuthorization durante la verifica scarta l'inserimento
+				const uint64_t authorizationCacheGeneration = _authorizationCache ? _authorizationCache->generation() : 0;
 				requestData.authorizationDetails = checkAuthorization(sThreadId, requestData, userName, password);
+				if (_authorizationCache && requestData.authorizationDetails)
+					_authorizationCache->insert(usernameAndPasswordBase64, userName, requestData.authorizationDetails, authorizationCacheGeneration);
 			}
-			catch (exception &e)
-			{
-				auto method = requestData.getQueryParameter("x-api-method");
-				LOG_ERROR(
-					"checkAuthorization failed"
-					", threadId: {}"
-					", clientIPAddress: {}"
-					", method: {}"
-					", requestURI: {}"
-					", e.what(): {}",
-					sThreadId, requestData.clientIPAddress, method, requestData.requestURI, e.what()
-				);
+		}
+		catch (exception &e)
+		{
+			auto method = requestData.getQueryParameter("x-api-method");
+			LOG_ERROR(
+				"checkAuthorization failed"
+				", threadId: {}"
+				", clientIPAddress: {}"
+				", method: {}"
+				", requestURI: {}"
+				", e.what(): {}",
+				sThreadId, requestData.clientIPAddress, method, requestData.requestURI, e.what()
+			);
 
-				int htmlResponseCode = 500;
-				if (dynamic_cast<FastCGIError::HTTPError*>(&e))
-					htmlResponseCode = dynamic_cast<FastCGIError::HTTPError*>(&e)->httpErrorCode;
+			int htmlResponseCode = 500;
+			if (dynamic_cast<FastCGIError::HTTPError*>(&e))
+				htmlResponseCode = dynamic_cast<FastCGIError::HTTPError*>(&e)->httpErrorCode;
 
-				string errorMessage = FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode);
-				LOG_ERROR(errorMessage);
+			string errorMessage(FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode));
+			LOG_ERROR(errorMessage);
 
-				sendError(request, htmlResponseCode, errorMessage); // unauthorized
+			sendError(request, htmlResponseCode, errorMessage); // unauthorized
 
-				if (!_fcgxFinishDone)
-					FCGX_Finish_r(&request);
+			if (!_fcgxFinishDone)
+				finishRequest(request);
 
-				//  throw runtime_error(errorMessage);
-				continue;
-			}
+			//  throw runtime_error(errorMessage);
+			return false;
 		}
+	}
 
-		{
-			shared_ptr<ThreadLogger> threadLogger = requestThreadLogger(requestData);
+	// la route e l'handler (x-api-method) determinano le opzioni del body
+	try
+	{
+		requestData.initRequestBody(request, _maxAPIContentLength, requestBodyOptions(requestData));
+	}
+	catch (exception &e)
+	{
+		LOG_ERROR(e.what());
 
-			auto method = requestData.getQueryParameter("x-api-method", "", false);
+		sendError(request, 500, e.what());
 
-			chrono::system_clock::time_point startManageRequest = chrono::system_clock::now();
-			try
-			{
-				manageRequestAndResponse(sThreadId, request, requestData);
-			}
-			catch (exception &e)
-			{
-				LOG_ERROR(
-					"manageRequestAndResponse failed"
-					", threadId: {}"
-					", clientIPAddress: @{}@"
-					", method: @{}@"
-					", requestURI: {}"
-					", authorizationPresent: {}"
-					", exception: {}",
-					sThreadId, requestData.clientIPAddress, method, requestData.requestURI, authorizationPresent, e.what()
-				);
-			}
-			if (!requestData.requestURI.ends_with("/status"))
-			{
-				LOG_DEBUG(
-					"manageRequestAndResponse"
-					", threadId: {}"
-					", clientIPAddress: @{}@"
-					", method: @{}@"
-					", requestURI: {}"
-					", authorizationPresent: {}"
-					", @MMS statistics@ - manageRequestDuration (millisecs): @{}@",
-					sThreadId, requestData.clientIPAddress, method, requestData.requestURI, authorizationPresent,
-					chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() - startManageRequest).count()
-				);
-			}
+		if (!_fcgxFinishDone)
+			finishRequest(request);
+
+		return false;
+	}
+
+	// risposta in cache: l'handler non viene eseguito
+	setResponseCacheKey(requestData);
+	if (!requestData.responseCacheKey.empty() && sendCachedResponse(sThreadId, request, requestData))
+		return false;
+
+	{
+		shared_ptr<ThreadLogger> threadLogger = requestThreadLogger(requestData);
+
+		auto method = requestData.getQueryParameter("x-api-method", "", false);
+
+		chrono::system_clock::time_point startManageRequest = chrono::system_clock::now();
+		try
+		{
+			manageRequestAndResponse(sThreadId, request, requestData);
+		}
+		catch (exception &e)
+		{
+			LOG_ERROR(
+				"manageRequestAndResponse failed"
+				", threadId: {}"
+				", clientIPAddress: @{}@"
+				", method: @{}@"
+				", requestURI: {}"
+				", authorizationPresent: {}"
+				", exception: {}",
+				sThreadId, requestData.clientIPAddress, method, requestData.requestURI, authorizationPresent, e.what()
+			);
 		}
+		if (!requestData.requestURI.ends_with("/status"))
+		{
+			LOG_DEBUG(
+				"manageRequestAndResponse"
+				", threadId: {}"
+				", clientIPAddress: @{}@"
+				", method: @{}@"
+				", requestURI: {}"
+				", authorizationPresent: {}"
+				", @MMS statistics@ - manageRequestDuration (millisecs): @{}@",
+				sThreadId, requestData.clientIPAddress, method, requestData.requestURI, authorizationPresent,
+				chrono::duration_cast<chrono::milliseconds>(chrono::system_clock::now() - startManageRequest).count()
+			);
+		}
+	}
+
+	if (_suspendedAsyncRequest)
+	{
+		// la richiesta verrà chiusa da resumeAsyncRequest al termine della coroutine
+		_suspendedAsyncRequest->requestData = std::move(ownedRequestData);
+		_asyncRequests.push_back(std::move(_suspendedAsyncRequest));
 
 		LOG_TRACE(
-			"FastCGIAPI::request finished"
-			", threadId: {}",
-			sThreadId
+			"FastCGIAPI::request suspended"
+			", threadId: {}"
+			", asyncRequests: {}",
+			sThreadId, _asyncRequests.size()
 		);
 
-		if (!_fcgxFinishDone)
-			FCGX_Finish_r(&request);
-
-		// Note: the fcgi_streambuf destructor will auto flush
+		return true;
 	}
 
-	LOG_INFO(
-		"FastCGIAPI shutdown"
+	LOG_TRACE(
+		"FastCGIAPI::request finished"
 		", threadId: {}",
 		sThreadId
 	);
 
-	return 0;
+	if (!_fcgxFinishDone)
+		finishRequest(request);
+
+	return false;
 }
 
 bool FastCGIAPI::handleRequest(
 	const string_view &sThreadId, FCGX_Request &request,
 	const FCGIRequestData& requestData, const bool exceptionIfNotManaged)
 {
+	if (requestData.routeIndex >= 0)
+	{
+		const Handlers &routeHandlers = _routeHandlers[requestData.routeIndex];
+		if (routeHandlers.asyncHandler)
+			startAsyncHandler(routeHandlers.asyncHandler, sThreadId, request, requestData);
+		else
+			routeHandlers.handler(sThreadId, request, requestData);
+
+		return false;
+	}
+
 	bool isParamPresent;
 	const string method = requestData.getQueryParameter("x-api-method", "", false, {}, &isParamPresent);
 	if (!isParamPresent)
@@ -298,35 +1010,577 @@ bool FastCGIAPI::handleRequest(
 		return true; // request not managed
 	}
 
-	const auto handlerIt = _handlers.find(method);
-	if (handlerIt == _handlers.end())
+	const auto handlerIt = _handlers.find(method);
+	if (handlerIt != _handlers.end())
+	{
+		handlerIt->second(sThreadId, request, requestData);
+
+		return false;
+	}
+
+	const auto asyncHandlerIt = _asyncHandlers.find(method);
+	if (asyncHandlerIt == _asyncHandlers.end())
+	{
+		if (exceptionIfNotManaged)
+		{
+			string errorMessage = std::format(
+				"request is not managed because no registration found for method {}"
+				", threadId: {}"
+				", requestURI: {}"
+				", requestMethod: {}",
+				method, sThreadId, requestData.requestURI, requestData.requestMethod);
+			LOG_ERROR(errorMessage);
+			throw runtime_error(errorMessage);
+		}
+		return true; // request not managed
+	}
+
+	startAsyncHandler(asyncHandlerIt->second, sThreadId, request, requestData);
+
+	return false;
+}
+
+void FastCGIAPI::startAsyncHandler(
+	const AsyncHandler &asyncHandler, const string_view sThreadId, FCGX_Request &request, const FCGIRequestData &requestData
+)
+{
+	auto asyncRequest = make_unique<AsyncRequest>();
+	asyncRequest->request = &request;
+	asyncRequest->task = asyncHandler(sThreadId, request, requestData);
+
+	// la coroutine gira fino alla prima sospensione, i waiter registrati ricordano asyncRequest
+	_eventLoop.setCurrentContext(asyncRequest.get());
+	asyncRequest->task.resume();
+	_eventLoop.setCurrentContext(nullptr);
+
+	if (asyncRequest->task.done())
+	{
+		// terminata senza sospendersi: come un Handler sincrono
+		asyncRequest->task.rethrowIfFailed();
+
+		return;
+	}
+
+	asyncRequest->fcgxFinishDone = _fcgxFinishDone;
+	_suspendedAsyncRequest = std::move(asyncRequest);
+}
+
+void FastCGIAPI::resumeAsyncRequest(AsyncRequest &asyncRequest, const coroutine_handle<> handle)
+{
+	// _fcgxFinishDone e l'arena corrente sono dell'istanza: vengono salvati/ripristinati intorno alla ripresa della coroutine
+	const bool fcgxFinishDone = _fcgxFinishDone;
+	_fcgxFinishDone = asyncRequest.fcgxFinishDone;
+	FCGIRequestArena *currentRequestArena = _currentRequestArena;
+	_currentRequestArena = asyncRequest.requestArena.get();
+	const FCGIRequestData *currentRequestData = _currentRequestData;
+	_currentRequestData = asyncRequest.requestData.get();
+
+	handle.resume();
+
+	if (asyncRequest.task.done())
+	{
+		try
+		{
+			asyncRequest.task.rethrowIfFailed();
+		}
+		catch (exception &e)
+		{
+			LOG_ERROR(
+				"AsyncHandler failed"
+				", requestURI: {}"
+				", exception: {}",
+				asyncRequest.requestData->requestURI, e.what()
+			);
+
+			if (!_fcgxFinishDone)
+				sendError(*asyncRequest.request, 500, e.what());
+		}
+
+		if (!_fcgxFinishDone)
+			finishRequest(*asyncRequest.request);
+
+		erase_if(_asyncRequests, [&asyncRequest](const unique_ptr<AsyncRequest> &pendingRequest) { return pendingRequest.get() == &asyncRequest; });
+	}
+	else
+		asyncRequest.fcgxFinishDone = _fcgxFinishDone;
+
+	_fcgxFinishDone = fcgxFinishDone;
+	_currentRequestArena = currentRequestArena;
+	_currentRequestData = currentRequestData;
+}
+
+bool FastCGIAPI::waitListenSocket(const int sock_fd)
+{
+	pollfd pollFds[2] = {{sock_fd, POLLIN, 0}, {_eventLoop.fd(), POLLIN, 0}};
+
+	// timeout per controllare periodicamente _shutdown
+	int timeout = 1000;
+	if (const int eventLoopTimeout = _eventLoop.nextTimeout(); eventLoopTimeout != -1)
+		timeout = min(timeout, eventLoopTimeout);
+	if (poll(pollFds, size(pollFds), timeout) == -1)
+		return false;
+
+	_eventLoop.runOnce(0);
+
+	return (pollFds[0].revents & POLLIN) != 0;
+}
+
+bool FastCGIAPI::socketReadable(const int socket, const int timeoutMilliseconds)
+{
+	pollfd pollFd{socket, POLLIN, 0};
+
+	return poll(&pollFd, 1, timeoutMilliseconds) == 1 && (pollFd.revents & POLLIN) != 0;
+}
+
+void FastCGIAPI::drainAsyncRequests()
+{
+	if (_asyncRequests.empty())
+		return;
+
+	LOG_INFO(
+		"FastCGIAPI shutdown, waiting for the suspended AsyncHandler"
+		", asyncRequests: {}",
+		_asyncRequests.size()
+	);
+
+	// una coroutine in attesa di un fd che non diventa mai pronto bloccherebbe lo shutdown per sempre
+	const auto deadline = chrono::steady_clock::now() + chrono::seconds(_asyncShutdownTimeoutInSeconds);
+	while (!_asyncRequests.empty() && chrono::steady_clock::now() < deadline)
+		_eventLoop.runOnce(1000);
+
+	if (_asyncRequests.empty())
+		return;
+
+	LOG_WARN(
+		"FastCGIAPI shutdown, suspended AsyncHandler abandoned"
+		", asyncRequests: {}"
+		", asyncShutdownTimeoutInSeconds: {}",
+		_asyncRequests.size(), _asyncShutdownTimeoutInSeconds
+	);
+
+	for (const unique_ptr<AsyncRequest> &asyncRequest : _asyncRequests)
+	{
+		_eventLoop.cancel(asyncRequest.get());
+
+		// sendError chiude anche la richiesta
+		_fcgxFinishDone = asyncRequest->fcgxFinishDone;
+		if (!_fcgxFinishDone)
+			sendError(*asyncRequest->request, 503, FastCGIError::HTTPError::getHtmlStandardMessage(503));
+	}
+	_fcgxFinishDone = false;
+	// distrugge le coroutine (i waiter sono già stati rimossi dal loop) e rilascia le richieste
+	_asyncRequests.clear();
+}
+
+void FastCGIAPI::stopFastcgi()
+{
+	_shutdown = true;
+
+	// il thread potrebbe essere bloccato in FCGX_Accept_r sul proprio socket:
+	// lo shutdown del socket fa fallire l'accept e il thread esce dal loop
+	if (_acceptMode == AcceptMode::ReusePort)
+	{
+		lock_guard<mutex> locker(_listenSocketMutex);
+		if (_listenSocket != -1)
+			shutdown(_listenSocket, SHUT_RDWR);
+	}
+}
+
+int FastCGIAPI::openReusePortSocket(const string &listenAddress, const int listenBacklog)
+{
+	// listenAddress: <host>:<port> oppure [<ipv6>]:<port>
+	const size_t portSeparator = listenAddress.rfind(':');
+	if (portSeparator == string::npos)
+	{
+		string errorMessage = std::format(
+			"Wrong listenAddress format, expected <host>:<port>"
+			", listenAddress: {}",
+			listenAddress
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+	string host = listenAddress.substr(0, portSeparator);
+	if (host.size() >= 2 && host.front() == '[' && host.back() == ']')
+		host = host.substr(1, host.size() - 2);
+	const string port = listenAddress.substr(portSeparator + 1);
+
+	addrinfo hints{};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_flags = AI_PASSIVE;
+
+	addrinfo *addresses = nullptr;
+	if (const int returnCode = getaddrinfo(host.empty() ? nullptr : host.c_str(), port.c_str(), &hints, &addresses); returnCode != 0)
+	{
+		string errorMessage = std::format(
+			"getaddrinfo failed"
+			", listenAddress: {}"
+			", error: {}",
+			listenAddress, gai_strerror(returnCode)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	int listenSocket = -1;
+	int lastErrno = 0;
+	for (const addrinfo *address = addresses; address != nullptr; address = address->ai_next)
+	{
+		listenSocket = socket(address->ai_family, address->ai_socktype | SOCK_CLOEXEC, address->ai_protocol);
+		if (listenSocket == -1)
+		{
+			lastErrno = errno;
+			continue;
+		}
+
+		int enable = 1;
+		if (setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) == 0
+			&& setsockopt(listenSocket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == 0
+			&& bind(listenSocket, address->ai_addr, address->ai_addrlen) == 0
+			&& listen(listenSocket, listenBacklog) == 0)
+			break;
+
+		lastErrno = errno;
+		close(listenSocket);
+		listenSocket = -1;
+	}
+	freeaddrinfo(addresses);
+
+	if (listenSocket == -1)
+	{
+		string errorMessage = std::format(
+			"Failed to open the SO_REUSEPORT listen socket"
+			", listenAddress: {}"
+			", errno: {}",
+			listenAddress, strerror(lastErrno)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+
+	LOG_INFO(
+		"SO_REUSEPORT listen socket opened"
+		", listenAddress: {}"
+		", listenSocket: {}",
+		listenAddress, listenSocket
+	);
+
+	return listenSocket;
+}
+
+bool FastCGIAPI::basicAuthenticationRequired(const FCGIRequestData& requestData)
+{
+	bool basicAuthenticationRequired = true;
+
+	return basicAuthenticationRequired;
+}
+
+FCGIRequestData::BodyOptions FastCGIAPI::requestBodyOptions(const FCGIRequestData& requestData)
+{
+	FCGIRequestData::BodyOptions bodyOptions;
+
+	if (requestData.routeIndex >= 0)
+		bodyOptions.mode = _router.route(requestData.routeIndex).options.bodyMode;
+	else
+	{
+		if (_handlersBodyMode.empty())
+			return bodyOptions;
+
+		const auto it = _handlersBodyMode.find(requestData.getQueryParameter("x-api-method", "", false));
+		if (it == _handlersBodyMode.end())
+			return bodyOptions;
+
+		bodyOptions.mode = it->second;
+	}
+	if (bodyOptions.mode == FCGIRequestData::BodyMode::Buffered)
+		return bodyOptions;
+
+	bodyOptions.maxContentLength = _maxStreamingContentLength;
+	bodyOptions.spoolThreshold = _requestBodySpoolThreshold;
+	bodyOptions.spoolDirectory = _requestBodySpoolDirectory;
+
+	return bodyOptions;
+}
+
+string FastCGIAPI::routeRequest(FCGIRequestData &requestData) const
+{
+	if (_router.empty())
+		return {};
+
+	FCGIRouter::PathParameterValues parameterValues;
+	const optional<size_t> routeIndex = _router.match(requestData.requestMethod, requestData.rawRequestURI(), parameterValues);
+	if (!routeIndex)
+	{
+		string allowedMethods = _router.allowedMethods(requestData.rawRequestURI());
+		if (!allowedMethods.empty())
+			LOG_DEBUG(
+				"Method not allowed"
+				", requestMethod: {}"
+				", requestURI: {}"
+				", allowedMethods: {}",
+				requestData.requestMethod, requestData.requestURI, allowedMethods
+			);
+
+		return allowedMethods;
+	}
+
+	const FCGIRouter::Route &route = _router.route(*routeIndex);
+	requestData.routeIndex = static_cast<int32_t>(*routeIndex);
+	for (size_t parameterIndex = 0; parameterIndex < route.parameterNames.size(); parameterIndex++)
+		requestData.addPathParameter(route.parameterNames[parameterIndex], parameterValues[parameterIndex]);
+	if (!route.options.responseCompression)
+		requestData.responseBodyCompressed = false;
+
+	LOG_TRACE(
+		"Request routed"
+		", requestMethod: {}"
+		", requestURI: {}"
+		", pathPattern: {}",
+		requestData.requestMethod, requestData.requestURI, route.pathPattern
+	);
+
+	return {};
+}
+
+void FastCGIAPI::negotiateResponseEncoding(FCGIRequestData &requestData) const
+{
+	// x-responseBodyCompressed (compressione non standard, X-CompressedBody) ha la precedenza
+	if (!_responseCompressionEnabled || requestData.responseBodyCompressed)
+		return;
+
+	int32_t compressionLevel = -1;
+	if (requestData.routeIndex >= 0)
+	{
+		const FCGIRouter::RouteOptions &routeOptions = _router.route(requestData.routeIndex).options;
+		if (!routeOptions.responseCompression)
+			return;
+		compressionLevel = routeOptions.compressionLevel;
+	}
+	requestData.responseEncodingNegotiated = true;
+
+	static constexpr FCGIHeaderKey acceptEncodingHeader{"accept-encoding"};
+	const string acceptEncoding = requestData.getHeaderParameter(acceptEncodingHeader, "");
+	if (acceptEncoding.empty())
+		return;
+
+	requestData.responseEncoding = FCGIResponseCompressor::negotiate(acceptEncoding, _responseCompressionEncodings);
+	if (compressionLevel < 0)
+		compressionLevel = requestData.responseEncoding == FCGIResponseCompressor::Encoding::Zstd ? _zstdCompressionLevel : _gzipCompressionLevel;
+	requestData.responseCompressionLevel = compressionLevel;
+
+	// il dizionario ha il suo livello (quello di api->responseCompression->zstdLevel)
+	if (_zstdDictionary && requestData.responseEncoding == FCGIResponseCompressor::Encoding::Zstd)
+	{
+		static constexpr FCGIHeaderKey zstdDictionaryIdHeader{"x-zstd-dictionary-id"};
+		const string zstdDictionaryId = requestData.getHeaderParameter(zstdDictionaryIdHeader, "");
+		uint32_t clientDictionaryId{};
+		if (const auto [ptr, ec] = from_chars(zstdDictionaryId.data(), zstdDictionaryId.data() + zstdDictionaryId.size(), clientDictionaryId);
+			ec == errc() && ptr == zstdDictionaryId.data() + zstdDictionaryId.size())
+			requestData.responseZstdDictionary = clientDictionaryId == _zstdDictionary->id();
+	}
+}
+
+void FastCGIAPI::setResponseCacheKey(FCGIRequestData &requestData) const
+{
+	if (!_responseCache || requestData.routeIndex < 0 || requestData.requestMethod != "GET")
+		return;
+
+	const FCGIRouter::RouteOptions &routeOptions = _router.route(requestData.routeIndex).options;
+	if (routeOptions.cacheTTL <= chrono::seconds::zero())
+		return;
+
+	// prima dell'handler: una invalidate durante l'handler scarta l'inserimento della risposta
+	requestData.responseCacheGeneration = _responseCache->generation();
+
+	// componenti preceduti dalla lunghezza: nessuna collisione tra valori diversi (es. utenti diversi)
+	auto key = back_inserter(requestData.responseCacheKey);
+	const string_view userName = requestData.authorizationDetails ? string_view(requestData.authorizationDetails->userName) : string_view();
+	std::format_to(key, "{}:{}", userName.size(), userName);
+
+	string_view path = requestData.rawRequestURI();
+	path = path.substr(0, path.find('?'));
+	if (path.size() > 1 && path.ends_with('/'))
+		path.remove_suffix(1);
+	std::format_to(key, "{}:{}", path.size(), path);
+
+	// valori non decodificati, nell'ordine di cacheQueryParameters (non in quello della query string)
+	const span<const FCGIParametersView::value_type> queryParameters = requestData.queryParametersView();
+	for (const string &parameterName : routeOptions.cacheQueryParameters)
+	{
+		const auto it = ranges::find(queryParameters, string_view(parameterName), &FCGIParametersView::value_type::first);
+		if (it == queryParameters.end())
+			requestData.responseCacheKey += '-';
+		else
+			std::format_to(key, "{}:{}", it->second.size(), it->second);
+	}
+}
+
+vector<string> FastCGIAPI::responseCacheTags(const FCGIRouter::RouteOptions &routeOptions, const FCGIRequestData &requestData)
+{
+	vector<string> tags;
+	tags.reserve(routeOptions.cacheTags.size());
+	for (const string &cacheTag : routeOptions.cacheTags)
+	{
+		string &tag = tags.emplace_back();
+		size_t index = 0;
+		while (index < cacheTag.size())
+		{
+			const size_t openIndex = cacheTag.find('{', index);
+			const size_t closeIndex = openIndex == string::npos ? string::npos : cacheTag.find('}', openIndex);
+			if (closeIndex == string::npos)
+			{
+				tag.append(cacheTag, index);
+				break;
+			}
+			tag.append(cacheTag, index, openIndex - index);
+			tag += requestData.getPathParameter(string_view(cacheTag).substr(openIndex + 1, closeIndex - openIndex - 1));
+			index = closeIndex + 1;
+		}
+	}
+
+	return tags;
+}
+
+void FastCGIAPI::insertCachedResponse(shared_ptr<const FCGIResponseCache::Response> cachedResponse) const
+{
+	if (!cachedResponse)
+		return;
+
+	const FCGIRouter::RouteOptions &routeOptions = _router.route(_currentRequestData->routeIndex).options;
+	_responseCache->insert(
+		_currentRequestData->responseCacheKey, std::move(cachedResponse), routeOptions.cacheTTL, responseCacheTags(routeOptions, *_currentRequestData),
+		_currentRequestData->responseCacheGeneration
+	);
+}
+
+bool FastCGIAPI::responseETag(const FCGIRequestData &requestData) const
+{
+	if (requestData.requestMethod != "GET" && requestData.requestMethod != "HEAD")
+		return false;
+
+	if (requestData.routeIndex >= 0)
+	{
+		if (const optional<bool> &routeResponseETag = _router.route(requestData.routeIndex).options.responseETag; routeResponseETag)
+			return *routeResponseETag;
+	}
+
+	return _responseETagEnabled;
+}
+
+bool FastCGIAPI::sendCachedResponse(const string_view &sThreadId, FCGX_Request &request, const FCGIRequestData &requestData)
+{
+	const shared_ptr<const FCGIResponseCache::Response> response = _responseCache->find(requestData.responseCacheKey);
+	if (!response)
+		return false;
+
+	constexpr string_view endLine = "\r\n";
+
+	FCGIResponseCompressor::Encoding encoding = requestData.responseEncoding;
+	if (static_cast<int64_t>(response->body.size()) < (requestData.responseZstdDictionary ? _zstdDictionaryMinSize : _responseCompressionMinSize))
+		encoding = FCGIResponseCompressor::Encoding::Identity;
+	// ETag debole per i body compressi: stesso contenuto, byte diversi
+	const string_view etagPrefix = encoding == FCGIResponseCompressor::Encoding::Identity ? "" : "W/";
+
+	const string lastModified = FCGIRequestData::formatHTTPDate(response->lastModified);
+	if (requestData.notModified(response->etag, response->lastModified))
+	{
+		_responseHeaders = FastCGIError::HTTPError::statusLine(304);
+		auto headers = back_inserter(_responseHeaders);
+		std::format_to(
+			headers,
+			"ETag: {}\"{}\"{}"
+			"Last-Modified: {}{}",
+			etagPrefix, response->etag, endLine, lastModified, endLine
+		);
+		// il 304 porta il Vary che avrebbe il 200 (RFC 9110 15.4.5)
+		formatResponseEncodingHeaders(headers, requestData, false);
+		_responseHeaders += endLine;
+		writeResponse(request, {});
+
+		LOG_DEBUG(
+			"sendCachedResponse, not modified"
+			", threadId: {}"
+			", requestURI: {}"
+			", etag: {}",
+			sThreadId, requestData.requestURI, response->etag
+		);
+
+		finishRequest(request);
+		_fcgxFinishDone = true;
+
+		return true;
+	}
+
+	// encodedResponseBody mantiene valida la variante compressa fino a writeResponse (anche se la risposta viene invalidata)
+	string_view responseBody = response->body;
+	shared_ptr<const string> encodedResponseBody;
+	unique_ptr<FCGIResponseCompressor> responseCompressor;
+	if (encoding != FCGIResponseCompressor::Encoding::Identity && requestData.responseZstdDictionary)
 	{
-		if (exceptionIfNotManaged)
+		// la variante con il dizionario dipende dal client: non viene messa in cache
+		responseCompressor = acquireResponseCompressor();
+		responseBody = responseCompressor->compress(encoding, requestData.responseCompressionLevel, responseBody, responseZstdDictionary(requestData));
+	}
+	else if (encoding != FCGIResponseCompressor::Encoding::Identity)
+	{
+		auto &encodedBody = response->encodedBodies[static_cast<size_t>(encoding)];
+		encodedResponseBody = encodedBody.load();
+		if (!encodedResponseBody)
 		{
-			string errorMessage = std::format(
-				"request is not managed because no registration found for method {}"
-				", threadId: {}"
-				", requestURI: {}"
-				", requestMethod: {}",
-				method, sThreadId, requestData.requestURI, requestData.requestMethod);
-			LOG_ERROR(errorMessage);
-			throw runtime_error(errorMessage);
+			// più thread possono comprimere insieme la stessa variante, ne resta una
+			responseCompressor = acquireResponseCompressor();
+			encodedResponseBody = make_shared<const string>(responseCompressor->compress(encoding, requestData.responseCompressionLevel, responseBody));
+			encodedBody.store(encodedResponseBody);
 		}
-		return true; // request not managed
+		responseBody = *encodedResponseBody;
 	}
 
-	handlerIt->second(sThreadId, request, requestData);
+	_responseHeaders = FastCGIError::HTTPError::statusLine(200);
+	auto headers = back_inserter(_responseHeaders);
+	if (!response->contentType.empty())
+		std::format_to(headers, "{}{}", response->contentType, endLine);
+	std::format_to(headers, "ETag: {}\"{}\"{}", etagPrefix, response->etag, endLine);
+	std::format_to(headers, "Last-Modified: {}{}", lastModified, endLine);
+	formatResponseEncodingHeaders(headers, requestData, encoding != FCGIResponseCompressor::Encoding::Identity);
+	std::format_to(headers, "Content-Length: {}{}{}", responseBody.size(), endLine, endLine);
+
+	LOG_DEBUG(
+		"sendCachedResponse"
+		", threadId: {}"
+		", requestURI: {}"
+		", responseBody.size: @{}@"
+		", contentEncoding: {}",
+		sThreadId, requestData.requestURI, responseBody.size(), FCGIResponseCompressor::name(encoding)
+	);
 
-	return false;
-}
+	writeResponse(request, responseBody);
+	if (responseCompressor)
+		releaseResponseCompressor(std::move(responseCompressor));
 
-void FastCGIAPI::stopFastcgi() { _shutdown = true; }
+	finishRequest(request);
+	_fcgxFinishDone = true;
 
-bool FastCGIAPI::basicAuthenticationRequired(const FCGIRequestData& requestData)
+	return true;
+}
+
+unique_ptr<FCGIResponseCompressor> FastCGIAPI::acquireResponseCompressor()
 {
-	bool basicAuthenticationRequired = true;
+	if (_responseCompressors.empty())
+		return make_unique<FCGIResponseCompressor>();
 
-	return basicAuthenticationRequired;
+	unique_ptr<FCGIResponseCompressor> responseCompressor = std::move(_responseCompressors.back());
+	_responseCompressors.pop_back();
+
+	return responseCompressor;
+}
+
+void FastCGIAPI::releaseResponseCompressor(unique_ptr<FCGIResponseCompressor> responseCompressor)
+{
+	_responseCompressors.push_back(std::move(responseCompressor));
 }
 
 std::shared_ptr<ThreadLogger> FastCGIAPI::requestThreadLogger(const FCGIRequestData& requestData)
@@ -359,70 +1613,131 @@ void FastCGIAPI::sendSuccess(
 		return;
 	}
 
-	string endLine = "\r\n";
-
-	string httpStatus = std::format("Status: {} {}{}", htmlResponseCode,
-		FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode), endLine);
+	constexpr string_view endLine = "\r\n";
 
-	string localContentType;
-	if (!responseBody.empty())
+	// risposta da mettere in cache (GET di una route con cacheTTL), non quelle personalizzate con cookie o CORS
+	shared_ptr<FCGIResponseCache::Response> cachedResponse;
+	if (_currentRequestData != nullptr && !_currentRequestData->responseCacheKey.empty() && htmlResponseCode == 200 && !responseBodyCompressed &&
+		cookieName.empty() && !enableCorsGETHeader && responseBody.size() <= _responseCache->maxBodySize())
 	{
-		if (contentType.empty())
-			localContentType = std::format("Content-Type: application/json; charset=utf-8{}", endLine);
-		else
-			localContentType = std::format("{}{}", contentType, endLine);
+		cachedResponse = make_shared<FCGIResponseCache::Response>();
+		cachedResponse->etag = FCGIResponseCache::etag(responseBody);
+		cachedResponse->lastModified = chrono::floor<chrono::seconds>(chrono::system_clock::now());
+		cachedResponse->body = responseBody;
 	}
 
-	string cookieHeader;
-	if (!cookieName.empty() && !cookieValue.empty())
+	// Content-Encoding negoziato (vedi negotiateResponseEncoding), i body piccoli non vengono compressi
+	const bool bodyEncoded = !responseBodyCompressed && _currentRequestData != nullptr &&
+							 _currentRequestData->responseEncoding != FCGIResponseCompressor::Encoding::Identity &&
+							 static_cast<int64_t>(responseBody.size()) >=
+								 (_currentRequestData->responseZstdDictionary ? _zstdDictionaryMinSize : _responseCompressionMinSize);
+
+	// validatori della risposta: ETag (debole per i body compressi: stesso contenuto, byte diversi) e, per le risposte in cache, Last-Modified.
+	// Nessun ETag (e quindi nessun 304) per una risposta con Set-Cookie: il 304 non rinnoverebbe il cookie
+	const bool setCookie = !cookieName.empty() && !cookieValue.empty();
+	string etag;
+	if (cachedResponse)
+		etag = cachedResponse->etag;
+	else if (htmlResponseCode == 200 && !setCookie && _currentRequestData != nullptr && responseETag(*_currentRequestData))
+		etag = FCGIResponseCache::etag(responseBody);
+	const string_view etagPrefix = bodyEncoded || responseBodyCompressed ? "W/" : "";
+
+	// Set-Cookie e CORS, uguali per il 200 e per il 304
+	const auto formatMetadataHeaders = [&](auto headers)
 	{
-		cookieHeader = std::format("Set-Cookie: {}={}", cookieName, cookieValue);
+		if (setCookie)
+		{
+			std::format_to(headers, "Set-Cookie: {}={}", cookieName, cookieValue);
 
-		if (!cookiePath.empty())
-			cookieHeader += (std::format("; Path={}", cookiePath));
+			if (!cookiePath.empty())
+				std::format_to(headers, "; Path={}", cookiePath);
 
-		cookieHeader += endLine;
-	}
+			_responseHeaders += endLine;
+		}
 
-	string corsGETHeader;
-	if (enableCorsGETHeader)
-	{
-		string origin = "*";
-		if (!originHeader.empty())
-			origin = originHeader;
+		if (enableCorsGETHeader)
+		{
+			string_view origin = "*";
+			if (!originHeader.empty())
+				origin = originHeader;
+
+			std::format_to(
+				headers,
+				"Access-Control-Allow-Origin: {}{}"
+				"Access-Control-Allow-Methods: GET, POST, OPTIONS{}"
+				"Access-Control-Allow-Credentials: true{}"
+				"Access-Control-Allow-Headers: "
+				"DNT,User-Agent,X-Requested-With,If-Modified-Since,Cache-Control,"
+				"Content-Type,Range{}"
+				"Access-Control-Expose-Headers: Content-Length,Content-Range{}",
+				origin, endLine, endLine, endLine, endLine, endLine
+			);
+		}
+	};
 
-		corsGETHeader = std::format(
-			"Access-Control-Allow-Origin: {}{}"
-			"Access-Control-Allow-Methods: GET, POST, OPTIONS{}"
-			"Access-Control-Allow-Credentials: true{}"
-			"Access-Control-Allow-Headers: "
-			"DNT,User-Agent,X-Requested-With,If-Modified-Since,Cache-Control,"
-			"Content-Type,Range{}"
-			"Access-Control-Expose-Headers: Content-Length,Content-Range{}",
-			origin, endLine, endLine, endLine, endLine, endLine
+	if (!etag.empty() && _currentRequestData->notModified(etag, cachedResponse ? optional(cachedResponse->lastModified) : nullopt))
+	{
+		_responseHeaders = FastCGIError::HTTPError::statusLine(304);
+		auto headers = back_inserter(_responseHeaders);
+		formatMetadataHeaders(headers);
+		std::format_to(headers, "ETag: {}\"{}\"{}", etagPrefix, etag, endLine);
+		if (cachedResponse)
+			std::format_to(headers, "Last-Modified: {}{}", FCGIRequestData::formatHTTPDate(cachedResponse->lastModified), endLine);
+		// il 304 porta il Vary che avrebbe il 200 (RFC 9110 15.4.5)
+		if (!responseBodyCompressed)
+			formatResponseEncodingHeaders(headers, *_currentRequestData, false);
+		_responseHeaders += endLine;
+
+		LOG_DEBUG(
+			"sendSuccess, not modified"
+			", threadId: {}"
+			", requestURI: {}"
+			", requestMethod: {}"
+			", responseBody.size: @{}@"
+			", etag: {}",
+			sThreadId, requestURI, requestMethod, responseBody.size(), etag
 		);
+
+		writeResponse(request, {});
+		insertCachedResponse(std::move(cachedResponse));
+
+		finishRequest(request);
+		_fcgxFinishDone = true;
+
+		return;
+	}
+
+	// header nel buffer riutilizzato tra le richieste, il body viene scritto senza copie (writeResponse)
+	_responseHeaders = FastCGIError::HTTPError::statusLine(htmlResponseCode);
+	auto headers = back_inserter(_responseHeaders);
+
+	if (!responseBody.empty())
+	{
+		const string_view contentTypeHeader = contentType.empty() ? "Content-Type: application/json; charset=utf-8" : contentType;
+		std::format_to(headers, "{}{}", contentTypeHeader, endLine);
+		if (cachedResponse)
+			cachedResponse->contentType = contentTypeHeader;
 	}
 
+	formatMetadataHeaders(headers);
+
+	if (!etag.empty())
+		std::format_to(headers, "ETag: {}\"{}\"{}", etagPrefix, etag, endLine);
+	if (cachedResponse)
+		std::format_to(headers, "Last-Modified: {}{}", FCGIRequestData::formatHTTPDate(cachedResponse->lastModified), endLine);
+
 	if (responseBodyCompressed)
 	{
 		string compressedResponseBody = Compressor::compress_string(responseBody);
 
-		unsigned long contentLength = compressedResponseBody.size();
-
-		string headResponse = std::format(
-			"{}"
-			"{}"
-			"{}"
-			"{}"
+		std::format_to(
+			headers,
 			"Content-Length: {}{}"
 			"X-CompressedBody: true{}"
 			"{}",
-			httpStatus, localContentType, cookieHeader, corsGETHeader, contentLength,
-			endLine, endLine, endLine
+			compressedResponseBody.size(), endLine, endLine, endLine
 		);
 
-		FCGX_FPrintF(request.out, headResponse.c_str());
-
 		LOG_INFO(
 			"sendSuccess"
 			", threadId: {}"
@@ -432,32 +1747,46 @@ void FastCGIAPI::sendSuccess(
 			", responseBody.size: @{}@"
 			", compressedResponseBody.size: @{}@"
 			", headResponse: {}",
-			sThreadId, requestURI, requestMethod, headResponse.size(), responseBody.size(), contentLength, headResponse
+			sThreadId, requestURI, requestMethod, _responseHeaders.size(), responseBody.size(), compressedResponseBody.size(), _responseHeaders
 		);
 
-		FCGX_PutStr(compressedResponseBody.data(), compressedResponseBody.size(), request.out);
+		writeResponse(request, compressedResponseBody);
 	}
-	else
+	else if (bodyEncoded)
 	{
-		string completeHttpResponse;
+		const FCGIResponseCompressor::Encoding encoding = _currentRequestData->responseEncoding;
+		unique_ptr<FCGIResponseCompressor> responseCompressor = acquireResponseCompressor();
+		const string_view compressedResponseBody = responseCompressor->compress(
+			encoding, _currentRequestData->responseCompressionLevel, responseBody, responseZstdDictionary(*_currentRequestData)
+		);
 
-		// 2020-02-08: content length has to be calculated before the substitution
-		// from % to %% because for FCGX_FPrintF (below used) %% is just one
-		// character
-		unsigned long contentLength = responseBody.length();
+		formatResponseEncodingHeaders(headers, *_currentRequestData, true);
+		if (cachedResponse && !_currentRequestData->responseZstdDictionary)
+			cachedResponse->encodedBodies[static_cast<size_t>(encoding)].store(make_shared<const string>(compressedResponseBody));
+		std::format_to(headers, "Content-Length: {}{}{}", compressedResponseBody.size(), endLine, endLine);
 
-		// responseBody cannot have the '%' char because FCGX_FPrintF will not work
-		completeHttpResponse = std::format(
-			"{}"
-			"{}"
-			"{}"
-			"{}"
-			"Content-Length: {}{}"
-			"{}"
-			"{}",
-			httpStatus, localContentType, cookieHeader, corsGETHeader, contentLength, endLine, endLine,
-			responseBody.find('%') != string::npos ? StringUtils::replaceAll(responseBody, "%", "%%") : responseBody
-		);
+		if (!requestURI.ends_with("/status"))
+			LOG_DEBUG(
+				"sendSuccess"
+				", threadId: {}"
+				", requestURI: {}"
+				", requestMethod: {}"
+				", responseBody.size: @{}@"
+				", contentEncoding: {}"
+				", compressedResponseBody.size: @{}@"
+				", httpStatus: {}",
+				sThreadId, requestURI, requestMethod, responseBody.size(), FCGIResponseCompressor::name(encoding), compressedResponseBody.size(),
+				htmlResponseCode
+			);
+
+		writeResponse(request, compressedResponseBody);
+		releaseResponseCompressor(std::move(responseCompressor));
+	}
+	else
+	{
+		if (_currentRequestData != nullptr)
+			formatResponseEncodingHeaders(headers, *_currentRequestData, false);
+		std::format_to(headers, "Content-Length: {}{}{}", responseBody.size(), endLine, endLine);
 
 		if (!requestURI.ends_with("/status"))
 			LOG_DEBUG(
@@ -467,20 +1796,289 @@ void FastCGIAPI::sendSuccess(
 				", requestMethod: {}"
 				", responseBody.size: @{}@"
 				", httpStatus: {}",
-				// ", completeHttpResponse: {}", spesso la response è troppo lunga, per cui logghiamo solo httpStatus
-				sThreadId, requestURI, requestMethod, responseBody.size(), httpStatus //, completeHttpResponse
+				// spesso la response è troppo lunga, per cui logghiamo solo lo status
+				sThreadId, requestURI, requestMethod, responseBody.size(), htmlResponseCode
 			);
 
-		// si potrebbe usare anche FCGX_PutStr, in questo caso
-		// non bisogna gestire %% (vedi sopra)
-		// FCGX_PutStr(responseBody.data(), responseBody.size(), request.out);
-		FCGX_FPrintF(request.out, completeHttpResponse.c_str());
+		writeResponse(request, responseBody);
+	}
+
+	insertCachedResponse(std::move(cachedResponse));
+
+	finishRequest(request);
+	_fcgxFinishDone = true;
+}
+
+void FastCGIAPI::writeResponse(FCGX_Request &request, const string_view responseBody) const
+{
+	// niente FCGX_FPrintF: il contenuto non è un formato, per cui nessun escaping dei '%' e nessuna copia
+	FCGX_PutStr(_responseHeaders.data(), static_cast<int>(_responseHeaders.size()), request.out);
+	if (!responseBody.empty())
+		FCGIConnection::putStr(request, responseBody);
+}
+
+void FastCGIAPI::sendFile(FCGX_Request &request, const FCGIRequestData &requestData, const string &filePath, const string_view contentType)
+{
+	const int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+	{
+		const int openErrno = errno;
+		string errorMessage = std::format(
+			"File cannot be opened"
+			", filePath: {}"
+			", errno: {}",
+			filePath, strerror(openErrno)
+		);
+		LOG_ERROR(errorMessage);
+
+		throw FastCGIError::HTTPError(openErrno == ENOENT ? 404 : 403);
+	}
+
+	try
+	{
+		sendFile(request, requestData, fd, contentType);
+	}
+	catch (...)
+	{
+		close(fd);
+		throw;
+	}
+	close(fd);
+}
+
+void FastCGIAPI::sendFile(FCGX_Request &request, const FCGIRequestData &requestData, const int fd, const string_view contentType)
+{
+	if (_fcgxFinishDone)
+	{
+		LOG_ERROR("response was already done");
+
+		return;
+	}
+
+	struct stat fileStat{};
+	if (fstat(fd, &fileStat) == -1 || !S_ISREG(fileStat.st_mode))
+	{
+		string errorMessage = std::format(
+			"sendFile: fd is not a regular file"
+			", requestURI: {}"
+			", fd: {}",
+			requestData.requestURI, fd
+		);
+		LOG_ERROR(errorMessage);
+
+		throw runtime_error(errorMessage);
+	}
+	const auto fileSize = static_cast<uint64_t>(fileStat.st_size);
+	const bool headRequest = requestData.requestMethod == "HEAD";
+
+	constexpr string_view endLine = "\r\n";
+
+	// validatori (come nginx): data di modifica e dimensione, senza leggere il file
+	const chrono::system_clock::time_point fileLastModified = chrono::system_clock::from_time_t(fileStat.st_mtim.tv_sec);
+	const string etag = std::format("{:x}-{:x}", fileStat.st_mtim.tv_sec, fileSize);
+	const string lastModified = FCGIRequestData::formatHTTPDate(fileLastModified);
+	if (requestData.notModified(etag, fileLastModified))
+	{
+		_responseHeaders = FastCGIError::HTTPError::statusLine(304);
+		std::format_to(
+			back_inserter(_responseHeaders),
+			"ETag: \"{}\"{}"
+			"Last-Modified: {}{}"
+			"{}",
+			etag, endLine, lastModified, endLine, endLine
+		);
+		writeResponse(request, {});
+
+		LOG_INFO(
+			"sendFile, not modified"
+			", requestURI: {}"
+			", etag: {}",
+			requestData.requestURI, etag
+		);
+
+		finishRequest(request);
+		_fcgxFinishDone = true;
+
+		return;
+	}
+	if (requestData.preconditionFailed(etag))
+	{
+		LOG_INFO(
+			"sendFile, precondition failed"
+			", requestURI: {}"
+			", requestMethod: {}"
+			", etag: {}",
+			requestData.requestURI, requestData.requestMethod, etag
+		);
+
+		sendError(request, 412, FastCGIError::HTTPError::getHtmlStandardMessage(412));
+
+		return;
+	}
+
+	// nullopt: Range assente o da ignorare, risposta 200 con l'intero file
+	optional<vector<FCGIRequestData::ByteRange>> ranges;
+	if (requestData.requestMethod == "GET")
+	{
+		if (const string range = requestData.getHeaderParameter(FCGIRequestData::rangeHeader, ""); !range.empty())
+			ranges = FCGIRequestData::parseRange(range, fileSize);
+	}
+
+	_responseHeaders.clear();
+	auto headers = back_inserter(_responseHeaders);
+
+	int htmlResponseCode = 200;
+	bool success = true;
+	if (ranges && ranges->empty())
+	{
+		htmlResponseCode = 416;
+		_responseHeaders += FastCGIError::HTTPError::statusLine(htmlResponseCode);
+		std::format_to(
+			headers,
+			"Content-Range: bytes */{}{}"
+			"Content-Length: 0{}"
+			"{}",
+			fileSize, endLine, endLine, endLine
+		);
+		writeResponse(request, {});
+	}
+	else if (!ranges || ranges->size() == 1)
+	{
+		const FCGIRequestData::ByteRange byteRange = ranges ? ranges->front() : FCGIRequestData::ByteRange{0, fileSize - 1};
+		const uint64_t contentLength = ranges ? byteRange.length() : fileSize;
+
+		htmlResponseCode = ranges ? 206 : 200;
+		_responseHeaders += FastCGIError::HTTPError::statusLine(htmlResponseCode);
+		std::format_to(
+			headers,
+			"Content-Type: {}{}"
+			"Accept-Ranges: bytes{}"
+			"ETag: \"{}\"{}"
+			"Last-Modified: {}{}"
+			"Content-Length: {}{}",
+			contentType, endLine, endLine, etag, endLine, lastModified, endLine, contentLength, endLine
+		);
+		if (ranges)
+			std::format_to(headers, "Content-Range: bytes {}-{}/{}{}", byteRange.start, byteRange.end, fileSize, endLine);
+		_responseHeaders += endLine;
+
+		writeResponse(request, {});
+		if (!headRequest)
+			success = writeFileRange(request, fd, byteRange.start, contentLength);
+	}
+	else
+	{
+		// multipart/byteranges: le intestazioni delle parti servono prima, per il Content-Length
+		htmlResponseCode = 206;
+		const string boundary = std::format("FCGIByteRanges{:016x}", chrono::steady_clock::now().time_since_epoch().count());
+
+		vector<string> partHeaders;
+		partHeaders.reserve(ranges->size());
+		uint64_t contentLength = 0;
+		for (const FCGIRequestData::ByteRange &byteRange : *ranges)
+		{
+			partHeaders.push_back(std::format(
+				"--{}{}"
+				"Content-Type: {}{}"
+				"Content-Range: bytes {}-{}/{}{}"
+				"{}",
+				boundary, endLine, contentType, endLine, byteRange.start, byteRange.end, fileSize, endLine, endLine
+			));
+			contentLength += partHeaders.back().size() + byteRange.length() + endLine.size();
+		}
+		const string closingBoundary = std::format("--{}--{}", boundary, endLine);
+		contentLength += closingBoundary.size();
+
+		_responseHeaders += FastCGIError::HTTPError::statusLine(htmlResponseCode);
+		std::format_to(
+			headers,
+			"Content-Type: multipart/byteranges; boundary={}{}"
+			"Accept-Ranges: bytes{}"
+			"ETag: \"{}\"{}"
+			"Last-Modified: {}{}"
+			"Content-Length: {}{}"
+			"{}",
+			boundary, endLine, endLine, etag, endLine, lastModified, endLine, contentLength, endLine, endLine
+		);
+
+		writeResponse(request, {});
+		if (!headRequest)
+		{
+			for (size_t rangeIndex = 0; success && rangeIndex < ranges->size(); rangeIndex++)
+			{
+				const FCGIRequestData::ByteRange &byteRange = (*ranges)[rangeIndex];
+				FCGX_PutStr(partHeaders[rangeIndex].data(), static_cast<int>(partHeaders[rangeIndex].size()), request.out);
+				success = writeFileRange(request, fd, byteRange.start, byteRange.length());
+				FCGX_PutStr(endLine.data(), static_cast<int>(endLine.size()), request.out);
+			}
+			FCGX_PutStr(closingBoundary.data(), static_cast<int>(closingBoundary.size()), request.out);
+		}
 	}
 
-	FCGX_Finish_r(&request);
+	if (success)
+		LOG_INFO(
+			"sendFile"
+			", requestURI: {}"
+			", htmlResponseCode: {}"
+			", fileSize: {}"
+			", rangesNumber: {}",
+			requestData.requestURI, htmlResponseCode, fileSize, ranges ? ranges->size() : 0
+		);
+	else
+		LOG_WARN(
+			"sendFile: response not completely sent"
+			", requestURI: {}"
+			", htmlResponseCode: {}"
+			", fileSize: {}",
+			requestData.requestURI, htmlResponseCode, fileSize
+		);
+
+	finishRequest(request);
 	_fcgxFinishDone = true;
 }
 
+bool FastCGIAPI::writeFileRange(FCGX_Request &request, const int fd, const uint64_t offset, const uint64_t length)
+{
+	if (length == 0)
+		return true;
+
+	if (FCGIConnection::isNativeRequest(request))
+		return FCGIConnection::sendFile(request, fd, offset, length);
+
+	// libfcgi: i byte del file vengono copiati solo nel buffer dello stream
+	const auto pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+	const uint64_t mapOffset = offset - offset % pageSize;
+	const size_t mapLength = length + (offset - mapOffset);
+	void *map = mmap(nullptr, mapLength, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(mapOffset));
+	if (map == MAP_FAILED)
+	{
+		LOG_ERROR(
+			"mmap failed"
+			", fd: {}"
+			", offset: {}"
+			", length: {}"
+			", errno: {}",
+			fd, offset, length, strerror(errno)
+		);
+
+		return false;
+	}
+	madvise(map, mapLength, MADV_SEQUENTIAL);
+
+	const char *data = static_cast<const char *>(map) + (offset - mapOffset);
+	bool success = true;
+	for (uint64_t written = 0; success && written < length;)
+	{
+		// FCGX_PutStr accetta un int
+		const auto chunkLength = static_cast<int>(min<uint64_t>(length - written, 1 << 30));
+		success = FCGX_PutStr(data + written, chunkLength, request.out) == chunkLength;
+		written += chunkLength;
+	}
+	munmap(map, mapLength);
+
+	return success;
+}
+
 void FastCGIAPI::sendRedirect(FCGX_Request &request, const string_view& locationURL, const bool permanently, const string_view& contentType)
 {
 	if (_fcgxFinishDone)
@@ -495,32 +2093,28 @@ void FastCGIAPI::sendRedirect(FCGX_Request &request, const string_view& location
 		return;
 	}
 
-	string endLine = "\r\n";
+	constexpr string_view endLine = "\r\n";
 
 	// int htmlResponseCode = permanently ? 301 : 302;
 	int16_t htmlResponseCode = permanently ? 308 : 307;
 
-	string completeHttpResponse = std::format(
-		"Status: {} {}{}"
-		"Location: {}{}",
-		htmlResponseCode, FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode), endLine,
-		locationURL.find('%') != string::npos ? StringUtils::replaceAll(locationURL, "%", "%%") : locationURL,
-		endLine
-	);
+	_responseHeaders = FastCGIError::HTTPError::statusLine(htmlResponseCode);
+	auto headers = back_inserter(_responseHeaders);
+	std::format_to(headers, "Location: {}{}", locationURL, endLine);
 	if (!contentType.empty())
-		completeHttpResponse += std::format("Content-Type: {}{}{}", contentType, endLine, endLine);
+		std::format_to(headers, "Content-Type: {}{}{}", contentType, endLine, endLine);
 	else
-		completeHttpResponse += endLine;
+		_responseHeaders += endLine;
 
 	LOG_INFO(
 		"HTTP Success"
 		", response: {}",
-		completeHttpResponse
+		_responseHeaders
 	);
 
-	FCGX_FPrintF(request.out, completeHttpResponse.c_str());
+	writeResponse(request, {});
 
-	FCGX_Finish_r(&request);
+	finishRequest(request);
 	_fcgxFinishDone = true;
 }
 
@@ -538,26 +2132,20 @@ void FastCGIAPI::sendHeadSuccess(FCGX_Request &request, int16_t htmlResponseCode
 		return;
 	}
 
-	string endLine = "\r\n";
-
-	string httpStatus = std::format("Status: {} {}{}", htmlResponseCode,
-		FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode), endLine);
+	constexpr string_view endLine = "\r\n";
 
-	string completeHttpResponse = std::format(
-		"{}"
-		"Content-Range: bytes 0-{}{}{}",
-		httpStatus, fileSize, endLine, endLine
-	);
+	_responseHeaders = FastCGIError::HTTPError::statusLine(htmlResponseCode);
+	std::format_to(back_inserter(_responseHeaders), "Content-Range: bytes 0-{}{}{}", fileSize, endLine, endLine);
 
 	LOG_INFO(
 		"HTTP HEAD Success"
 		", response: {}",
-		completeHttpResponse
+		_responseHeaders
 	);
 
-	FCGX_FPrintF(request.out, completeHttpResponse.c_str());
+	writeResponse(request, {});
 
-	FCGX_Finish_r(&request);
+	finishRequest(request);
 	_fcgxFinishDone = true;
 }
 
@@ -565,14 +2153,11 @@ void FastCGIAPI::sendHeadSuccess(int16_t htmlResponseCode, unsigned long fileSiz
 {
 	string endLine = "\r\n";
 
-	string httpStatus = std::format("Status: {} {}{}", htmlResponseCode,
-		FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode), endLine);
-
 	string completeHttpResponse = std::format(
 		"{}"
 		"X-CatraMMS-Resume: {}{}"
 		"{}",
-		httpStatus, fileSize, endLine, endLine
+		FastCGIError::HTTPError::statusLine(htmlResponseCode), fileSize, endLine, endLine
 	);
 
 	LOG_INFO(
@@ -582,6 +2167,84 @@ void FastCGIAPI::sendHeadSuccess(int16_t htmlResponseCode, unsigned long fileSiz
 	);
 }
 
+bool FastCGIAPI::receiveResumableUpload(
+	const string_view &sThreadId, FCGX_Request &request, const FCGIRequestData &requestData, const string &filePath
+)
+{
+	if (requestData.requestMethod == "HEAD")
+	{
+		sendHeadSuccess(request, 200, FCGIUploadSink::receivedPrefix(filePath));
+
+		return false;
+	}
+
+	static constexpr FCGIHeaderKey contentRangeHeader{"content-range"};
+
+	uint64_t contentRangeStart = 0;
+	uint64_t contentRangeEnd = requestData.contentLength > 0 ? requestData.contentLength - 1 : 0;
+	uint64_t contentRangeSize = requestData.contentLength;
+	if (const string contentRange = requestData.getHeaderParameter(contentRangeHeader, ""); !contentRange.empty())
+	{
+		// header del client: un Content-Range non valido è un 400, non un errore del server
+		try
+		{
+			FCGIRequestData::parseContentRange(contentRange, contentRangeStart, contentRangeEnd, contentRangeSize);
+		}
+		catch (exception &e)
+		{
+			throw FastCGIError::HTTPError(400, e.what());
+		}
+	}
+
+	const uint64_t rangeSize = contentRangeEnd - contentRangeStart + 1;
+	if (contentRangeEnd < contentRangeStart || contentRangeEnd >= contentRangeSize || rangeSize != requestData.contentLength)
+	{
+		string errorMessage = std::format(
+			"Wrong Content-Range"
+			", threadId: {}"
+			", requestURI: {}"
+			", contentRangeStart: {}"
+			", contentRangeEnd: {}"
+			", contentRangeSize: {}"
+			", contentLength: {}",
+			sThreadId, requestData.requestURI, contentRangeStart, contentRangeEnd, contentRangeSize, requestData.contentLength
+		);
+		LOG_ERROR(errorMessage);
+
+		throw FastCGIError::HTTPError(400, errorMessage);
+	}
+
+	FCGIUploadSink uploadSink(filePath, contentRangeSize);
+	if (const uint64_t written = uploadSink.write(requestData, contentRangeStart, rangeSize); written != rangeSize)
+		LOG_WARN(
+			"Upload range received partially"
+			", threadId: {}"
+			", filePath: {}"
+			", contentRangeStart: {}"
+			", rangeSize: {}"
+			", written: {}",
+			sThreadId, filePath, contentRangeStart, rangeSize, written
+		);
+
+	const bool uploadCompleted = uploadSink.complete();
+	sendHeadSuccess(request, uploadCompleted ? 201 : 200, uploadSink.receivedPrefix());
+
+	return uploadCompleted;
+}
+
+void FastCGIAPI::sendRequestError(FCGX_Request &request, const FastCGIError::RequestError &requestError)
+{
+	const string errorMessage = requestError.message();
+	LOG_DEBUG(
+		"Request error"
+		", httpErrorCode: {}"
+		", errorMessage: {}",
+		requestError.httpErrorCode, errorMessage
+	);
+
+	sendError(request, requestError.httpErrorCode, errorMessage);
+}
+
 void FastCGIAPI::sendError(FCGX_Request &request, int16_t htmlResponseCode, const string_view& responseBody)
 {
 	if (_fcgxFinishDone)
@@ -596,82 +2259,60 @@ void FastCGIAPI::sendError(FCGX_Request &request, int16_t htmlResponseCode, cons
 		return;
 	}
 
-	string endLine = "\r\n";
-
-	// 2020-02-08: content length has to be calculated before the substitution
-	// from % to %% because for FCGX_FPrintF (below used) %% is just one
-	// character
-	unsigned long contentLength = responseBody.length();
+	constexpr string_view endLine = "\r\n";
 
-	string httpStatus = std::format("Status: {} {}{}", htmlResponseCode,
-		FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode), endLine);
-
-	string completeHttpResponse = std::format(
-		"{}"
+	_responseHeaders = FastCGIError::HTTPError::statusLine(htmlResponseCode);
+	std::format_to(
+		back_inserter(_responseHeaders),
 		"Content-Type: application/json; charset=utf-8{}"
 		"Content-Length: {}{}"
-		"{}"
 		"{}",
-		httpStatus, endLine, contentLength, endLine, endLine,
-		responseBody.find('%') != string::npos ? StringUtils::replaceAll(responseBody, "%", "%%") : responseBody
+		endLine, responseBody.size(), endLine, endLine
 	);
 
 	LOG_INFO(
 		"HTTP Error"
-		", response: {}",
-		completeHttpResponse
+		", response: {}{}",
+		_responseHeaders, responseBody
 	);
 
-	FCGX_FPrintF(request.out, completeHttpResponse.c_str());
+	writeResponse(request, responseBody);
 
-	FCGX_Finish_r(&request);
+	finishRequest(request);
 	_fcgxFinishDone = true;
 }
 
-string FastCGIAPI::base64_encode(const string &in)
+void FastCGIAPI::sendMethodNotAllowed(FCGX_Request &request, const string_view allowedMethods)
 {
-	string out;
-
-	int val = 0, valb = -6;
-	for (unsigned char c : in)
+	if (_fcgxFinishDone)
 	{
-		val = (val << 8) + c;
-		valb += 8;
-		while (valb >= 0)
-		{
-			out.push_back("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[(val >> valb) & 0x3F]);
-			valb -= 6;
-		}
+		LOG_ERROR("response was already done");
+
+		return;
 	}
-	if (valb > -6)
-		out.push_back("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[((val << 8) >> (valb + 8)) & 0x3F]);
-	while (out.size() % 4)
-		out.push_back('=');
-	return out;
-}
 
-string FastCGIAPI::base64_decode(const string &in)
-{
-	string out;
+	constexpr string_view endLine = "\r\n";
+	constexpr int16_t htmlResponseCode = 405;
+	const string_view responseBody = FastCGIError::HTTPError::getHtmlStandardMessage(htmlResponseCode);
 
-	vector<int> T(256, -1);
-	for (int i = 0; i < 64; i++)
-		T["ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/"[i]] = i;
+	_responseHeaders = FastCGIError::HTTPError::statusLine(htmlResponseCode);
+	std::format_to(
+		back_inserter(_responseHeaders),
+		"Allow: {}{}"
+		"Content-Type: application/json; charset=utf-8{}"
+		"Content-Length: {}{}"
+		"{}",
+		allowedMethods, endLine, endLine, responseBody.size(), endLine, endLine
+	);
 
-	int val = 0, valb = -8;
-	for (unsigned char c : in)
-	{
-		if (c == ' ')
-			c = '+';
-		if (T[c] == -1)
-			break;
-		val = (val << 6) + T[c];
-		valb += 6;
-		if (valb >= 0)
-		{
-			out.push_back(char((val >> valb) & 0xFF));
-			valb -= 8;
-		}
-	}
-	return out;
+	LOG_INFO(
+		"HTTP Error"
+		", response: {}{}",
+		_responseHeaders, responseBody
+	);
+
+	writeResponse(request, responseBody);
+
+	finishRequest(request);
+	_fcgxFinishDone = true;
 }
\ No newline at end of file
@@ -21,14 +21,29 @@
 
 #pragma once
 
+#include <atomic>
+#include <expected>
 #include <unordered_map>
 #include "spdlog/spdlog.h"
+#include "FCGIAuthorizationCache.h"
+#include "FCGIEventLoop.h"
+#include "FCGIParameterSchema.h"
+#include "FCGIRequestArena.h"
 #include "FCGIRequestData.h"
+#include "FCGIResponseCache.h"
+#include "FCGIResponseCompressor.h"
+#include "FCGIResponseStream.h"
+#include "FCGIRouter.h"
+#include "FCGIZstdDictionary.h"
+#include "FCGITask.h"
+#include "FCGIWorkerPool.h"
 #include "JSONUtils.h"
 
 
 class FastCGIAPI
 {
+	friend class FCGIResponseStream;
+
 public:
 
 	using Handler = std::function<void(
@@ -37,6 +52,25 @@ public:
 		const FCGIRequestData& // requestData
 	)>;
 
+	// handler asincrono (coroutine): può sospendersi con co_await sugli awaitable di _eventLoop
+	// senza bloccare il thread, che nel frattempo gestisce altre richieste.
+	// request e requestData restano validi finché la coroutine non termina.
+	// sThreadId è passato per valore perchè un parametro reference di una coroutine
+	// non sopravvive alla prima sospensione
+	using AsyncHandler = std::function<FCGITask(
+		std::string_view, // sThreadId
+		FCGX_Request &, // request
+		const FCGIRequestData& // requestData
+	)>;
+
+	// handler che ritorna l'errore invece di lanciare un'eccezione: l'errore viene inviato
+	// da sendRequestError, senza il costo dell'unwinding (es. richieste non valide in grande quantità)
+	using ExpectedHandler = std::function<std::expected<void, FastCGIError::RequestError>(
+		const std::string_view&, // sThreadId
+		FCGX_Request &, // request
+		const FCGIRequestData& // requestData
+	)>;
+
 	virtual void stopFastcgi();
 
 	int operator()();
@@ -58,11 +92,90 @@ protected:
 
 	bool _fcgxFinishDone{};
 
+	// Mutex: tutti i thread condividono il socket ereditato (fd 0, spawn-fcgi) e serializzano
+	//	FCGX_Accept_r tramite _fcgiAcceptMutex
+	// ReusePort: ogni thread apre il proprio socket in listen su _listenAddress con SO_REUSEPORT,
+	//	il kernel distribuisce le connessioni tra i socket e non serve nessun lock globale
+	enum class AcceptMode
+	{
+		Mutex,
+		ReusePort
+	};
+
+	// LibFcgi: richieste gestite da libfcgi (una richiesta per connessione)
+	// Native: protocollo FastCGI gestito da FCGIConnection (FCGI_KEEP_CONN, multiplexing, FCGI_GET_VALUES)
+	enum class Transport
+	{
+		LibFcgi,
+		Native
+	};
+
 	std::string _hostName;
 	int64_t _maxAPIContentLength{};
+	// api->requestBody: body degli handler registrati con BodyMode::Streaming o BodyMode::Spool
+	int64_t _maxStreamingContentLength{};
+	int64_t _requestBodySpoolThreshold{};
+	std::string _requestBodySpoolDirectory;
+	// api->responseCompression: Content-Encoding negoziato con Accept-Encoding (sendSuccess e FCGIResponseStream)
+	bool _responseCompressionEnabled{};
+	// body più piccoli non vengono compressi
+	int64_t _responseCompressionMinSize{};
+	uint32_t _responseCompressionEncodings{};
+	int32_t _gzipCompressionLevel{};
+	int32_t _zstdCompressionLevel{};
+	// api->responseCompression->zstdDictionary: dizionario per le risposte zstd dei client che lo hanno
+	// (X-Zstd-Dictionary-Id), annunciato agli altri con Link se url è configurato
+	std::shared_ptr<FCGIZstdDictionary> _zstdDictionary;
+	std::string _zstdDictionaryURL;
+	// con il dizionario conviene comprimere anche body molto piccoli
+	int64_t _zstdDictionaryMinSize{};
+	// api->responseETag: ETag (XXH64 del body) nelle risposte 200 di sendSuccess alle GET/HEAD, 304 se la richiesta
+	// condizionale è soddisfatta (il body viene comunque prodotto dall'handler, ma non inviato)
+	bool _responseETagEnabled{};
+	// api->requestArenaSize: buffer iniziale dell'arena di ogni richiesta
+	int64_t _requestArenaSize{};
 	std::mutex *_fcgiAcceptMutex{};
+	AcceptMode _acceptMode{AcceptMode::Mutex};
+	std::string _listenAddress;
+	int _listenBacklog{};
+	// socket di AcceptMode::ReusePort: scritto dal thread che lo apre/chiude e letto da stopFastcgi,
+	// sempre sotto _listenSocketMutex (lo shutdown non deve colpire un fd già chiuso e riassegnato)
+	std::mutex _listenSocketMutex;
+	int _listenSocket{-1};
+	Transport _transport{Transport::LibFcgi};
+	int32_t _fcgiMaxConnections{};
+	int32_t _fcgiMaxRequests{};
+
+	// worker pool (api->workerPool): i primi _workerPoolAcceptorThreads thread accettano le richieste
+	// e le accodano, gli altri thread eseguono gli handler. Il numero dei thread è quello delle istanze di FastCGIAPI
+	// create dall'applicazione, api->workerPool->workerQueues è il numero delle deque del pool
+	int32_t _workerPoolAcceptorThreads{};
+	int32_t _workerPoolWorkerQueues{};
+	std::shared_ptr<FCGIWorkerPool> _workerPool;
+
+	// cache (di processo) degli esiti di checkAuthorization (api->authorizationCache, maxEntries 0: disabilitata).
+	// Da abilitare solo se checkAuthorization dipende unicamente dalle credenziali
+	std::shared_ptr<FCGIAuthorizationCache> _authorizationCache;
+
+	// cache (di processo) delle risposte GET delle route con cacheTTL (api->responseCache, maxEntries 0: disabilitata)
+	std::shared_ptr<FCGIResponseCache> _responseCache;
+
+	// connessioni aperte dal transport Native in tutto il processo (tutti i thread)
+	static inline std::atomic<int32_t> _nativeConnectionsNumber{};
 
 	std::unordered_map<std::string, Handler> _handlers;
+	std::unordered_map<std::string, AsyncHandler> _asyncHandlers;
+	// router delle route REST: _routeHandlers[i] gestisce la route i
+	FCGIRouter _router;
+	// solo gli handler che non usano BodyMode::Buffered
+	std::unordered_map<std::string, FCGIRequestData::BodyMode> _handlersBodyMode;
+
+	// event loop del thread, usato dagli AsyncHandler
+	FCGIEventLoop _eventLoop;
+
+	// arena della richiesta in gestione, liberata in blocco al termine della richiesta.
+	// Utilizzabile dagli handler per le allocazioni temporanee (std::pmr::string, std::pmr::vector, ...)
+	[[nodiscard]] std::pmr::memory_resource *requestArena() const { return _currentRequestArena; }
 
 	virtual std::shared_ptr<ThreadLogger> requestThreadLogger(const FCGIRequestData& requestData);
 
@@ -72,9 +185,42 @@ protected:
 		const FCGIRequestData &requestData, bool exceptionIfNotManaged);
 
 	template <typename F>
-	void registerHandler(const std::string& name, F&& f)
+	void registerHandler(const std::string& name, F&& f, const FCGIRequestData::BodyMode bodyMode = FCGIRequestData::BodyMode::Buffered)
+	{
+		if (bodyMode != FCGIRequestData::BodyMode::Buffered)
+			_handlersBodyMode[name] = bodyMode;
+
+		Handlers handlers = makeHandlers(std::forward<F>(f));
+		if (handlers.asyncHandler)
+			_asyncHandlers[name] = std::move(handlers.asyncHandler);
+		else
+			_handlers[name] = std::move(handlers.handler);
+	}
+
+	// handler con i parametri dichiarati in schema: riceve in più la struct P già letta e validata
+	// (const P& per un Handler, P per valore per un AsyncHandler). Parametri non validi: sendRequestError,
+	// senza eccezioni, e l'handler non viene chiamato
+	template <typename P, typename F>
+	void registerHandler(const std::string& name, FCGIParameterSchema<P> schema, F&& f,
+		const FCGIRequestData::BodyMode bodyMode = FCGIRequestData::BodyMode::Buffered)
+	{
+		registerHandler(name, schemaHandler(std::move(schema), std::forward<F>(f)), bodyMode);
+	}
+
+	// route REST (metodo + path con parametri, vedi FCGIRouter), con precedenza su x-api-method.
+	// Gli handler sono gli stessi di registerHandler, i parametri del path sono in requestData.getPathParameter
+	template <typename F>
+	void registerRoute(const std::string_view method, const std::string_view pathPattern, F&& f, FCGIRouter::RouteOptions options = {})
 	{
-		_handlers[name] = std::forward<F>(f);
+		_router.addRoute(method, pathPattern, std::move(options));
+		_routeHandlers.push_back(makeHandlers(std::forward<F>(f)));
+	}
+
+	template <typename P, typename F>
+	void registerRoute(const std::string_view method, const std::string_view pathPattern, FCGIParameterSchema<P> schema, F&& f,
+		FCGIRouter::RouteOptions options = {})
+	{
+		registerRoute(method, pathPattern, schemaHandler(std::move(schema), std::forward<F>(f)), std::move(options));
 	}
 
 	virtual std::shared_ptr<FCGIRequestData::AuthorizationDetails> checkAuthorization(const std::string_view& sThreadId,
@@ -82,6 +228,31 @@ protected:
 
 	virtual bool basicAuthenticationRequired(const FCGIRequestData& requestData);
 
+	// da chiamare quando cambiano credenziali o permessi di un utente: le richieste successive
+	// ripassano da checkAuthorization (tutti i thread, la cache è di processo)
+	void invalidateAuthorization(const std::string_view userName) const
+	{
+		if (_authorizationCache)
+			_authorizationCache->invalidate(userName);
+	}
+	void invalidateAllAuthorizations() const
+	{
+		if (_authorizationCache)
+			_authorizationCache->clear();
+	}
+
+	// da chiamare quando cambiano i dati delle risposte in cache con il tag (RouteOptions::cacheTags),
+	// ritorna il numero di risposte eliminate (tutti i thread, la cache è di processo)
+	size_t invalidateResponseCache(const std::string_view tag) const { return _responseCache ? _responseCache->invalidate(tag) : 0; }
+	void invalidateAllResponseCache() const
+	{
+		if (_responseCache)
+			_responseCache->clear();
+	}
+
+	// chiamato prima della lettura del body, di default usa il BodyMode con cui è stato registrato l'handler (x-api-method)
+	virtual FCGIRequestData::BodyOptions requestBodyOptions(const FCGIRequestData& requestData);
+
 	void sendSuccess(
 		const std::string_view& sThreadId, bool responseBodyCompressed, FCGX_Request &request, const std::string_view& requestURI,
 		const std::string_view& requestMethod, int htmlResponseCode, const std::string_view& responseBody = "", const std::string_view& contentType = "",
@@ -91,13 +262,205 @@ protected:
 	void sendRedirect(FCGX_Request &request, const std::string_view& locationURL, bool permanently, const std::string_view& contentType = "");
 	void sendHeadSuccess(FCGX_Request &request, int16_t htmlResponseCode, unsigned long fileSize);
 	static void sendHeadSuccess(int16_t htmlResponseCode, unsigned long fileSize);
+
+	// file come body della risposta, senza copie in user space (sendfile con il transport Native,
+	// mmap + FCGX_PutStr con libfcgi). Header Range (solo GET): 206 con uno o più intervalli
+	// (multipart/byteranges), 416 se nessun intervallo è soddisfacibile. HEAD: solo gli header.
+	// If-None-Match soddisfatto: 304 per GET e HEAD, 412 per gli altri metodi.
+	// File non presente: HTTPError 404
+	void sendFile(FCGX_Request &request, const FCGIRequestData &requestData, const std::string &filePath,
+		std::string_view contentType = "application/octet-stream");
+	// fd (file regolare) resta del chiamante
+	void sendFile(FCGX_Request &request, const FCGIRequestData &requestData, int fd, std::string_view contentType = "application/octet-stream");
+
+	// risposta scritta a pezzi invece che con sendSuccess (vedi FCGIResponseStream)
+	FCGIResponseStream responseStream(FCGX_Request &request, const int htmlResponseCode = 200,
+		const std::string_view contentType = "application/json; charset=utf-8")
+	{
+		return {*this, request, htmlResponseCode, contentType};
+	}
+
+	// upload ripristinabile in filePath (vedi FCGIUploadSink), l'handler va registrato con BodyMode::Streaming o Spool:
+	//	- HEAD: risponde con i byte contigui già ricevuti (sendHeadSuccess)
+	//	- PUT/POST: scrive il body all'offset indicato da Content-Range (senza Content-Range il body è l'intero file)
+	//		e risponde con i byte contigui ricevuti (201 quando l'upload è completo)
+	// La risposta viene inviata da questo metodo, ritorna true se l'upload è completo
+	bool receiveResumableUpload(
+		const std::string_view &sThreadId, FCGX_Request &request, const FCGIRequestData &requestData, const std::string &filePath
+	);
 	virtual void sendError(FCGX_Request &request, int16_t htmlResponseCode, const std::string_view &responseBody);
+	// errore ritornato da un ExpectedHandler o dai getter try*: LOG_DEBUG invece di LOG_ERROR
+	// (tipicamente richieste non valide dei client) e sendError
+	void sendRequestError(FCGX_Request &request, const FastCGIError::RequestError &requestError);
 	// void sendError(int htmlResponseCode, string errorMessage);
 
+	// chiude la richiesta (FCGX_Finish_r oppure FCGIConnection::finishRequest in base al transport)
+	static void finishRequest(FCGX_Request &request);
+
 private:
+	// richiesta il cui AsyncHandler si è sospeso: request e requestData restano vivi fino al termine della coroutine
+	struct AsyncRequest
+	{
+		FCGX_Request *request{};
+		// FCGX_Request allocata dal loop (libfcgi/worker pool), nel transport Native appartiene a FCGIConnection
+		FCGXRequestPtr ownedRequest;
+		// dichiarata prima di requestData perchè deve essere distrutta dopo
+		std::unique_ptr<FCGIRequestArena> requestArena;
+		std::unique_ptr<FCGIRequestData> requestData;
+		FCGITask task;
+		bool fcgxFinishDone{};
+	};
+
+	// Handler oppure AsyncHandler (uno solo dei due) di un handler registrato
+	struct Handlers
+	{
+		Handler handler;
+		AsyncHandler asyncHandler;
+	};
+
+	// indicizzato con requestData.routeIndex
+	std::vector<Handlers> _routeHandlers;
+
+	std::vector<std::unique_ptr<AsyncRequest>> _asyncRequests;
+	// api->asyncShutdownTimeoutInSeconds: attesa massima degli AsyncHandler sospesi allo shutdown,
+	// scaduta le richieste ricevono 503 e le coroutine vengono distrutte
+	int64_t _asyncShutdownTimeoutInSeconds{};
+	// impostato da handleRequest se l'AsyncHandler si è sospeso, preso in carico da processRequest
+	std::unique_ptr<AsyncRequest> _suspendedAsyncRequest;
+
+	// arena del thread per le richieste sincrone e arena della richiesta in gestione
+	// (diversa durante la ripresa di un AsyncHandler)
+	std::unique_ptr<FCGIRequestArena> _requestArena;
+	FCGIRequestArena *_currentRequestArena{};
+
+	// header della risposta in costruzione (send*), riutilizzato tra le richieste del thread
+	std::string _responseHeaders;
+
+	// richiesta in gestione (salvata/ripristinata intorno alla ripresa di un AsyncHandler, come _fcgxFinishDone),
+	// usata da sendSuccess e FCGIResponseStream per l'encoding negoziato
+	const FCGIRequestData *_currentRequestData{};
+
+	// contesti di compressione del thread, riutilizzati tra le risposte
+	// (più di uno solo con risposte in streaming di AsyncHandler sospesi)
+	std::vector<std::unique_ptr<FCGIResponseCompressor>> _responseCompressors;
+	std::unique_ptr<FCGIResponseCompressor> acquireResponseCompressor();
+	void releaseResponseCompressor(std::unique_ptr<FCGIResponseCompressor> responseCompressor);
+
+	// dizionario zstd da usare per la risposta di requestData, nullptr se nessuno
+	[[nodiscard]] const FCGIZstdDictionary *responseZstdDictionary(const FCGIRequestData &requestData) const
+	{
+		return requestData.responseZstdDictionary ? _zstdDictionary.get() : nullptr;
+	}
+
+	// header della codifica della risposta di requestData: Content-Encoding e id del dizionario zstd se il body è compresso,
+	// Vary per ogni risposta con l'encoding negoziato (anche non compressa, es. sotto minSize), in ogni caso
+	// l'annuncio del dizionario zstd ai client che accettano zstd e non lo hanno
+	template <typename OutputIt>
+	void formatResponseEncodingHeaders(OutputIt headers, const FCGIRequestData &requestData, const bool bodyCompressed) const
+	{
+		if (bodyCompressed)
+		{
+			std::format_to(headers, "Content-Encoding: {}\r\n", FCGIResponseCompressor::name(requestData.responseEncoding));
+			if (requestData.responseZstdDictionary)
+				std::format_to(headers, "X-Zstd-Dictionary-Id: {}\r\n", _zstdDictionary->id());
+		}
+		if (bodyCompressed || requestData.responseEncodingNegotiated)
+			std::format_to(headers, "Vary: {}\r\n", _zstdDictionary ? "Accept-Encoding, X-Zstd-Dictionary-Id" : "Accept-Encoding");
+		if (requestData.responseEncoding == FCGIResponseCompressor::Encoding::Zstd && !requestData.responseZstdDictionary && !_zstdDictionaryURL.empty())
+			std::format_to(headers, "Link: <{}>; rel=\"x-zstd-dictionary\"\r\n", _zstdDictionaryURL);
+	}
+
 	void loadConfiguration(nlohmann::json configurationRoot);
 
-	static std::string base64_encode(const std::string &in);
+	// scrive _responseHeaders e responseBody su request.out
+	void writeResponse(FCGX_Request &request, std::string_view responseBody) const;
+	// scrive length byte di fd (da offset) su request.out
+	static bool writeFileRange(FCGX_Request &request, int fd, uint64_t offset, uint64_t length);
+
+	template <typename F>
+	Handlers makeHandlers(F&& f)
+	{
+		Handlers handlers;
+		if constexpr (std::is_invocable_r_v<FCGITask, F, std::string_view, FCGX_Request &, const FCGIRequestData &>)
+			handlers.asyncHandler = std::forward<F>(f);
+		else if constexpr (std::is_same_v<std::invoke_result_t<F, const std::string_view &, FCGX_Request &, const FCGIRequestData &>,
+							   std::expected<void, FastCGIError::RequestError>>)
+			handlers.handler = [this, f = ExpectedHandler(std::forward<F>(f))](const std::string_view &sThreadId, FCGX_Request &request,
+				const FCGIRequestData &requestData)
+			{
+				if (auto result = f(sThreadId, request, requestData); !result)
+					sendRequestError(request, result.error());
+			};
+		else
+			handlers.handler = std::forward<F>(f);
+
+		return handlers;
+	}
+
+	template <typename P, typename F>
+	auto schemaHandler(FCGIParameterSchema<P> schema, F&& f)
+	{
+		if constexpr (std::is_invocable_r_v<FCGITask, F, std::string_view, FCGX_Request &, const FCGIRequestData &, P>)
+			return [this, schema = std::move(schema), f = std::forward<F>(f)](std::string_view sThreadId, FCGX_Request &request,
+				const FCGIRequestData &requestData) -> FCGITask
+			{
+				auto parameters = schema.tryParse(requestData);
+				if (!parameters)
+				{
+					sendRequestError(request, parameters.error());
+					return {};
+				}
+				return f(sThreadId, request, requestData, std::move(*parameters));
+			};
+		else
+			return [this, schema = std::move(schema), f = std::forward<F>(f)](const std::string_view &sThreadId, FCGX_Request &request,
+				const FCGIRequestData &requestData)
+			{
+				auto parameters = schema.tryParse(requestData);
+				if (!parameters)
+				{
+					sendRequestError(request, parameters.error());
+					return;
+				}
+				f(sThreadId, request, requestData, *parameters);
+			};
+	}
+
+	// cerca la route della richiesta (prima della lettura del body): routeIndex e parametri del path in requestData.
+	// Se il path corrisponde a delle route ma non il metodo ritorna i metodi ammessi (header Allow del 405)
+	[[nodiscard]] std::string routeRequest(FCGIRequestData &requestData) const;
+	// 405 con l'header Allow
+	void sendMethodNotAllowed(FCGX_Request &request, std::string_view allowedMethods);
+	// Content-Encoding della risposta (requestData.responseEncoding) in base ad Accept-Encoding, configurazione e route
+	void negotiateResponseEncoding(FCGIRequestData &requestData) const;
+	// api->responseETag o RouteOptions::responseETag per la richiesta
+	[[nodiscard]] bool responseETag(const FCGIRequestData &requestData) const;
+	// requestData.responseCacheKey per le GET delle route con cacheTTL (dopo l'autorizzazione: la chiave comprende l'utente)
+	void setResponseCacheKey(FCGIRequestData &requestData) const;
+	// tag della route con i parametri del path della richiesta
+	static std::vector<std::string> responseCacheTags(const FCGIRouter::RouteOptions &routeOptions, const FCGIRequestData &requestData);
+	// inserisce in _responseCache la risposta della richiesta in gestione (nullptr: nessuna)
+	void insertCachedResponse(std::shared_ptr<const FCGIResponseCache::Response> cachedResponse) const;
+	// risposta (o 304) da _responseCache senza eseguire l'handler, false se non è in cache
+	bool sendCachedResponse(const std::string_view &sThreadId, FCGX_Request &request, const FCGIRequestData &requestData);
+
+	void fcgiRequestsLoop(const std::string &sThreadId, int sock_fd);
+	void acceptorRequestsLoop(const std::string &sThreadId, int sock_fd);
+	void workerRequestsLoop(const std::string &sThreadId, int32_t workerIndex);
+	// 503 alla richiesta che nessun worker gestirà (coda piena, shutdown)
+	void rejectRequest(FCGX_Request &request);
+	bool acceptRequest(const std::string &sThreadId, FCGX_Request &request, int sock_fd, bool blocking);
+	void nativeRequestsLoop(const std::string &sThreadId, int sock_fd);
+	// ritorna true se la richiesta è gestita da un AsyncHandler ancora in esecuzione
+	bool processRequest(const std::string &sThreadId, FCGX_Request &request);
+	bool manageRequest(const std::string &sThreadId, FCGX_Request &request);
+
+	void startAsyncHandler(const AsyncHandler &asyncHandler, std::string_view sThreadId, FCGX_Request &request, const FCGIRequestData &requestData);
+	void resumeAsyncRequest(AsyncRequest &asyncRequest, std::coroutine_handle<> handle);
+	// attende (al massimo 1 secondo) il socket e l'event loop, ritorna true se il socket è pronto in lettura
+	bool waitListenSocket(int sock_fd);
+	static bool socketReadable(int socket, int timeoutMilliseconds);
+	void drainAsyncRequests();
 
-	static std::string base64_decode(const std::string &in);
+	static int openReusePortSocket(const std::string &listenAddress, int listenBacklog);
 };
\ No newline at end of file
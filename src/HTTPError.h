@@ -22,99 +22,252 @@
 #pragma once
 
 #include "ThreadLogger.h"
+#include <array>
+#include <cstdint>
 #include <format>
+#include <iterator>
 #include <stdexcept>
 #include <string>
+#include <string_view>
+#include <utility>
 
 namespace FastCGIError
 {
 
+// reason phrase dei codici di stato HTTP gestiti
+inline constexpr std::pair<int16_t, std::string_view> reasonPhrases[] = {
+	{100, "Continue"},
+	{101, "Switching Protocols"},
+	{102, "Processing"},
+	{103, "Early Hints"},
+	{200, "OK"},
+	{201, "Created"},
+	{202, "Accepted"},
+	{203, "Non-Authoritative Information"},
+	{204, "No Content"},
+	{205, "Reset Content"},
+	{206, "Partial Content"},
+	{207, "Multi-Status"},
+	{208, "Already Reported"},
+	{226, "IM Used"},
+	{300, "Multiple Choices"},
+	{301, "Moved Permanently"},
+	{302, "Found"},
+	{303, "See Other"},
+	{304, "Not Modified"},
+	{307, "Temporary Redirect"},
+	{308, "Permanent Redirect"},
+	{400, "Bad Request"},
+	{401, "Unauthorized"},
+	{402, "Payment Required"},
+	{403, "Forbidden"},
+	{404, "Not Found"},
+	{405, "Method Not Allowed"},
+	{406, "Not Acceptable"},
+	{407, "Proxy Authentication Required"},
+	{408, "Request Timeout"},
+	{409, "Conflict"},
+	{410, "Gone"},
+	{411, "Length Required"},
+	{412, "Precondition Failed"},
+	{413, "Content Too Large"},
+	{414, "URI Too Long"},
+	{415, "Unsupported Media Type"},
+	{416, "Range Not Satisfiable"},
+	{417, "Expectation Failed"},
+	{418, "I'm a teapot"},
+	{421, "Misdirected Request"},
+	{422, "Unprocessable Content"},
+	{423, "Locked"},
+	{424, "Failed Dependency"},
+	{425, "Too Early"},
+	{426, "Upgrade Required"},
+	{428, "Precondition Required"},
+	{429, "Too Many Requests"},
+	{431, "Request Header Fields Too Large"},
+	{451, "Unavailable For Legal Reasons"},
+	{500, "Internal Server Error"},
+	{501, "Not Implemented"},
+	{502, "Bad Gateway"},
+	{503, "Service Unavailable"},
+	{504, "Gateway Timeout"},
+	{505, "HTTP Version Not Supported"},
+	{506, "Variant Also Negotiates"},
+	{507, "Insufficient Storage"},
+	{508, "Loop Detected"},
+	{510, "Not Extended"},
+	{511, "Network Authentication Required"}
+};
+
+// reason phrase di un codice: quella generica della classe (es. "Client Error") se il codice non è in reasonPhrases
+constexpr std::string_view reasonPhrase(const int16_t httpCode)
+{
+	for (const auto &[code, phrase] : reasonPhrases)
+	{
+		if (code == httpCode)
+			return phrase;
+	}
+
+	switch (httpCode / 100)
+	{
+	case 1:
+		return "Informational";
+	case 2:
+		return "Success";
+	case 3:
+		return "Redirection";
+	case 4:
+		return "Client Error";
+	default:
+		return "Server Error";
+	}
+}
+
+// "Status: " + "NNN " ... "\r\n"
+inline constexpr size_t statusLineOverhead = 14;
+
+constexpr size_t statusLinesSize(const int16_t minCode, const int16_t maxCode)
+{
+	size_t size = 0;
+	for (int16_t code = minCode; code <= maxCode; code++)
+		size += statusLineOverhead + reasonPhrase(code).size();
+	return size;
+}
+
+// righe "Status: NNN Reason\r\n" della risposta FastCGI, composte a compile time per tutti i codici 100-599
+// e indicizzate per codice: nessuna ricerca, formattazione o allocazione per risposta
+class StatusLines final
+{
+public:
+	static constexpr int16_t minCode = 100;
+	static constexpr int16_t maxCode = 599;
+	static constexpr size_t codesNumber = maxCode - minCode + 1;
+
+	constexpr StatusLines()
+	{
+		size_t offset = 0;
+		for (int16_t code = minCode; code <= maxCode; code++)
+		{
+			_offsets[code - minCode] = static_cast<uint16_t>(offset);
+			for (const char c : std::string_view("Status: "))
+				_storage[offset++] = c;
+			_storage[offset++] = static_cast<char>('0' + code / 100);
+			_storage[offset++] = static_cast<char>('0' + code / 10 % 10);
+			_storage[offset++] = static_cast<char>('0' + code % 10);
+			_storage[offset++] = ' ';
+			for (const char c : reasonPhrase(code))
+				_storage[offset++] = c;
+			_storage[offset++] = '\r';
+			_storage[offset++] = '\n';
+		}
+		_offsets[codesNumber] = static_cast<uint16_t>(offset);
+	}
+
+	// codice fuori da 100-599: riga del 500
+	[[nodiscard]] constexpr std::string_view line(const int16_t code) const
+	{
+		const size_t index = code >= minCode && code <= maxCode ? code - minCode : 500 - minCode;
+		return {_storage.data() + _offsets[index], static_cast<size_t>(_offsets[index + 1] - _offsets[index])};
+	}
+
+private:
+	std::array<char, statusLinesSize(minCode, maxCode)> _storage{};
+	std::array<uint16_t, codesNumber + 1> _offsets{};
+};
+
+inline constexpr StatusLines statusLines;
+
 struct HTTPError final : std::runtime_error
 {
 	int16_t httpErrorCode;
 
-	static inline std::map<int16_t, std::string> _codes = {
-		{100, "Continue"},
-		{101, "Switching Protocols"},
-		{102, "Processing"},
-		{103, "Early Hints"},
-		{200, "OK"},
-		{201, "Created"},
-		{202, "Accepted"},
-		{203, "Non-Authoritative Information"},
-		{204, "No Content"},
-		{205, "Reset Content"},
-		{206, "Partial Content"},
-		{207, "Multi-Status"},
-		{208, "Already Reported"},
-		{226, "IM Used"},
-		{300, "Multiple Choices"},
-		{301, "Moved Permanently"},
-		{302, "Found"},
-		{303, "See Other"},
-		{304, "Not Modified"},
-		{307, "Temporary Redirect"},
-		{308, "Permanent Redirect"},
-		{400, "Bad Request"},
-		{401, "Unauthorized"},
-		{402, "Payment Required"},
-		{403, "Forbidden"},
-		{404, "Not Found"},
-		{405, "Method Not Allowed"},
-		{406, "Not Acceptable"},
-		{407, "Proxy Authentication Required"},
-		{408, "Request Timeout"},
-		{409, "Conflict"},
-		{410, "Gone"},
-		{411, "Length Required"},
-		{412, "Precondition Failed"},
-		{413, "Content Too Large"},
-		{414, "URI Too Long"},
-		{415, "Unsupported Media Type"},
-		{416, "Range Not Satisfiable"},
-		{417, "Expectation Failed"},
-		{418, "I'm a teapot"},
-		{421, "Misdirected Request"},
-		{422, "Unprocessable Content"},
-		{423, "Locked"},
-		{424, "Failed Dependency"},
-		{425, "Too Early"},
-		{426, "Upgrade Required"},
-		{428, "Precondition Required"},
-		{429, "Too Many Requests"},
-		{431, "Request Header Fields Too Large"},
-		{451, "Unavailable For Legal Reasons"},
-		{500, "Internal Server Error"},
-		{501, "Not Implemented"},
-		{502, "Bad Gateway"},
-		{503, "Service Unavailable"},
-		{504, "Gateway Timeout"},
-		{505, "HTTP Version Not Supported"},
-		{506, "Variant Also Negotiates"},
-		{507, "Insufficient Storage"},
-		{508, "Loop Detected"},
-		{510, "Not Extended"},
-		{511, "Network Authentication Required"}
-	};
-
 	explicit HTTPError(const int16_t httpErrorCode, const std::string& errorMessage = "") :
-		std::runtime_error(errorMessage.empty() ? getHtmlStandardMessage(httpErrorCode) : errorMessage),
+		std::runtime_error(errorMessage.empty() ? std::string(getHtmlStandardMessage(httpErrorCode)) : errorMessage),
 		httpErrorCode(httpErrorCode) {};
 
-	static std::string getHtmlStandardMessage(int16_t htmlResponseCode)
+	// "Status: NNN Reason\r\n"
+	static constexpr std::string_view statusLine(const int16_t htmlResponseCode) { return statusLines.line(htmlResponseCode); }
+
+	// un codice non gestito non è un errore: reason phrase generica della classe (fuori da 100-599 quella del 500)
+	static constexpr std::string_view getHtmlStandardMessage(const int16_t htmlResponseCode)
 	{
-		if (const auto it = _codes.find(htmlResponseCode); it != _codes.end())
-			return it->second;
+		std::string_view line = statusLine(htmlResponseCode);
+		line.remove_prefix(statusLineOverhead - 2);
+		line.remove_suffix(2);
+		return line;
+	}
+};
 
-		const std::string errorMessage = std::format(
-			"HTTP status code not managed"
-			", htmlResponseCode: {}",
-			htmlResponseCode
-		);
-		LOG_ERROR(errorMessage);
+// errore di una richiesta come valore (std::expected<T, RequestError>), alternativa a HTTPError
+// dove il costo dell'eccezione conta (es. richieste non valide in grande quantità).
+// Il messaggio viene formattato solo da message(); parameterName e value puntano nella memoria
+// della richiesta o del chiamante e sono validi quanto la richiesta
+struct RequestError
+{
+	enum class Reason : uint8_t
+	{
+		MissingParameter,
+		InvalidValue,
+		NotAllowedValue,
+		Other
+	};
+
+	int16_t httpErrorCode{400};
+	Reason reason{Reason::Other};
+	std::string_view parameterName;
+	std::string_view value;
+	// Reason::Other: messaggio della risposta, vuoto per il messaggio standard di httpErrorCode
+	// Reason::NotAllowedValue: elenco dei valori ammessi (vedi allowedValuesList)
+	std::string detail;
+
+	static RequestError missingParameter(const std::string_view parameterName)
+	{
+		return {400, Reason::MissingParameter, parameterName, {}, {}};
+	}
+	static RequestError invalidValue(const std::string_view parameterName, const std::string_view value)
+	{
+		return {400, Reason::InvalidValue, parameterName, value, {}};
+	}
+	static RequestError notAllowedValue(const std::string_view parameterName, const std::string_view value, std::string allowedValues)
+	{
+		return {400, Reason::NotAllowedValue, parameterName, value, std::move(allowedValues)};
+	}
+	// valori ammessi separati da ", " per notAllowedValue
+	template <typename R> static std::string allowedValuesList(const R &allowedValues)
+	{
+		std::string list;
+		bool first = true;
+		for (const auto &allowedValue : allowedValues)
+		{
+			std::format_to(std::back_inserter(list), "{}{}", first ? "" : ", ", allowedValue);
+			first = false;
+		}
+		return list;
+	}
+	static RequestError http(const int16_t httpErrorCode, std::string detail = {})
+	{
+		return {httpErrorCode, Reason::Other, {}, {}, std::move(detail)};
+	}
 
-		throw runtime_error(errorMessage);
+	[[nodiscard]] std::string message() const
+	{
+		switch (reason)
+		{
+		case Reason::MissingParameter:
+			return std::format("Missing mandatory header/query parameter: {}", parameterName);
+		case Reason::InvalidValue:
+			return std::format("Wrong parameter value"
+				", parameterName: {}"
+				", value: {}", parameterName, value);
+		case Reason::NotAllowedValue:
+			return std::format("Invalid value '{}' for '{}'. Allowed values are: {}", value, parameterName, detail);
+		default:
+			return detail.empty() ? std::string(HTTPError::getHtmlStandardMessage(httpErrorCode)) : detail;
+		}
 	}
+
+	// per chi preferisce l'eccezione (getter che lanciano)
+	[[nodiscard]] HTTPError exception() const { return HTTPError(httpErrorCode, message()); }
 };
 
 } // namespace mms::fc